@@ -74,7 +74,18 @@ int main(void)
     mt_world_add_object(world, ball4, MT_OBJECT_SPHERE);
     MT_Sphere *ball5 = mt_sphere_create((MT_Vec3){2, -1, 2}, 1.0f, mat_glossy);
     mt_world_add_object(world, ball5, MT_OBJECT_SPHERE);
-    
+
+    // a ring of beads scattered around the balls, one object however many there are
+    MT_SphereCloud *beads = mt_sphere_cloud_create(2000);
+    for (int i = 0; i < 2000; ++i)
+    {
+        float angle = i * 2.39996f;
+        float distance = 3.5f + (i % 97) / 97.0f * 2.5f;
+        float radius = 0.03f + (i % 13) / 13.0f * 0.05f;
+        mt_sphere_cloud_add_sphere(beads, (MT_Vec3){cosf(angle) * distance, -radius, sinf(angle) * distance}, radius, i % 3 ? mat_diffuse : mat_glossy);
+    }
+    mt_world_add_object(world, beads, MT_OBJECT_SPHERE_CLOUD);
+
     mt_world_recalculate_bvh(world);
 
     RaylibInstance instance = raylib_instance_create((MT_Vec3 *)malloc(sizeof(MT_Vec3) * render_width * render_height), render_width, render_height, render_scale, 2500, 200);
@@ -55,13 +55,14 @@ int main(void)
     MT_Sphere* sphere = mt_sphere_create((MT_Vec3){14.178, 1.525, 12.026}, 1.0f, mat_glass);
     mt_world_add_object(world, sphere, MT_OBJECT_SPHERE);
 
+    // every cube is an analytic box, one test each instead of 12 tris
     mt_random_init();
     for (int i = 0; i < 500; ++i)
     {
-        MT_Mesh *cube = mt_mesh_create_cube((MT_Vec3){mt_random_float() * 10, mt_random_float() * 10, mt_random_float() * 10}, (MT_Vec3){0, 0, 0}, (MT_Vec3){1, 1, 1}, mat_glossy);
-        mt_world_add_object(world, cube, MT_OBJECT_MESH);
+        mt_world_create_box(world, (MT_Vec3){mt_random_float() * 10, mt_random_float() * 10, mt_random_float() * 10}, (MT_Vec3){0, 0, 0}, (MT_Vec3){1, 1, 1}, mat_glossy);
     }
 
+    mt_world_enable_wide_bvh(world, 1);
     mt_world_recalculate_bvh(world);
 
     RaylibInstance instance = raylib_instance_create((MT_Vec3 *)malloc(sizeof(MT_Vec3) * render_width * render_height), render_width, render_height, render_scale, 2500, 200);
@@ -28,6 +28,7 @@ int main(void)
     mt_renderer_enable_progressive(renderer, 1);
     mt_renderer_enable_antialiasing(renderer, 1);
     mt_renderer_enable_bvh(renderer, 1);
+    mt_renderer_enable_grid(renderer, 1); // hundreds of similar cubes suit a grid
 
     camera->position.x = 14.178;
     camera->position.y = 1.525;
@@ -59,17 +60,17 @@ int main(void)
     MT_Sphere *sphere2 = mt_sphere_create((MT_Vec3){0, -20, 25}, 10.0f, mat_glass);
     mt_world_add_object(world, sphere2, MT_OBJECT_SPHERE);
 
-    MT_Mesh *floor = mt_mesh_create_plane((MT_Vec3){0, 15, 0}, (MT_Vec3){0, 0, 0}, (MT_Vec3){100, 1, 100}, mat_glossy);
-    mt_world_add_object(world, floor, MT_OBJECT_MESH);
+    MT_Plane *floor = mt_plane_create((MT_Vec3){0, 15, 0}, (MT_Vec3){0, 0, 0}, mat_glossy);
+    mt_world_add_object(world, floor, MT_OBJECT_PLANE);
 
+    // every cube is an analytic box, one test each instead of 12 tris
     mt_random_init();
     for (int i = 0; i < 500; ++i)
     {
-        MT_Mesh *cube = mt_mesh_create_cube((MT_Vec3){mt_random_float() * 10, mt_random_float() * 10, mt_random_float() * 10}, (MT_Vec3){0, 0, 0}, (MT_Vec3){1, 1, 1}, mat_diffuse_red);
-        mt_world_add_object(world, cube, MT_OBJECT_MESH);
+        mt_world_create_box(world, (MT_Vec3){mt_random_float() * 10, mt_random_float() * 10, mt_random_float() * 10}, (MT_Vec3){0, 0, 0}, (MT_Vec3){1, 1, 1}, mat_diffuse_red);
     }
 
-    mt_world_recalculate_bvh(world);
+    mt_world_recalculate_grid(world);
 
     RaylibInstance instance = raylib_instance_create((MT_Vec3 *)malloc(sizeof(MT_Vec3) * render_width * render_height), render_width, render_height, render_scale, 2500, 200);
     while (!WindowShouldClose())
@@ -35,6 +35,20 @@
 #include <limits.h>
 #include <float.h>
 #include <pthread.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <malloc.h>
+#endif
+
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
 
 ///////////////////////////////
 // ========== VEC ========== //
@@ -112,19 +126,25 @@ void mt_material_delete(MT_Material *material);
 typedef enum ObjectType
 {
     MT_OBJECT_MESH,
-    MT_OBJECT_SPHERE
+    MT_OBJECT_SPHERE,
+    MT_OBJECT_INSTANCE,
+    MT_OBJECT_BOX,
+    MT_OBJECT_PLANE,
+    MT_OBJECT_SPHERE_CLOUD
 } ObjectType;
 
+// a standalone tri, meshes keep theirs as indices into shared vertex arrays instead
 typedef struct MT_Tri
 {
     MT_Vec3 p[3];
-    MT_Vec3 p_n[3];
     MT_Vec3 face_normal;
 
     MT_Material *mat;
 } MT_Tri;
 
 typedef struct MT_Mesh MT_Mesh;
+typedef struct MT_Instance MT_Instance;
+typedef struct MT_SphereCloud MT_SphereCloud;
 
 typedef struct MT_Sphere
 {
@@ -134,18 +154,50 @@ typedef struct MT_Sphere
     MT_Material *mat;
 } MT_Sphere;
 
+// an oriented box, one slab test in its own space instead of the 12 tris of a cube mesh
+typedef struct MT_Box
+{
+    MT_Vec3 position;
+    MT_Vec3 axes[3]; // its local x, y and z in world space
+    MT_Vec3 half_size;
+
+    MT_Material *mat;
+} MT_Box;
+
+// an infinite plane through position, kept out of the bvh and grid and tested by every ray instead
+typedef struct MT_Plane
+{
+    MT_Vec3 position;
+    MT_Vec3 normal;
+
+    MT_Material *mat;
+} MT_Plane;
+
 MT_Mesh *mt_mesh_create(unsigned int max_tris);
 MT_Mesh *mt_mesh_create_plane(MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale, MT_Material *material);
 MT_Mesh *mt_mesh_create_cube(MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale, MT_Material *material);
 MT_Mesh *mt_mesh_create_from_stl(const char *path, MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale, MT_Material *material);
+MT_Mesh *mt_mesh_create_from_stream(const char *path, size_t resident_bytes);
+int mt_mesh_save_stream(MT_Mesh *mesh, const char *path, unsigned int thread_count);
+// copies the tri into the mesh, which no longer keeps or frees it, tri stays the caller's and may live on the stack
 void mt_mesh_add_tri(MT_Mesh *mesh, MT_Tri *tri);
 void mt_mesh_recalculate_normals(MT_Mesh *mesh);
+void mt_mesh_reorder_tris(MT_Mesh *mesh);
 void mt_mesh_move(MT_Mesh *mesh, MT_Vec3 position);
 void mt_mesh_rotate(MT_Mesh *mesh, MT_Vec3 rotation);
 void mt_mesh_scale(MT_Mesh *mesh, MT_Vec3 scale);
 void mt_mesh_transform(MT_Mesh *mesh, MT_Vec3 translation, MT_Vec3 rotation, MT_Vec3 scale);
 
 MT_Sphere *mt_sphere_create(MT_Vec3 position, float radius, MT_Material *mat);
+MT_Box *mt_box_create(MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale, MT_Material *mat);
+MT_Plane *mt_plane_create(MT_Vec3 position, MT_Vec3 rotation, MT_Material *mat);
+
+MT_SphereCloud *mt_sphere_cloud_create(unsigned int max_spheres);
+void mt_sphere_cloud_add_sphere(MT_SphereCloud *cloud, MT_Vec3 position, float radius, MT_Material *mat);
+void mt_sphere_cloud_clear(MT_SphereCloud *cloud);
+
+MT_Instance *mt_instance_create(MT_Mesh *mesh, MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale);
+void mt_instance_transform(MT_Instance *instance, MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale);
 
 ///////////////////////////////////////
 // ========== ENVIRONMENT ========== //
@@ -164,10 +216,58 @@ MT_Environment *mt_environment_create();
 /////////////////////////////////
 typedef struct MT_World MT_World;
 
+typedef enum MT_BVHBuilder
+{
+    MT_BVH_BUILDER_MORTON, // fast build, sorts objects along a morton curve
+    MT_BVH_BUILDER_SAH,    // slower build, binned surface area heuristic for faster traversal
+    MT_BVH_BUILDER_SBVH    // slowest build, sah that may also split large objects and tris between nodes
+} MT_BVHBuilder;
+
+// children per node of the optional wide bvh, 8 fills an avx register and 4 fills an sse register
+#ifndef MT_BVH_WIDTH
+#ifdef __AVX__
+#define MT_BVH_WIDTH 8
+#else
+#define MT_BVH_WIDTH 4
+#endif
+#endif
+
+typedef struct MT_BVHStats
+{
+    unsigned int node_count;
+    unsigned int leaf_count;
+    unsigned int max_depth;
+    float sah_cost; // expected cost of a ray through the tree, lower is better
+    float build_ms; // time the last build of the object level tree took, including its treelet passes
+    float treelet_ms;
+    float brute_ray_ns; // estimated cost of a ray tested against every object
+    float bvh_ray_ns;   // estimated cost of a ray through the bvh, the auto renderer uses whichever is lower
+    size_t node_bytes;      // memory the traversed nodes take
+    size_t wide_node_bytes; // what the same wide tree takes with float bounds, 0 for binary trees
+} MT_BVHStats;
+
 MT_World *mt_world_create(unsigned int max_objects);
-void mt_world_add_object(MT_World *world, void *object, ObjectType object_type);
+int mt_world_add_object(MT_World *world, void *object, ObjectType object_type);
+MT_Mesh *mt_world_add_shared_mesh(MT_World *world, MT_Mesh *mesh);
+MT_Sphere *mt_world_create_sphere(MT_World *world, MT_Vec3 position, float radius, MT_Material *mat);
+MT_Box *mt_world_create_box(MT_World *world, MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale, MT_Material *mat);
+MT_Instance *mt_world_create_instance(MT_World *world, MT_Mesh *mesh, MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale);
+void mt_world_enable_huge_pages(MT_World *world, int b_enable);
 void mt_world_set_environment(MT_World *world, MT_Environment *environment);
+void mt_world_set_bvh_builder(MT_World *world, MT_BVHBuilder builder);
+void mt_world_set_bvh_leaf_size(MT_World *world, unsigned int max_leaf_size);
+void mt_world_enable_wide_bvh(MT_World *world, int b_enable);
+void mt_world_enable_quantized_bvh(MT_World *world, int b_enable);
+void mt_world_set_bvh_thread_count(MT_World *world, unsigned int thread_count);
+void mt_world_set_bvh_split_budget(MT_World *world, float budget);
+void mt_world_set_bvh_treelet_passes(MT_World *world, unsigned int passes);
 void mt_world_recalculate_bvh(MT_World *world);
+void mt_world_mark_object_dirty(MT_World *world, int object_id);
+void mt_world_refit_bvh(MT_World *world);
+void mt_world_recalculate_grid(MT_World *world);
+MT_BVHStats mt_world_get_bvh_stats(MT_World *world);
+int mt_world_save_snapshot(MT_World *world, const char *path);
+MT_World *mt_world_load_snapshot(const char *path);
 void mt_world_delete(MT_World *world);
 
 //////////////////////////////////
@@ -200,6 +300,8 @@ void mt_renderer_enable_progressive(MT_Renderer *renderer, int b_enable);
 void mt_renderer_reset_progressive(MT_Renderer *renderer);
 void mt_renderer_enable_antialiasing(MT_Renderer *renderer, int b_enable);
 void mt_renderer_enable_bvh(MT_Renderer *renderer, int b_enable);
+void mt_renderer_enable_auto_bvh(MT_Renderer *renderer, int b_enable);
+void mt_renderer_enable_grid(MT_Renderer *renderer, int b_enable);
 void mt_renderer_delete(MT_Renderer *renderer);
 
 MT_Vec3 mt_renderer_get_pixel(MT_Renderer *renderer, int x, int y, float gamma, int b_as_8bit);
@@ -247,6 +349,13 @@ static inline float mt__random_float_thread()
     return 2.0f * (seed / (float)UINT_MAX) - 1.0f;
 }
 
+static double mt__time_ms()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
 static inline float mt__lerp(float a, float b, float t)
 {
     return a + t * (b - a);
@@ -309,6 +418,321 @@ static void mt__debug_print_bits(uint32_t n, int bits)
     }
 }
 
+////////////////////////////////////////
+// ========== THREAD UTILS ========== //
+////////////////////////////////////////
+typedef void (*MT_ParallelFn)(void *data, unsigned int start, unsigned int end, unsigned int thread_index);
+
+typedef struct MT_ParallelRange
+{
+    MT_ParallelFn fn;
+    void *data;
+    unsigned int start;
+    unsigned int end;
+    unsigned int thread_index;
+} MT_ParallelRange;
+
+// ranges smaller than this are not worth waking a thread for
+#define MT_PARALLEL_MIN_COUNT 4096
+
+static unsigned int mt__parallel_thread_count(unsigned int thread_count, unsigned int count)
+{
+    unsigned int max_threads = count / MT_PARALLEL_MIN_COUNT;
+    if (thread_count > max_threads)
+    {
+        thread_count = max_threads;
+    }
+    return thread_count > 0 ? thread_count : 1;
+}
+
+// the threads a job can use when the caller does not pick a count
+static unsigned int mt__hardware_thread_count(void)
+{
+#ifdef _WIN32
+    return 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned int)count : 1;
+#endif
+}
+
+static void *mt__parallel_range_run(void *data)
+{
+    MT_ParallelRange *range = (MT_ParallelRange *)data;
+    range->fn(range->data, range->start, range->end, range->thread_index);
+    return NULL;
+}
+
+// splits [0, count) into one contiguous range per thread and waits for all of them, the calling thread runs the last range
+// the split only depends on count and thread_count so separate passes over the same data line up
+static void mt__parallel_for(unsigned int thread_count, unsigned int count, MT_ParallelFn fn, void *data)
+{
+    if (thread_count <= 1)
+    {
+        fn(data, 0, count, 0);
+        return;
+    }
+
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * thread_count);
+    MT_ParallelRange *ranges = (MT_ParallelRange *)malloc(sizeof(MT_ParallelRange) * thread_count);
+
+    for (unsigned int i = 0; i < thread_count; ++i)
+    {
+        ranges[i] = (MT_ParallelRange){fn, data, (unsigned int)((uint64_t)count * i / thread_count), (unsigned int)((uint64_t)count * (i + 1) / thread_count), i};
+        if (i < thread_count - 1)
+        {
+            pthread_create(&threads[i], NULL, mt__parallel_range_run, &ranges[i]);
+        }
+    }
+
+    mt__parallel_range_run(&ranges[thread_count - 1]);
+
+    for (unsigned int i = 0; i < thread_count - 1; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+    free(ranges);
+}
+
+////////////////////////////////////////
+// ========== MEMORY UTILS ========== //
+////////////////////////////////////////
+// for arrays read with vector loads, free with mt__aligned_free
+static void *mt__aligned_malloc(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, alignment, size) != 0)
+    {
+        return NULL;
+    }
+    return ptr;
+#endif
+}
+
+static void mt__aligned_free(void *ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+// the first chunk of an arena, later ones double up to the max so big scenes need few of them
+#define MT_ARENA_CHUNK_SIZE (1 << 20)
+#define MT_ARENA_MAX_CHUNK_SIZE (64 << 20)
+#define MT_ARENA_ALIGNMENT 16
+#define MT_ARENA_HUGE_PAGE_SIZE (2 << 20)
+
+typedef struct MT_ArenaChunk
+{
+    struct MT_ArenaChunk *next;
+    size_t size; // including this header
+    size_t used;
+    int b_mapped;
+} MT_ArenaChunk;
+
+// bump allocations that are only ever freed all at once
+typedef struct MT_Arena
+{
+    MT_ArenaChunk *chunks; // newest first, allocations only come from the newest
+    size_t next_chunk_size;
+    int b_huge_pages;
+} MT_Arena;
+
+static void mt__arena_init(MT_Arena *arena)
+{
+    arena->chunks = NULL;
+    arena->next_chunk_size = MT_ARENA_CHUNK_SIZE;
+    arena->b_huge_pages = 0;
+}
+
+// huge page chunks try reserved huge pages first, then ask for transparent ones, and fall back to malloc without mmap
+static MT_ArenaChunk *mt__arena_chunk_create(size_t size, int b_huge_pages)
+{
+    MT_ArenaChunk *chunk = NULL;
+    int b_mapped = 0;
+
+#ifndef _WIN32
+    if (b_huge_pages)
+    {
+        size = (size + MT_ARENA_HUGE_PAGE_SIZE - 1) / MT_ARENA_HUGE_PAGE_SIZE * MT_ARENA_HUGE_PAGE_SIZE;
+
+        void *data = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if (data == MAP_FAILED)
+        {
+            data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+            if (data != MAP_FAILED)
+            {
+                madvise(data, size, MADV_HUGEPAGE);
+            }
+#endif
+        }
+
+        if (data != MAP_FAILED)
+        {
+            chunk = (MT_ArenaChunk *)data;
+            b_mapped = 1;
+        }
+    }
+#endif
+
+    if (!chunk)
+    {
+        chunk = (MT_ArenaChunk *)malloc(size);
+        if (!chunk)
+        {
+            return NULL;
+        }
+    }
+
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = (sizeof(MT_ArenaChunk) + MT_ARENA_ALIGNMENT - 1) / MT_ARENA_ALIGNMENT * MT_ARENA_ALIGNMENT;
+    chunk->b_mapped = b_mapped;
+    return chunk;
+}
+
+// zeroed memory aligned to MT_ARENA_ALIGNMENT, valid until the arena is deleted
+static void *mt__arena_alloc(MT_Arena *arena, size_t size)
+{
+    size = (size + MT_ARENA_ALIGNMENT - 1) / MT_ARENA_ALIGNMENT * MT_ARENA_ALIGNMENT;
+
+    MT_ArenaChunk *chunk = arena->chunks;
+    if (!chunk || chunk->size - chunk->used < size)
+    {
+        size_t header_size = (sizeof(MT_ArenaChunk) + MT_ARENA_ALIGNMENT - 1) / MT_ARENA_ALIGNMENT * MT_ARENA_ALIGNMENT;
+        size_t chunk_size = arena->next_chunk_size;
+        if (chunk_size < header_size + size)
+        {
+            chunk_size = header_size + size;
+        }
+
+        chunk = mt__arena_chunk_create(chunk_size, arena->b_huge_pages);
+        if (!chunk)
+        {
+            return NULL;
+        }
+
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        if (arena->next_chunk_size < MT_ARENA_MAX_CHUNK_SIZE)
+        {
+            arena->next_chunk_size *= 2;
+        }
+    }
+
+    void *ptr = (char *)chunk + chunk->used;
+    chunk->used += size;
+
+    // mapped chunks start out zeroed
+    if (!chunk->b_mapped)
+    {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+static void mt__arena_delete(MT_Arena *arena)
+{
+    MT_ArenaChunk *chunk = arena->chunks;
+    while (chunk)
+    {
+        MT_ArenaChunk *next = chunk->next;
+#ifndef _WIN32
+        if (chunk->b_mapped)
+        {
+            munmap(chunk, chunk->size);
+        }
+        else
+#endif
+        {
+            free(chunk);
+        }
+        chunk = next;
+    }
+    mt__arena_init(arena);
+}
+
+//////////////////////////////////////
+// ========== FILE UTILS ========== //
+//////////////////////////////////////
+// maps a whole file copy on write, its pages stay shared with every other process mapping it until one of them writes to its copy
+// without mmap the file is read into memory instead
+static void *mt__file_map(const char *path, size_t *out_size)
+{
+#ifdef _WIN32
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        perror("fopen");
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    void *data = size > 0 ? malloc(size) : NULL;
+    if (!data || fread(data, 1, size, fp) != (size_t)size)
+    {
+        free(data);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("open");
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror("mmap");
+        return NULL;
+    }
+#endif
+
+    *out_size = size;
+    return data;
+}
+
+static void mt__file_unmap(void *data, size_t size)
+{
+    if (!data)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    free(data);
+#else
+    munmap(data, size);
+#endif
+}
+
 ///////////////////////////////
 // ========== VEC ========== //
 ///////////////////////////////
@@ -543,970 +967,7099 @@ void mt_material_delete(MT_Material *material)
 //////////////////////////////////
 // ========== OBJECT ========== //
 //////////////////////////////////
+// tris per block of precomputed intersection data, one avx register of floats or one sse register
+#ifndef MT_TRI_BLOCK_WIDTH
+#ifdef __AVX__
+#define MT_TRI_BLOCK_WIDTH 8
+#else
+#define MT_TRI_BLOCK_WIDTH 4
+#endif
+#endif
+
+#define MT_TRI_BLOCK_ALIGN 64
+
+// what a ray test needs of MT_TRI_BLOCK_WIDTH tris, a corner and the two edges from it, one lane per tri
+// lanes past the last tri are zero, which no ray can hit
+typedef struct MT_TriBlock
+{
+    float v0[3][MT_TRI_BLOCK_WIDTH];
+    float e1[3][MT_TRI_BLOCK_WIDTH];
+    float e2[3][MT_TRI_BLOCK_WIDTH];
+} MT_TriBlock;
+
+// a tri is three indices into the mesh's shared vertices, with one packed face normal and material of its own
 typedef struct MT_Mesh
 {
-    MT_Tri **tris;
+    MT_Vec3 *vertices;
+    uint32_t *indices;            // three per tri
+    uint32_t *normals;            // one face normal per tri, see mt__normal_pack
+    uint32_t *tri_materials;      // one per tri, an index into materials
+    MT_Material **materials;      // each material the tris use, once
+    uint32_t material_count;
+    uint32_t max_materials;
+    MT_TriBlock *tri_blocks;      // rebuilt with the bvh, only used while it is not dirty
+    uint32_t tri_block_count;
+    int b_borrowed;               // set when the vertices, indices, normals and tri materials point into a mapped snapshot and materials is its world's, none are freed
+    int b_unwelded;               // set when tris were added since duplicate vertices were last merged
+    struct MT_MeshStream *stream; // set when the tris are paged in from a file instead, see mt_mesh_create_from_stream
+    struct MT_BVH *bvh;           // triangle level bvh, rebuilt by mt_world_recalculate_bvh
+    int b_bvh_dirty;
+    int b_bvh_slower; // set when the bvh is built if testing every tri is expected to be cheaper
+    float ray_cost;   // expected nanoseconds for a ray that reaches the mesh
 
     MT_Vec3 origin_offset;
 
     unsigned int max_tris;
     unsigned int tri_index;
+    unsigned int max_vertices;
+    unsigned int vertex_index;
 } MT_Mesh;
 
-static void mt__tri_recalculate_normals(MT_Tri *tri)
+// MT_TRI_BLOCK_WIDTH spheres of a cloud, one lane per sphere so a ray is tested against all of them at once
+// lanes past the last sphere are zero and are masked off by index, see mt__render_handle_sphere_blocks
+typedef struct MT_SphereBlock
 {
-    MT_Vec3 u = mt_vec3_sub(tri->p[1], tri->p[0]);
-    MT_Vec3 v = mt_vec3_sub(tri->p[2], tri->p[0]);
-
-    MT_Vec3 normal = mt_vec3_normalize(mt_vec3_cross(u, v));
-    tri->face_normal = normal;
-    tri->p_n[0] = normal;
-    tri->p_n[1] = normal;
-    tri->p_n[2] = normal;
-}
+    float center[3][MT_TRI_BLOCK_WIDTH];
+    float radius[MT_TRI_BLOCK_WIDTH];
+} MT_SphereBlock;
 
-static MT_Tri *mt__tri_create(MT_Vec3 p1, MT_Vec3 p2, MT_Vec3 p3, MT_Material *mat)
+// many spheres as one object with a tree of its own, for particles and other sets too large to add sphere by sphere
+// the spheres are reordered whenever the bvh is built, so they are not addressed by the order they were added in
+typedef struct MT_SphereCloud
+{
+    MT_SphereBlock *blocks;      // the centers and radii, the only copy of them
+    uint32_t *sphere_materials;  // one per sphere, an index into materials
+    MT_Material **materials;     // each material the spheres use, once
+    uint32_t material_count;
+    uint32_t max_materials;
+    int b_borrowed;              // set when the blocks and sphere materials point into a mapped snapshot and materials is its world's, none are freed
+    struct MT_BVH *bvh;          // sphere level bvh, rebuilt by mt_world_recalculate_bvh
+    int b_bvh_dirty;
+    int b_bvh_slower; // set when the bvh is built if testing every sphere is expected to be cheaper
+    float ray_cost;   // expected nanoseconds for a ray that reaches the cloud
+
+    unsigned int max_spheres;
+    unsigned int sphere_index;
+} MT_SphereCloud;
+
+// octahedral encoding with 16 bits per axis, 65534 steps keep the axis directions exact
+static uint32_t mt__normal_pack(MT_Vec3 n)
 {
-    MT_Tri *tri = (MT_Tri *)malloc(sizeof(MT_Tri));
-    tri->p[0] = p1;
-    tri->p[1] = p2;
-    tri->p[2] = p3;
-    tri->mat = mat;
+    float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
 
-    mt__tri_recalculate_normals(tri);
+    // degenerate tris have no normal and are never hit, any direction will do
+    if (!(sum > 0.0f))
+    {
+        n = (MT_Vec3){0, 0, 1};
+        sum = 1.0f;
+    }
 
-    return tri;
-}
+    float x = n.x / sum;
+    float y = n.y / sum;
+    if (n.z < 0.0f)
+    {
+        float folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = folded_x;
+        y = folded_y;
+    }
 
-MT_Mesh *mt_mesh_create(unsigned int max_tris)
-{
-    MT_Mesh *mesh = (MT_Mesh *)malloc(sizeof(MT_Mesh));
-    mesh->tris = (MT_Tri **)malloc(sizeof(MT_Tri *) * max_tris);
-    mesh->origin_offset = (MT_Vec3){0, 0, 0};
-    mesh->tri_index = 0;
-    mesh->max_tris = max_tris;
-    return mesh;
+    uint32_t packed_x = (uint32_t)lrintf((x * 0.5f + 0.5f) * 65534.0f);
+    uint32_t packed_y = (uint32_t)lrintf((y * 0.5f + 0.5f) * 65534.0f);
+    return packed_x | (packed_y << 16);
 }
 
-MT_Mesh *mt_mesh_create_plane(MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale, MT_Material *material)
+static inline MT_Vec3 mt__normal_unpack(uint32_t packed)
 {
-    MT_Mesh *plane = mt_mesh_create(2);
+    float x = (packed & 0xFFFF) * (2.0f / 65534.0f) - 1.0f;
+    float y = (packed >> 16) * (2.0f / 65534.0f) - 1.0f;
+    float z = 1.0f - fabsf(x) - fabsf(y);
 
-    MT_Tri *t1 = mt__tri_create((MT_Vec3){-0.5f, 0, 0.5f}, (MT_Vec3){-0.5f, 0, -0.5f}, (MT_Vec3){0.5f, 0, 0.5f}, material);
-    MT_Tri *t2 = mt__tri_create((MT_Vec3){0.5f, 0, 0.5f}, (MT_Vec3){-0.5f, 0, -0.5f}, (MT_Vec3){0.5f, 0, -0.5f}, material);
-    mt_mesh_add_tri(plane, t1);
-    mt_mesh_add_tri(plane, t2);
+    if (z < 0.0f)
+    {
+        float unfolded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float unfolded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = unfolded_x;
+        y = unfolded_y;
+    }
 
-    mt_mesh_transform(plane, position, rotation, scale);
+    return mt_vec3_normalize((MT_Vec3){x, y, z});
+}
 
-    return plane;
+static inline void mt__mesh_tri_corners(const MT_Mesh *mesh, uint32_t tri, MT_Vec3 out[3])
+{
+    const uint32_t *index = &mesh->indices[tri * 3];
+    out[0] = mesh->vertices[index[0]];
+    out[1] = mesh->vertices[index[1]];
+    out[2] = mesh->vertices[index[2]];
 }
 
-MT_Mesh *mt_mesh_create_cube(MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale, MT_Material *material)
+static void mt__tri_block_set(MT_TriBlock *block, uint32_t lane, const MT_Vec3 p[3])
 {
-    MT_Mesh *cube = mt_mesh_create(12);
-    MT_Mesh **planes = (MT_Mesh **)malloc(sizeof(MT_Mesh *) * 6);
+    MT_Vec3 e1 = mt_vec3_sub(p[1], p[0]);
+    MT_Vec3 e2 = mt_vec3_sub(p[2], p[0]);
+
+    block->v0[0][lane] = p[0].x;
+    block->v0[1][lane] = p[0].y;
+    block->v0[2][lane] = p[0].z;
+    block->e1[0][lane] = e1.x;
+    block->e1[1][lane] = e1.y;
+    block->e1[2][lane] = e1.z;
+    block->e2[0][lane] = e2.x;
+    block->e2[1][lane] = e2.y;
+    block->e2[2][lane] = e2.z;
+}
 
-    for (int i = 0; i < 6; ++i)
+// the tris only change between renders, so their edges are worked out once here instead of on every ray test
+static void mt__mesh_update_tri_blocks(MT_Mesh *mesh)
+{
+    uint32_t block_count = (mesh->tri_index + MT_TRI_BLOCK_WIDTH - 1) / MT_TRI_BLOCK_WIDTH;
+    if (!mesh->tri_blocks || block_count != mesh->tri_block_count)
     {
-        planes[i] = mt_mesh_create_plane((MT_Vec3){0, 0, 0}, (MT_Vec3){0, 0, 0}, (MT_Vec3){1, 1, 1}, material);
+        mt__aligned_free(mesh->tri_blocks);
+        mesh->tri_blocks = (MT_TriBlock *)mt__aligned_malloc(sizeof(MT_TriBlock) * (block_count > 0 ? block_count : 1), MT_TRI_BLOCK_ALIGN);
+        mesh->tri_block_count = block_count;
     }
 
-    // top
-    mt_mesh_move(planes[0], (MT_Vec3){0, -0.5, 0});
-
-    // bottom
-    mt_mesh_move(planes[1], (MT_Vec3){0, 0.5, 0});
-    mt_mesh_rotate(planes[1], (MT_Vec3){MT_PI, 0, 0});
-
-    // front
-    mt_mesh_move(planes[2], (MT_Vec3){0, 0, -0.5});
-    mt_mesh_rotate(planes[2], (MT_Vec3){MT_PI / 2.0f, 0, 0});
+    if (block_count > 0)
+    {
+        memset(&mesh->tri_blocks[block_count - 1], 0, sizeof(MT_TriBlock));
+    }
 
-    // back
-    mt_mesh_move(planes[3], (MT_Vec3){0, 0, 0.5});
-    mt_mesh_rotate(planes[3], (MT_Vec3){-MT_PI / 2.0f, 0, 0});
+    for (uint32_t i = 0; i < mesh->tri_index; ++i)
+    {
+        MT_Vec3 p[3];
+        mt__mesh_tri_corners(mesh, i, p);
+        mt__tri_block_set(&mesh->tri_blocks[i / MT_TRI_BLOCK_WIDTH], i % MT_TRI_BLOCK_WIDTH, p);
+    }
+}
 
-    // left
-    mt_mesh_move(planes[4], (MT_Vec3){-0.5, 0, 0});
-    mt_mesh_rotate(planes[4], (MT_Vec3){0, 0, -MT_PI / 2.0f});
+static void mt__mesh_recalculate_tri_normal(MT_Mesh *mesh, uint32_t tri)
+{
+    MT_Vec3 p[3];
+    mt__mesh_tri_corners(mesh, tri, p);
 
-    // right
-    mt_mesh_move(planes[5], (MT_Vec3){0.5, 0, 0});
-    mt_mesh_rotate(planes[5], (MT_Vec3){0, 0, MT_PI / 2.0f});
+    MT_Vec3 u = mt_vec3_sub(p[1], p[0]);
+    MT_Vec3 v = mt_vec3_sub(p[2], p[0]);
+    mesh->normals[tri] = mt__normal_pack(mt_vec3_normalize(mt_vec3_cross(u, v)));
+}
 
-    for (int i = 0; i < 6; ++i)
+// copies arrays a snapshot lent the mesh into its own memory, before they are replaced or resized
+static void mt__mesh_detach(MT_Mesh *mesh)
+{
+    if (!mesh->b_borrowed)
     {
-        mt_mesh_add_tri(cube, planes[i]->tris[0]);
-        mt_mesh_add_tri(cube, planes[i]->tris[1]);
+        return;
     }
 
-    free(planes);
-
-    mt_mesh_transform(cube, position, rotation, scale);
-
-    return cube;
+    MT_Vec3 *vertices = (MT_Vec3 *)malloc(sizeof(MT_Vec3) * (mesh->max_vertices > 0 ? mesh->max_vertices : 1));
+    uint32_t *indices = (uint32_t *)malloc(sizeof(uint32_t) * 3 * (mesh->max_tris > 0 ? mesh->max_tris : 1));
+    uint32_t *normals = (uint32_t *)malloc(sizeof(uint32_t) * (mesh->max_tris > 0 ? mesh->max_tris : 1));
+    uint32_t *tri_materials = (uint32_t *)malloc(sizeof(uint32_t) * (mesh->max_tris > 0 ? mesh->max_tris : 1));
+    MT_Material **materials = (MT_Material **)malloc(sizeof(MT_Material *) * (mesh->material_count > 0 ? mesh->material_count : 1));
+    memcpy(vertices, mesh->vertices, sizeof(MT_Vec3) * mesh->vertex_index);
+    memcpy(indices, mesh->indices, sizeof(uint32_t) * 3 * mesh->tri_index);
+    memcpy(normals, mesh->normals, sizeof(uint32_t) * mesh->tri_index);
+    memcpy(tri_materials, mesh->tri_materials, sizeof(uint32_t) * mesh->tri_index);
+    memcpy(materials, mesh->materials, sizeof(MT_Material *) * mesh->material_count);
+
+    mesh->vertices = vertices;
+    mesh->indices = indices;
+    mesh->normals = normals;
+    mesh->tri_materials = tri_materials;
+    mesh->materials = materials;
+    mesh->max_materials = mesh->material_count;
+    mesh->b_borrowed = 0;
 }
 
-MT_Mesh *mt_mesh_create_from_stl(const char *path, MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale, MT_Material *material)
+// merges vertices with bit identical positions, each tri added to a mesh starts out with three of its own
+static void mt__mesh_weld_vertices(MT_Mesh *mesh)
 {
-    FILE *fp = fopen(path, "r");
-    if (!fp)
+    if (!mesh->b_unwelded)
     {
-        perror("fopen");
-        return NULL;
+        return;
     }
+    mesh->b_unwelded = 0;
+    mt__mesh_detach(mesh);
 
-    char line[256];
-
-    MT_Mesh *stl_mesh = mt_mesh_create(1000);
+    uint32_t table_size = 16;
+    while (table_size < mesh->vertex_index * 2)
+    {
+        table_size *= 2;
+    }
 
-    int v_i = 0;
+    // open addressing on an fnv-1a hash of the position, UINT32_MAX marks an empty slot
+    uint32_t *table = (uint32_t *)malloc(sizeof(uint32_t) * table_size);
+    uint32_t *remap = (uint32_t *)malloc(sizeof(uint32_t) * (mesh->vertex_index > 0 ? mesh->vertex_index : 1));
+    memset(table, 0xFF, sizeof(uint32_t) * table_size);
 
-    MT_Tri *tri = (MT_Tri *)malloc(sizeof(MT_Tri));
-    while (fgets(line, sizeof(line), fp))
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < mesh->vertex_index; ++i)
     {
-        if (strncmp(line, "facet normal", 12) == 0)
-        {
-            sscanf(line, "facet normal %f %f %f", &tri->face_normal.x, &tri->face_normal.y, &tri->face_normal.z);
+        MT_Vec3 p = mesh->vertices[i];
+        const unsigned char *bytes = (const unsigned char *)&p;
 
-            tri->p_n[0] = tri->face_normal;
-            tri->p_n[1] = tri->face_normal;
-            tri->p_n[2] = tri->face_normal;
-        }
-        else if (strncmp(line, "  vertex", 8) == 0)
+        uint32_t hash = 2166136261u;
+        for (size_t j = 0; j < sizeof(p); ++j)
         {
-            sscanf(line, "  vertex %f %f %f", &tri->p[v_i].x, &tri->p[v_i].y, &tri->p[v_i].z);
-            ++v_i;
+            hash = (hash ^ bytes[j]) * 16777619u;
         }
-        else if (strncmp(line, "endfacet", 8) == 0)
+
+        uint32_t slot = hash & (table_size - 1);
+        while (table[slot] != UINT32_MAX && memcmp(&mesh->vertices[table[slot]], &p, sizeof(p)) != 0)
         {
-            tri->mat = material;
+            slot = (slot + 1) & (table_size - 1);
+        }
 
-            mt__tri_recalculate_normals(tri);
-            mt_mesh_add_tri(stl_mesh, tri);
-            tri = (MT_Tri *)malloc(sizeof(MT_Tri));
-            v_i = 0;
+        // kept vertices are compacted in place, count never passes i
+        if (table[slot] == UINT32_MAX)
+        {
+            table[slot] = count;
+            mesh->vertices[count] = p;
+            ++count;
         }
+        remap[i] = table[slot];
     }
 
-    mt_mesh_transform(stl_mesh, position, rotation, scale);
+    for (uint32_t i = 0; i < mesh->tri_index * 3; ++i)
+    {
+        mesh->indices[i] = remap[mesh->indices[i]];
+    }
 
-    return stl_mesh;
+    free(table);
+    free(remap);
+
+    // room is kept for the tris that can still be added
+    mesh->vertex_index = count;
+    mesh->max_vertices = count + 3 * (mesh->max_tris - mesh->tri_index);
+    mesh->vertices = (MT_Vec3 *)realloc(mesh->vertices, sizeof(MT_Vec3) * (mesh->max_vertices > 0 ? mesh->max_vertices : 1));
 }
 
-// moves a tri into the mesh, deleting the mesh will delete all children tris
-void mt_mesh_add_tri(MT_Mesh *mesh, MT_Tri *tri)
+// stores tri i where tri order[i] was
+static void mt__mesh_permute_tris(MT_Mesh *mesh, const uint32_t *order)
 {
-    if (mesh->tri_index >= mesh->max_tris)
+    mt__mesh_detach(mesh);
+
+    uint32_t *indices = (uint32_t *)malloc(sizeof(uint32_t) * 3 * mesh->max_tris);
+    uint32_t *normals = (uint32_t *)malloc(sizeof(uint32_t) * mesh->max_tris);
+    uint32_t *tri_materials = (uint32_t *)malloc(sizeof(uint32_t) * mesh->max_tris);
+
+    for (uint32_t i = 0; i < mesh->tri_index; ++i)
     {
-        return;
+        memcpy(&indices[i * 3], &mesh->indices[order[i] * 3], sizeof(uint32_t) * 3);
+        normals[i] = mesh->normals[order[i]];
+        tri_materials[i] = mesh->tri_materials[order[i]];
     }
 
-    mesh->tris[mesh->tri_index] = tri;
-    ++mesh->tri_index;
+    free(mesh->indices);
+    free(mesh->normals);
+    free(mesh->tri_materials);
+    mesh->indices = indices;
+    mesh->normals = normals;
+    mesh->tri_materials = tri_materials;
 }
 
-void mt_mesh_recalculate_normals(MT_Mesh *mesh)
+// renumbers the vertices in the order the tris first use them, so tris stored together read vertices stored together
+static void mt__mesh_reorder_vertices(MT_Mesh *mesh)
 {
-    for (int i = 0; i < mesh->tri_index; ++i)
+    mt__mesh_detach(mesh);
+
+    uint32_t *remap = (uint32_t *)malloc(sizeof(uint32_t) * (mesh->vertex_index > 0 ? mesh->vertex_index : 1));
+    MT_Vec3 *vertices = (MT_Vec3 *)malloc(sizeof(MT_Vec3) * (mesh->max_vertices > 0 ? mesh->max_vertices : 1));
+    memset(remap, 0xFF, sizeof(uint32_t) * mesh->vertex_index);
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < mesh->tri_index * 3; ++i)
     {
-        mt__tri_recalculate_normals(mesh->tris[i]);
+        uint32_t vertex = mesh->indices[i];
+        if (remap[vertex] == UINT32_MAX)
+        {
+            remap[vertex] = count;
+            vertices[count] = mesh->vertices[vertex];
+            ++count;
+        }
+        mesh->indices[i] = remap[vertex];
     }
+
+    free(remap);
+    free(mesh->vertices);
+    mesh->vertices = vertices;
+    mesh->vertex_index = count;
 }
 
-void mt_mesh_move(MT_Mesh *mesh, MT_Vec3 position)
+static inline MT_Material *mt__mesh_tri_material(const MT_Mesh *mesh, uint32_t tri)
 {
-    for (int i = 0; i < mesh->tri_index; ++i)
+    return mesh->materials[mesh->tri_materials[tri]];
+}
+
+// finds mat in the mesh's material table, adding it if no tri used it yet
+static uint32_t mt__mesh_material_index(MT_Mesh *mesh, MT_Material *mat)
+{
+    // tris are mostly added in runs sharing one material, so the table is searched from the last one added
+    for (uint32_t i = mesh->material_count; i-- > 0;)
     {
-        MT_Tri *tri = mesh->tris[i];
+        if (mesh->materials[i] == mat)
+        {
+            return i;
+        }
+    }
 
-        tri->p[0] = mt_vec3_add(tri->p[0], position);
-        tri->p[1] = mt_vec3_add(tri->p[1], position);
-        tri->p[2] = mt_vec3_add(tri->p[2], position);
+    mt__mesh_detach(mesh);
+    if (mesh->material_count >= mesh->max_materials)
+    {
+        mesh->max_materials = mesh->max_materials > 0 ? mesh->max_materials * 2 : 16;
+        mesh->materials = (MT_Material **)realloc(mesh->materials, sizeof(MT_Material *) * mesh->max_materials);
     }
 
-    mesh->origin_offset = mt_vec3_add(mesh->origin_offset, position);
+    mesh->materials[mesh->material_count] = mat;
+    return mesh->material_count++;
 }
 
-void mt_mesh_rotate(MT_Mesh *mesh, MT_Vec3 rotation)
+// makes room for max_tris tris, and three new vertices for each tri that can still be added
+static void mt__mesh_reserve(MT_Mesh *mesh, unsigned int max_tris)
 {
-    MT_Mat4x4 rotation_mat = mt_mat4x4_create_rotation(rotation);
+    if (max_tris <= mesh->max_tris)
+    {
+        return;
+    }
+
+    mt__mesh_detach(mesh);
+    mesh->max_vertices += 3 * (max_tris - mesh->max_tris);
+    mesh->max_tris = max_tris;
+    mesh->vertices = (MT_Vec3 *)realloc(mesh->vertices, sizeof(MT_Vec3) * mesh->max_vertices);
+    mesh->indices = (uint32_t *)realloc(mesh->indices, sizeof(uint32_t) * 3 * max_tris);
+    mesh->normals = (uint32_t *)realloc(mesh->normals, sizeof(uint32_t) * max_tris);
+    mesh->tri_materials = (uint32_t *)realloc(mesh->tri_materials, sizeof(uint32_t) * max_tris);
+}
 
-    for (int i = 0; i < mesh->tri_index; ++i)
+// appends a tri by its corners, they get vertices of their own until the mesh is welded
+static void mt__mesh_push_tri(MT_Mesh *mesh, MT_Vec3 p1, MT_Vec3 p2, MT_Vec3 p3, MT_Material *mat)
+{
+    if (mesh->tri_index >= mesh->max_tris)
     {
-        MT_Tri *tri = mesh->tris[i];
+        mt__mesh_reserve(mesh, mesh->max_tris ? mesh->max_tris * 2 : 16);
+    }
 
-        tri->p[0] = mt_vec3_sub(tri->p[0], mesh->origin_offset);
-        tri->p[1] = mt_vec3_sub(tri->p[1], mesh->origin_offset);
-        tri->p[2] = mt_vec3_sub(tri->p[2], mesh->origin_offset);
+    uint32_t first = mesh->vertex_index;
+    mesh->vertices[first] = p1;
+    mesh->vertices[first + 1] = p2;
+    mesh->vertices[first + 2] = p3;
+    mesh->vertex_index += 3;
 
-        tri->p[0] = mt_mat4x4_mult_vec3(rotation_mat, tri->p[0]);
-        tri->p[1] = mt_mat4x4_mult_vec3(rotation_mat, tri->p[1]);
-        tri->p[2] = mt_mat4x4_mult_vec3(rotation_mat, tri->p[2]);
+    uint32_t *index = &mesh->indices[mesh->tri_index * 3];
+    index[0] = first;
+    index[1] = first + 1;
+    index[2] = first + 2;
 
-        tri->p[0] = mt_vec3_add(tri->p[0], mesh->origin_offset);
-        tri->p[1] = mt_vec3_add(tri->p[1], mesh->origin_offset);
-        tri->p[2] = mt_vec3_add(tri->p[2], mesh->origin_offset);
+    mesh->tri_materials[mesh->tri_index] = mt__mesh_material_index(mesh, mat);
+    mt__mesh_recalculate_tri_normal(mesh, mesh->tri_index);
 
-        // fix normals
-        tri->p_n[0] = mt_mat4x4_mult_vec3(rotation_mat, tri->p_n[0]);
-        tri->p_n[1] = mt_mat4x4_mult_vec3(rotation_mat, tri->p_n[1]);
-        tri->p_n[2] = mt_mat4x4_mult_vec3(rotation_mat, tri->p_n[2]);
-        tri->face_normal = mt_mat4x4_mult_vec3(rotation_mat, tri->face_normal);
-    }
+    ++mesh->tri_index;
+    mesh->b_unwelded = 1;
+    mesh->b_bvh_dirty = 1;
 }
 
-void mt_mesh_scale(MT_Mesh *mesh, MT_Vec3 scale)
+// appends every tri of src to the mesh, with their vertices, normals and materials
+static void mt__mesh_append(MT_Mesh *mesh, const MT_Mesh *src)
 {
-    MT_Mat4x4 scale_mat = mt_mat4x4_create_scale(scale);
-
-    for (int i = 0; i < mesh->tri_index; ++i)
+    if (src->tri_index == 0)
     {
-        MT_Tri *tri = mesh->tris[i];
+        return;
+    }
+
+    mt__mesh_detach(mesh);
+    mt__mesh_reserve(mesh, mesh->tri_index + src->tri_index);
+
+    // src has at most three vertices per tri, which the reserve always leaves room for
+    uint32_t vertex_offset = mesh->vertex_index;
+    memcpy(&mesh->vertices[vertex_offset], src->vertices, sizeof(MT_Vec3) * src->vertex_index);
+    for (uint32_t i = 0; i < src->tri_index * 3; ++i)
+    {
+        mesh->indices[mesh->tri_index * 3 + i] = src->indices[i] + vertex_offset;
+    }
+    memcpy(&mesh->normals[mesh->tri_index], src->normals, sizeof(uint32_t) * src->tri_index);
 
-        tri->p[0] = mt_mat4x4_mult_vec3(scale_mat, tri->p[0]);
-        tri->p[1] = mt_mat4x4_mult_vec3(scale_mat, tri->p[1]);
-        tri->p[2] = mt_mat4x4_mult_vec3(scale_mat, tri->p[2]);
+    uint32_t *remap = (uint32_t *)malloc(sizeof(uint32_t) * (src->material_count > 0 ? src->material_count : 1));
+    for (uint32_t i = 0; i < src->material_count; ++i)
+    {
+        remap[i] = mt__mesh_material_index(mesh, src->materials[i]);
+    }
+    for (uint32_t i = 0; i < src->tri_index; ++i)
+    {
+        mesh->tri_materials[mesh->tri_index + i] = remap[src->tri_materials[i]];
     }
+    free(remap);
+
+    mesh->tri_index += src->tri_index;
+    mesh->vertex_index += src->vertex_index;
+    mesh->b_unwelded = 1;
+    mesh->b_bvh_dirty = 1;
 }
 
-void mt_mesh_transform(MT_Mesh *mesh, MT_Vec3 translation, MT_Vec3 rotation, MT_Vec3 scale)
+MT_Mesh *mt_mesh_create(unsigned int max_tris)
 {
-    MT_Mat4x4 translate_mat = mt_mat4x4_create_translation(translation);
-    MT_Mat4x4 rotation_mat = mt_mat4x4_create_rotation(rotation);
-    MT_Mat4x4 scale_mat = mt_mat4x4_create_scale(scale);
+    MT_Mesh *mesh = (MT_Mesh *)malloc(sizeof(MT_Mesh));
+    mesh->vertices = max_tris > 0 ? (MT_Vec3 *)malloc(sizeof(MT_Vec3) * 3 * max_tris) : NULL;
+    mesh->indices = max_tris > 0 ? (uint32_t *)malloc(sizeof(uint32_t) * 3 * max_tris) : NULL;
+    mesh->normals = max_tris > 0 ? (uint32_t *)malloc(sizeof(uint32_t) * max_tris) : NULL;
+    mesh->tri_materials = max_tris > 0 ? (uint32_t *)malloc(sizeof(uint32_t) * max_tris) : NULL;
+    mesh->materials = NULL;
+    mesh->material_count = 0;
+    mesh->max_materials = 0;
+    mesh->tri_blocks = NULL;
+    mesh->tri_block_count = 0;
+    mesh->b_borrowed = 0;
+    mesh->b_unwelded = 0;
+    mesh->stream = NULL;
+    mesh->bvh = NULL;
+    mesh->b_bvh_dirty = 1;
+    mesh->b_bvh_slower = 0;
+    mesh->ray_cost = 0.0f;
+    mesh->origin_offset = (MT_Vec3){0, 0, 0};
+    mesh->tri_index = 0;
+    mesh->max_tris = max_tris;
+    mesh->vertex_index = 0;
+    mesh->max_vertices = 3 * max_tris;
+    return mesh;
+}
 
-    for (int i = 0; i < mesh->tri_index; ++i)
-    {
-        MT_Tri *tri = mesh->tris[i];
+MT_Mesh *mt_mesh_create_plane(MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale, MT_Material *material)
+{
+    MT_Mesh *plane = mt_mesh_create(2);
 
-        tri->p[0] = mt_vec3_sub(tri->p[0], mesh->origin_offset);
-        tri->p[1] = mt_vec3_sub(tri->p[1], mesh->origin_offset);
-        tri->p[2] = mt_vec3_sub(tri->p[2], mesh->origin_offset);
+    mt__mesh_push_tri(plane, (MT_Vec3){-0.5f, 0, 0.5f}, (MT_Vec3){-0.5f, 0, -0.5f}, (MT_Vec3){0.5f, 0, 0.5f}, material);
+    mt__mesh_push_tri(plane, (MT_Vec3){0.5f, 0, 0.5f}, (MT_Vec3){-0.5f, 0, -0.5f}, (MT_Vec3){0.5f, 0, -0.5f}, material);
 
-        tri->p[0] = mt_mat4x4_mult_vec3(scale_mat, tri->p[0]);
-        tri->p[1] = mt_mat4x4_mult_vec3(scale_mat, tri->p[1]);
-        tri->p[2] = mt_mat4x4_mult_vec3(scale_mat, tri->p[2]);
+    mt_mesh_transform(plane, position, rotation, scale);
 
-        tri->p[0] = mt_mat4x4_mult_vec3(rotation_mat, tri->p[0]);
-        tri->p[1] = mt_mat4x4_mult_vec3(rotation_mat, tri->p[1]);
-        tri->p[2] = mt_mat4x4_mult_vec3(rotation_mat, tri->p[2]);
+    return plane;
+}
 
-        tri->p[0] = mt_mat4x4_mult_vec3(translate_mat, tri->p[0]);
-        tri->p[1] = mt_mat4x4_mult_vec3(translate_mat, tri->p[1]);
-        tri->p[2] = mt_mat4x4_mult_vec3(translate_mat, tri->p[2]);
+static void mt__world_mesh_delete(MT_Mesh *mesh);
 
-        tri->p[0] = mt_vec3_add(tri->p[0], mesh->origin_offset);
-        tri->p[1] = mt_vec3_add(tri->p[1], mesh->origin_offset);
-        tri->p[2] = mt_vec3_add(tri->p[2], mesh->origin_offset);
+MT_Mesh *mt_mesh_create_cube(MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale, MT_Material *material)
+{
+    // corner i is +0.5 on x, y and z where bits 0, 1 and 2 of i are set
+    static const uint8_t cube_tris[12][3] = {
+        {4, 0, 5}, {5, 0, 1}, // top
+        {2, 6, 3}, {3, 6, 7}, // bottom
+        {0, 2, 1}, {1, 2, 3}, // front
+        {6, 4, 7}, {7, 4, 5}, // back
+        {6, 2, 4}, {4, 2, 0}, // left
+        {5, 1, 7}, {7, 1, 3}, // right
+    };
+
+    MT_Vec3 corners[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        corners[i] = (MT_Vec3){i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f};
+    }
 
-        // fix normals
-        tri->p_n[0] = mt_mat4x4_mult_vec3(rotation_mat, tri->p_n[0]);
-        tri->p_n[1] = mt_mat4x4_mult_vec3(rotation_mat, tri->p_n[1]);
-        tri->p_n[2] = mt_mat4x4_mult_vec3(rotation_mat, tri->p_n[2]);
-        tri->face_normal = mt_mat4x4_mult_vec3(rotation_mat, tri->face_normal);
+    MT_Mesh *cube = mt_mesh_create(12);
+    for (int i = 0; i < 12; ++i)
+    {
+        mt__mesh_push_tri(cube, corners[cube_tris[i][0]], corners[cube_tris[i][1]], corners[cube_tris[i][2]], material);
     }
 
-    mesh->origin_offset = mt_vec3_add(mesh->origin_offset, translation);
+    mt_mesh_transform(cube, position, rotation, scale);
+
+    return cube;
 }
 
-MT_Sphere *mt_sphere_create(MT_Vec3 position, float radius, MT_Material *mat)
+// a binary stl is an 80 byte header, a little endian tri count and then 50 bytes per tri
+#define MT_STL_HEADER_SIZE 84
+#define MT_STL_TRI_SIZE 50
+
+// space, tab, newline, vertical tab, form feed or carriage return, without the locale lookup isspace does
+static inline int mt__stl_is_space(char c)
 {
-    MT_Sphere *sphere = (MT_Sphere *)malloc(sizeof(MT_Sphere));
-    sphere->position = position;
-    sphere->radius = radius;
-    sphere->mat = mat;
-    return sphere;
+    return c == ' ' || (c >= '\t' && c <= '\r');
 }
 
-///////////////////////////////
-// ========== RAY ========== //
-///////////////////////////////
-typedef struct MT_Ray
+// only a tri count matching the size or a zero byte marks a file as binary, anything else is parsed as text
+static int mt__stl_is_binary(const unsigned char *data, size_t size)
 {
-    MT_Vec3 origin;
-    MT_Vec3 direction;
-    MT_Vec3 throughput;
-    MT_Vec3 accumulated_radiance;
-} MT_Ray;
+    if (size < MT_STL_HEADER_SIZE)
+    {
+        return 0;
+    }
 
-typedef struct MT_RayHit
-{
-    int hit;
-    MT_Vec3 pos;
-    MT_Vec3 normal;
-    float t;
-    int is_backface;
-} MT_RayHit;
+    uint32_t tri_count;
+    memcpy(&tri_count, data + 80, sizeof(tri_count));
+    if (MT_STL_HEADER_SIZE + (uint64_t)tri_count * MT_STL_TRI_SIZE == size)
+    {
+        return 1;
+    }
 
-static MT_Vec3 mt__ray_at(const MT_Ray *ray, float t)
-{
-    return (MT_Vec3){
-        ray->origin.x + t * ray->direction.x,
-        ray->origin.y + t * ray->direction.y,
-        ray->origin.z + t * ray->direction.z};
+    // some exporters start binary headers with "solid" too, and a truncated file's count no longer matches its size
+    // text never holds a zero byte, while a count or attribute bytes almost always do
+    return memchr(data, 0, size < 512 ? size : 512) != NULL;
 }
 
-// Möller–Trumbore intersection
-// source: https://www.youtube.com/watch?v=fK1RPmF_zjQ
-static MT_RayHit mt__ray_hit_tri(const MT_Ray *ray, const MT_Tri *tri)
+// each record is copied straight into the mesh's arrays, facet normals and attribute bytes are skipped
+static void mt__stl_decode_binary(MT_Mesh *mesh, const unsigned char *data, size_t size, MT_Material *material)
 {
-    MT_RayHit hit = {0};
-
-    MT_Vec3 edge1 = mt_vec3_sub(tri->p[1], tri->p[0]);
-    MT_Vec3 edge2 = mt_vec3_sub(tri->p[2], tri->p[0]);
-
-    MT_Vec3 cross_direction_edge2 = mt_vec3_cross(ray->direction, edge2);
+    uint32_t tri_count;
+    memcpy(&tri_count, data + 80, sizeof(tri_count));
 
-    float det = mt_vec3_dot(edge1, cross_direction_edge2);
-    if (det > -MT_EPSILON && det < MT_EPSILON)
+    // a truncated file keeps the tris it has
+    uint64_t available = (size - MT_STL_HEADER_SIZE) / MT_STL_TRI_SIZE;
+    if (tri_count > available)
     {
-        return hit;
+        tri_count = (uint32_t)available;
     }
-    float inv_det = 1.0f / det;
 
-    MT_Vec3 orig_minus_vert0 = mt_vec3_sub(ray->origin, tri->p[0]);
+    mt__mesh_reserve(mesh, mesh->tri_index + tri_count);
+    uint32_t material_index = mt__mesh_material_index(mesh, material);
 
-    // calculate u coordinate and test bounds
-    float baryU = mt_vec3_dot(orig_minus_vert0, cross_direction_edge2) * inv_det;
-    if (baryU < 0.0f || baryU > 1.0f)
+    const unsigned char *record = data + MT_STL_HEADER_SIZE;
+    for (uint32_t i = 0; i < tri_count; ++i, record += MT_STL_TRI_SIZE)
     {
-        return hit;
+        uint32_t tri = mesh->tri_index + i;
+        uint32_t first = mesh->vertex_index + i * 3;
+        memcpy(&mesh->vertices[first], record + 12, sizeof(MT_Vec3) * 3);
+        mesh->indices[tri * 3] = first;
+        mesh->indices[tri * 3 + 1] = first + 1;
+        mesh->indices[tri * 3 + 2] = first + 2;
+        mesh->tri_materials[tri] = material_index;
+        mt__mesh_recalculate_tri_normal(mesh, tri);
     }
 
-    MT_Vec3 cross_originMinusVert0_edge1 = mt_vec3_cross(orig_minus_vert0, edge1);
-
-    float baryV = mt_vec3_dot(ray->direction, cross_originMinusVert0_edge1) * inv_det;
-    if (baryV < 0.0f || baryU + baryV > 1.0f)
+    mesh->tri_index += tri_count;
+    mesh->vertex_index += tri_count * 3;
+    if (tri_count > 0)
     {
-        return hit;
+        mesh->b_unwelded = 1;
+        mesh->b_bvh_dirty = 1;
     }
+}
 
-    float t = mt_vec3_dot(edge2, cross_originMinusVert0_edge1) * inv_det;
+// the next whitespace separated token in [*cursor, end), returns its length and 0 once the text runs out
+static size_t mt__stl_next_token(const char **cursor, const char *end, const char **out_token)
+{
+    const char *c = *cursor;
+    while (c < end && mt__stl_is_space(*c))
+    {
+        ++c;
+    }
 
-    if (t < 0.0f)
+    const char *token = c;
+    while (c < end && !mt__stl_is_space(*c))
     {
-        return hit;
+        ++c;
     }
 
-    hit.hit = 1;
-    hit.pos = mt__ray_at(ray, t);
-    hit.normal = tri->face_normal;
-    hit.t = t;
-    hit.is_backface = (det < 0.0f);
+    *cursor = c;
+    *out_token = token;
+    return (size_t)(c - token);
+}
 
-    if (hit.is_backface)
+// the mapped text is not null terminated, so a number is copied out before strtof reads it
+static float mt__stl_parse_float_slow(const char *token, size_t length)
+{
+    char buffer[64];
+    if (length >= sizeof(buffer))
     {
-        hit.normal = mt_vec3_negate(hit.normal);
+        length = sizeof(buffer) - 1;
     }
-
-    return hit;
+    memcpy(buffer, token, length);
+    buffer[length] = '\0';
+    return strtof(buffer, NULL);
 }
 
-static MT_RayHit mt__ray_hit_sphere(const MT_Ray *ray, const MT_Sphere *sphere)
+// decimal numbers with up to 19 significant digits and a small exponent are read by hand
+// their digits and the power of ten are both exact in a double, so one multiply or divide gives the nearest double
+// rounding that to a float only differs from strtof when it lands exactly halfway between two floats, those go to strtof
+// anything else, nan, inf or hex floats included, is left to strtof too
+static float mt__stl_parse_float(const char *token, size_t length)
 {
-    MT_RayHit hit = {0};
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
 
-    MT_Vec3 oc = mt_vec3_sub(sphere->position, ray->origin);
-    float a = mt_vec3_length_squared(ray->direction);
-    float h = mt_vec3_dot(ray->direction, oc);
-    float c = mt_vec3_length_squared(oc) - sphere->radius * sphere->radius;
-    float discriminant = h * h - a * c;
-    if (discriminant < 0)
+    const char *c = token;
+    const char *end = token + length;
+
+    int b_negative = 0;
+    if (c < end && (*c == '-' || *c == '+'))
     {
-        return hit;
+        b_negative = (*c == '-');
+        ++c;
     }
 
-    float sqrt_disc = sqrtf(discriminant);
-    float t1 = (h - sqrt_disc) / a;
-    float t2 = (h + sqrt_disc) / a;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    int b_any_digit = 0;
 
-    float t_hit = -1.0f;
-    if (t1 >= 0.0f)
+    for (; c < end && *c >= '0' && *c <= '9'; ++c)
     {
-        t_hit = t1;
+        b_any_digit = 1;
+        if (mantissa > 0 || *c != '0')
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+            ++digits;
+        }
     }
-    else if (t2 >= 0.0f)
+    if (c < end && *c == '.')
     {
-        t_hit = t2; // ray origin is inside sphere
+        for (++c; c < end && *c >= '0' && *c <= '9'; ++c)
+        {
+            b_any_digit = 1;
+            if (mantissa > 0 || *c != '0')
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+                ++digits;
+            }
+            --exponent;
+        }
     }
-    else
+    if (b_any_digit && c < end && (*c == 'e' || *c == 'E'))
+    {
+        ++c;
+        int b_negative_exponent = 0;
+        if (c < end && (*c == '-' || *c == '+'))
+        {
+            b_negative_exponent = (*c == '-');
+            ++c;
+        }
+
+        int value = 0;
+        const char *first = c;
+        for (; c < end && *c >= '0' && *c <= '9' && value < 10000; ++c)
+        {
+            value = value * 10 + (*c - '0');
+        }
+        if (c == first)
+        {
+            return mt__stl_parse_float_slow(token, length);
+        }
+        exponent += b_negative_exponent ? -value : value;
+    }
+
+    if (!b_any_digit || c != end || digits > 19 || mantissa > (1ull << 53) || exponent < -22 || exponent > 22)
     {
-        return hit; // both behind ray
+        return mt__stl_parse_float_slow(token, length);
     }
 
-    hit.hit = 1;
-    hit.t = t_hit;
-    hit.pos = mt__ray_at(ray, t_hit);
-    hit.normal = mt_vec3_normalize(mt_vec3_sub(hit.pos, sphere->position));
-    hit.is_backface = (mt_vec3_dot(ray->direction, hit.normal) > 0.0f);
+    double value = (double)mantissa;
+    value = exponent < 0 ? value / powers[-exponent] : value * powers[exponent];
 
-    if (hit.is_backface)
+    // every value reaching here is a normal float, so a midpoint has just the top one of the 29 bits a float drops set
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if ((bits & ((1ull << 29) - 1)) == (1ull << 28))
     {
-        hit.normal = mt_vec3_negate(hit.normal);
+        return mt__stl_parse_float_slow(token, length);
     }
 
-    return hit;
+    return (float)(b_negative ? -value : value);
 }
 
-static void mt__ray_refract(MT_Ray *ray, MT_RayHit *hit, MT_Material *mat)
+// reads the tris of ascii stl text, only vertex and endfacet keywords matter so any layout of whitespace is fine
+static void mt__stl_parse_ascii(MT_Mesh *mesh, const char *text, size_t size, MT_Material *material)
 {
-    float ior_air = 1.0f;
-    float ior_mat = mat->ior;
-    float n1, n2;
+    const char *cursor = text;
+    const char *end = text + size;
 
-    if (!hit->is_backface)
+    // facet normals are not read, they are recalculated from the corners like every other tri's
+    MT_Vec3 p[3];
+    int v_i = 0;
+
+    const char *token;
+    size_t length;
+    while ((length = mt__stl_next_token(&cursor, end, &token)) > 0)
     {
-        n1 = ior_air;
-        n2 = ior_mat;
+        if (length == 6 && memcmp(token, "vertex", 6) == 0)
+        {
+            float xyz[3] = {0.0f, 0.0f, 0.0f};
+            for (int i = 0; i < 3 && (length = mt__stl_next_token(&cursor, end, &token)) > 0; ++i)
+            {
+                xyz[i] = mt__stl_parse_float(token, length);
+            }
+
+            if (v_i < 3)
+            {
+                p[v_i++] = (MT_Vec3){xyz[0], xyz[1], xyz[2]};
+            }
+        }
+        else if (length == 8 && memcmp(token, "endfacet", 8) == 0)
+        {
+            // facets without three corners are dropped
+            if (v_i == 3)
+            {
+                mt__mesh_push_tri(mesh, p[0], p[1], p[2], material);
+            }
+            v_i = 0;
+        }
     }
-    else
+}
+
+// ascii text smaller than this is parsed on the calling thread
+#define MT_STL_CHUNK_MIN_BYTES (1 << 20)
+
+// moves offset forward to the next facet keyword, so no facet is split between two chunks
+static size_t mt__stl_facet_boundary(const char *text, size_t size, size_t offset)
+{
+    for (size_t i = offset; i + 5 <= size; ++i)
     {
-        n1 = ior_mat;
-        n2 = ior_air;
+        if (text[i] == 'f' && memcmp(&text[i], "facet", 5) == 0 &&
+            (i == 0 || mt__stl_is_space(text[i - 1])) && (i + 5 == size || mt__stl_is_space(text[i + 5])))
+        {
+            return i;
+        }
     }
+    return size;
+}
 
-    float eta = n1 / n2;
-    float cos_i = -mt_vec3_dot(hit->normal, ray->direction);    // incident cos
-    float cos_t_sq = 1.0f - eta * eta * (1.0f - cos_i * cos_i); // transmittance cos squared
-
-    // apply color
-    ray->throughput = mt_vec3_mult(ray->throughput, mat->color);
+typedef struct MT_STLParseJob
+{
+    const char *text;
+    const size_t *boundaries; // chunk i is [boundaries[i], boundaries[i + 1])
+    MT_Mesh **chunk_meshes;
+    MT_Material *material;
+} MT_STLParseJob;
 
-    MT_Vec3 mat_emission = mt_vec3_mult_v(mat->emission, mat->emission_strength);
-    ray->accumulated_radiance = mt_vec3_add(ray->accumulated_radiance, mt_vec3_mult(ray->throughput, mat_emission));
+static void mt__stl_parse_chunks(void *data, unsigned int start, unsigned int end, unsigned int thread_index)
+{
+    MT_STLParseJob *job = (MT_STLParseJob *)data;
 
-    if (cos_t_sq > 0.0f) // ray transmitted
+    for (unsigned int i = start; i < end; ++i)
     {
-        float cos_t = sqrtf(cos_t_sq);
-
-        // snell's law
-        MT_Vec3 refracted = mt_vec3_add(
-            mt_vec3_mult_v(ray->direction, eta),
-            mt_vec3_mult_v(hit->normal, eta * cos_i - cos_t));
+        job->chunk_meshes[i] = mt_mesh_create(0);
+        mt__stl_parse_ascii(job->chunk_meshes[i], job->text + job->boundaries[i], job->boundaries[i + 1] - job->boundaries[i], job->material);
+    }
+}
 
-        ray->direction = mt_vec3_normalize(refracted);
-        ray->origin = mt_vec3_add(hit->pos, mt_vec3_mult_v(ray->direction, MT_EPSILON * 10.0f));
+// each thread parses a run of whole facets into a mesh of its own, which are then appended in file order
+static void mt__stl_parse_ascii_parallel(MT_Mesh *mesh, const char *text, size_t size, MT_Material *material)
+{
+    size_t max_chunks = size / MT_STL_CHUNK_MIN_BYTES;
+    unsigned int chunk_count = mt__hardware_thread_count();
+    if (chunk_count > max_chunks)
+    {
+        chunk_count = max_chunks > 0 ? (unsigned int)max_chunks : 1;
     }
-    else // internal reflection
+
+    if (chunk_count <= 1)
     {
-        MT_Vec3 n = hit->normal;
-        float d = mt_vec3_dot(ray->direction, n);
-        ray->direction = mt_vec3_sub(ray->direction, mt_vec3_mult_v(n, 2.0f * d));
-        ray->origin = mt_vec3_add(hit->pos, mt_vec3_mult_v(n, MT_EPSILON * 0.1f));
+        mt__stl_parse_ascii(mesh, text, size, material);
+        return;
     }
-}
 
-static void mt__ray_reflect(MT_Ray *ray, MT_RayHit *hit, MT_Material *mat)
-{
-    // apply color
-    ray->throughput = mt_vec3_mult(ray->throughput, mat->color);
+    size_t *boundaries = (size_t *)malloc(sizeof(size_t) * (chunk_count + 1));
+    boundaries[0] = 0;
+    for (unsigned int i = 1; i < chunk_count; ++i)
+    {
+        size_t offset = (size_t)((uint64_t)size * i / chunk_count);
+        boundaries[i] = mt__stl_facet_boundary(text, size, offset > boundaries[i - 1] ? offset : boundaries[i - 1]);
+    }
+    boundaries[chunk_count] = size;
 
-    MT_Vec3 mat_emission = mt_vec3_mult_v(mat->emission, mat->emission_strength);
-    ray->accumulated_radiance = mt_vec3_add(ray->accumulated_radiance, mt_vec3_mult(ray->throughput, mat_emission));
+    MT_STLParseJob job = {text, boundaries, (MT_Mesh **)malloc(sizeof(MT_Mesh *) * chunk_count), material};
+    mt__parallel_for(chunk_count, chunk_count, mt__stl_parse_chunks, &job);
 
-    MT_Vec3 i_n = mt_vec3_normalize(ray->direction);
-    float d = mt_vec3_dot(i_n, hit->normal);
-    ray->origin = hit->pos;
-    ray->direction = mt_vec3_sub(i_n, mt_vec3_mult_v(hit->normal, 2.0f * d));
+    unsigned int tri_count = 0;
+    for (unsigned int i = 0; i < chunk_count; ++i)
+    {
+        tri_count += job.chunk_meshes[i]->tri_index;
+    }
+    mt__mesh_reserve(mesh, mesh->tri_index + tri_count);
 
-    // scatter from roughness
-    ray->direction = mt_vec3_lerp(ray->direction, mt__random_hemi_normal_distribution(hit->normal), mat->roughness);
-    ray->direction = mt_vec3_normalize(ray->direction);
+    for (unsigned int i = 0; i < chunk_count; ++i)
+    {
+        mt__mesh_append(mesh, job.chunk_meshes[i]);
+        mt__world_mesh_delete(job.chunk_meshes[i]);
+    }
 
-    // fix self intersection
-    ray->origin = mt_vec3_add(hit->pos, mt_vec3_mult_v(hit->normal, MT_EPSILON * 10.0f));
+    free(job.chunk_meshes);
+    free(boundaries);
 }
 
-static void mt__ray_bounce(MT_Ray *ray, MT_RayHit *hit, MT_Material *mat)
+// reads ascii or binary stl, the file is mapped and binary tris are decoded straight into the mesh's arrays
+// returns NULL if the file cannot be read or is text without any facets
+MT_Mesh *mt_mesh_create_from_stl(const char *path, MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale, MT_Material *material)
 {
-    if (mat->b_is_refractive)
+    size_t size;
+    unsigned char *data = (unsigned char *)mt__file_map(path, &size);
+    if (!data)
     {
-        // refractive bounce
-        mt__ray_refract(ray, hit, mat);
+        return NULL;
+    }
+
+#ifndef _WIN32
+    madvise(data, size, MADV_SEQUENTIAL);
+#endif
+
+    MT_Mesh *stl_mesh = mt_mesh_create(0);
+    if (mt__stl_is_binary(data, size))
+    {
+        mt__stl_decode_binary(stl_mesh, data, size, material);
     }
     else
     {
-        // reflective bounce
-        mt__ray_reflect(ray, hit, mat);
+        mt__stl_parse_ascii_parallel(stl_mesh, (const char *)data, size, material);
+
+        // text without a single facet is more likely a broken file than an empty mesh
+        if (stl_mesh->tri_index == 0)
+        {
+            fprintf(stderr, "mt_mesh_create_from_stl: %s has no facets\n", path);
+            mt__world_mesh_delete(stl_mesh);
+            mt__file_unmap(data, size);
+            return NULL;
+        }
     }
-}
 
-///////////////////////////////////////
-// ========== ENVIRONMENT ========== //
-///////////////////////////////////////
-MT_Environment *mt_environment_create()
-{
-    MT_Environment *environment = (MT_Environment *)malloc(sizeof(MT_Environment));
-    environment->zenith_color = (MT_Vec3){0.682f, 0.827f, 0.957f};
-    environment->horizon_color = (MT_Vec3){1.0f, 0.930f, 0.880f};
-    environment->brightness = 1.0f;
-    return environment;
+    mt__file_unmap(data, size);
+
+    mt_mesh_transform(stl_mesh, position, rotation, scale);
+
+    return stl_mesh;
 }
 
-static void mt__ray_hit_environment(MT_Environment *env, MT_Ray *ray)
+// copies the tri's corners and material into the mesh's arrays, its normal is recalculated and tri stays the caller's to free
+// the mesh only keeps its corners and material, so later edits to tri do not reach the mesh
+void mt_mesh_add_tri(MT_Mesh *mesh, MT_Tri *tri)
 {
-    MT_Vec3 unit_direction = mt_vec3_negate(mt_vec3_normalize(ray->direction));
-    float t = 0.5f * (unit_direction.y + 1.0f);
-    MT_Vec3 color = mt_vec3_lerp(env->horizon_color, env->zenith_color, t);
-    color = mt_vec3_clamp(mt_vec3_mult_v(color, env->brightness), 0.0f, 1.0f);
-    ray->accumulated_radiance = mt_vec3_add(ray->accumulated_radiance, mt_vec3_mult(ray->throughput, color));
+    mt__mesh_push_tri(mesh, tri->p[0], tri->p[1], tri->p[2], tri->mat);
 }
 
-///////////////////////////////
-// ========== BVH ========== //
-///////////////////////////////
-typedef struct MT_Bounds
+typedef struct MT_MeshTransformJob
 {
-    MT_Vec3 start, end;
-} MT_Bounds;
+    MT_Mesh *mesh;
+    MT_Mat4x4 m;
+} MT_MeshTransformJob;
 
-typedef struct MT_BVHMorton
+static void mt__mesh_normals_range(void *data, unsigned int start, unsigned int end, unsigned int thread_index)
 {
-    uint32_t morton_code;
-    int object_index;
-} MT_BVHMorton;
+    MT_MeshTransformJob *job = (MT_MeshTransformJob *)data;
+    (void)thread_index;
 
-typedef struct MT_BVHNode
-{
-    MT_Bounds bounds;
+    for (unsigned int i = start; i < end; ++i)
+    {
+        mt__mesh_recalculate_tri_normal(job->mesh, i);
+    }
+}
 
-    struct MT_BVHNode *child_left;
-    struct MT_BVHNode *child_right;
+void mt_mesh_recalculate_normals(MT_Mesh *mesh)
+{
+    MT_MeshTransformJob job;
+    job.mesh = mesh;
 
-    int leaf_object_index;
-} MT_BVHNode;
+    unsigned int thread_count = mt__parallel_thread_count(mt__hardware_thread_count(), mesh->tri_index);
+    mt__parallel_for(thread_count, mesh->tri_index, mt__mesh_normals_range, &job);
+}
 
-/////////////////////////////////
-// ========== WORLD ========== //
-/////////////////////////////////
-typedef struct MT_World
+// the packed vertices are x y z x y z..., so 4 of them fill 3 registers and are transposed to x4 y4 z4 and back
+// the sums run in the same order as the scalar tail, so the result does not depend on where a range starts
+static void mt__mesh_transform_range(void *data, unsigned int start, unsigned int end, unsigned int thread_index)
 {
-    void **objects;
-    ObjectType *objects_track;
-    MT_BVHNode *bvh;
+    MT_MeshTransformJob *job = (MT_MeshTransformJob *)data;
+    const MT_Mat4x4 *m = &job->m;
+    MT_Vec3 *vertices = job->mesh->vertices;
+    (void)thread_index;
 
-    MT_Environment *environment;
+    unsigned int i = start;
 
-    unsigned int object_index;
-    unsigned int max_objects;
-} MT_World;
+#if defined(__SSE__)
+    __m128 m00 = _mm_set1_ps(m->m[0][0]), m01 = _mm_set1_ps(m->m[0][1]), m02 = _mm_set1_ps(m->m[0][2]), m03 = _mm_set1_ps(m->m[0][3]);
+    __m128 m10 = _mm_set1_ps(m->m[1][0]), m11 = _mm_set1_ps(m->m[1][1]), m12 = _mm_set1_ps(m->m[1][2]), m13 = _mm_set1_ps(m->m[1][3]);
+    __m128 m20 = _mm_set1_ps(m->m[2][0]), m21 = _mm_set1_ps(m->m[2][1]), m22 = _mm_set1_ps(m->m[2][2]), m23 = _mm_set1_ps(m->m[2][3]);
 
-MT_World *mt_world_create(unsigned int max_objects)
-{
-    MT_World *world = (MT_World *)malloc(sizeof(MT_World));
-    world->objects = (void **)malloc(sizeof(void *) * max_objects);
-    world->objects_track = (ObjectType *)malloc(sizeof(ObjectType) * max_objects);
-    world->bvh = NULL;
-    world->environment = NULL;
-    world->object_index = 0;
-    world->max_objects = max_objects;
-    return world;
+    for (; i + 4 <= end; i += 4)
+    {
+        float *p = &vertices[i].x;
+        __m128 r0 = _mm_loadu_ps(p);     // x0 y0 z0 x1
+        __m128 r1 = _mm_loadu_ps(p + 4); // y1 z1 x2 y2
+        __m128 r2 = _mm_loadu_ps(p + 8); // z2 x3 y3 z3
+
+        __m128 x = _mm_shuffle_ps(r0, _mm_shuffle_ps(r1, r2, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+        __m128 y = _mm_shuffle_ps(_mm_shuffle_ps(r0, r1, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(r1, r2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 z = _mm_shuffle_ps(_mm_shuffle_ps(r0, r1, _MM_SHUFFLE(1, 1, 2, 2)), r2, _MM_SHUFFLE(3, 0, 2, 0));
+
+        __m128 out_x = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m00), _mm_mul_ps(y, m01)), _mm_mul_ps(z, m02)), m03);
+        __m128 out_y = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m10), _mm_mul_ps(y, m11)), _mm_mul_ps(z, m12)), m13);
+        __m128 out_z = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m20), _mm_mul_ps(y, m21)), _mm_mul_ps(z, m22)), m23);
+
+        _mm_storeu_ps(p, _mm_shuffle_ps(_mm_shuffle_ps(out_x, out_y, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(out_z, out_x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(p + 4, _mm_shuffle_ps(_mm_shuffle_ps(out_y, out_z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(out_x, out_y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(p + 8, _mm_shuffle_ps(_mm_shuffle_ps(out_z, out_x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(out_y, out_z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+    }
+#endif
+
+    for (; i < end; ++i)
+    {
+        MT_Vec3 v = vertices[i];
+        vertices[i] = (MT_Vec3){
+            v.x * m->m[0][0] + v.y * m->m[0][1] + v.z * m->m[0][2] + m->m[0][3],
+            v.x * m->m[1][0] + v.y * m->m[1][1] + v.z * m->m[1][2] + m->m[1][3],
+            v.x * m->m[2][0] + v.y * m->m[2][1] + v.z * m->m[2][2] + m->m[2][3]};
+    }
 }
 
-void mt_world_add_object(MT_World *world, void *object, ObjectType object_type)
+// applies one affine matrix to every vertex around pivot, the callers compose their steps into it first
+// normals are recalculated from the moved corners rather than transformed, so they cannot drift from the tris
+static void mt__mesh_apply_transform(MT_Mesh *mesh, MT_Mat4x4 m, MT_Vec3 pivot)
 {
-    if (world->object_index >= world->max_objects)
+    MT_MeshTransformJob job;
+    job.mesh = mesh;
+    job.m = mt_mat4x4_mult(mt_mat4x4_create_translation(pivot), mt_mat4x4_mult(m, mt_mat4x4_create_translation(mt_vec3_negate(pivot))));
+
+    int b_linear_identity = 1;
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            b_linear_identity &= job.m.m[i][j] == (i == j ? 1.0f : 0.0f);
+        }
+    }
+
+    if (b_linear_identity && job.m.m[0][3] == 0 && job.m.m[1][3] == 0 && job.m.m[2][3] == 0)
     {
         return;
     }
 
-    world->objects[world->object_index] = object;
-    world->objects_track[world->object_index] = object_type;
-    ++world->object_index;
+    unsigned int thread_count = mt__parallel_thread_count(mt__hardware_thread_count(), mesh->vertex_index);
+    mt__parallel_for(thread_count, mesh->vertex_index, mt__mesh_transform_range, &job);
+
+    // a pure translation leaves every normal as it was
+    if (!b_linear_identity)
+    {
+        mt_mesh_recalculate_normals(mesh);
+    }
+    mesh->b_bvh_dirty = 1;
 }
 
-void mt_world_set_environment(MT_World *world, MT_Environment *environment)
+void mt_mesh_move(MT_Mesh *mesh, MT_Vec3 position)
 {
-    world->environment = environment;
+    mt__mesh_apply_transform(mesh, mt_mat4x4_create_translation(position), (MT_Vec3){0, 0, 0});
+    mesh->origin_offset = mt_vec3_add(mesh->origin_offset, position);
 }
 
-static void mt__world_bvh_delete(MT_BVHNode *bvh)
+void mt_mesh_rotate(MT_Mesh *mesh, MT_Vec3 rotation)
 {
-    if (!bvh)
-    {
-        return;
-    }
+    mt__mesh_apply_transform(mesh, mt_mat4x4_create_rotation(rotation), mesh->origin_offset);
+}
 
-    mt__world_bvh_delete(bvh->child_left);
-    mt__world_bvh_delete(bvh->child_right);
+void mt_mesh_scale(MT_Mesh *mesh, MT_Vec3 scale)
+{
+    mt__mesh_apply_transform(mesh, mt_mat4x4_create_scale(scale), (MT_Vec3){0, 0, 0});
+}
 
-    free(bvh);
+void mt_mesh_transform(MT_Mesh *mesh, MT_Vec3 translation, MT_Vec3 rotation, MT_Vec3 scale)
+{
+    MT_Mat4x4 translate_mat = mt_mat4x4_create_translation(translation);
+    MT_Mat4x4 rotation_mat = mt_mat4x4_create_rotation(rotation);
+    MT_Mat4x4 scale_mat = mt_mat4x4_create_scale(scale);
+
+    mt__mesh_apply_transform(mesh, mt_mat4x4_mult(translate_mat, mt_mat4x4_mult(rotation_mat, scale_mat)), mesh->origin_offset);
+    mesh->origin_offset = mt_vec3_add(mesh->origin_offset, translation);
 }
 
-static void mt__world_mesh_delete(MT_Mesh *mesh)
+MT_Sphere *mt_sphere_create(MT_Vec3 position, float radius, MT_Material *mat)
 {
-    if (!mesh)
-    {
-        return;
-    }
+    MT_Sphere *sphere = (MT_Sphere *)malloc(sizeof(MT_Sphere));
+    sphere->position = position;
+    sphere->radius = radius;
+    sphere->mat = mat;
+    return sphere;
+}
+
+static void mt__box_set(MT_Box *box, MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale, MT_Material *mat)
+{
+    MT_Mat4x4 rotation_mat = mt_mat4x4_create_rotation(rotation);
 
-    if (mesh->tris)
+    box->position = position;
+    for (int i = 0; i < 3; ++i)
     {
-        for (int i = 0; i < mesh->tri_index; ++i)
-        {
-            if (mesh->tris[i])
-            {
-                free(mesh->tris[i]);
-            }
-        }
-        free(mesh->tris);
+        box->axes[i] = (MT_Vec3){rotation_mat.m[0][i], rotation_mat.m[1][i], rotation_mat.m[2][i]};
     }
+    box->half_size = (MT_Vec3){fabsf(scale.x) * 0.5f, fabsf(scale.y) * 0.5f, fabsf(scale.z) * 0.5f};
+    box->mat = mat;
+}
 
-    free(mesh);
+// the same unit box mt_mesh_create_cube makes, scaled, rotated and then moved
+MT_Box *mt_box_create(MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale, MT_Material *mat)
+{
+    MT_Box *box = (MT_Box *)malloc(sizeof(MT_Box));
+    mt__box_set(box, position, rotation, scale, mat);
+    return box;
 }
 
-static void mt__world_sphere_delete(MT_Sphere *sphere)
+// faces -y before it is rotated, like mt_mesh_create_plane's tris
+MT_Plane *mt_plane_create(MT_Vec3 position, MT_Vec3 rotation, MT_Material *mat)
 {
-    if (sphere)
-    {
-        free(sphere);
-    }
+    MT_Plane *plane = (MT_Plane *)malloc(sizeof(MT_Plane));
+    plane->position = position;
+    plane->normal = mt_vec3_normalize(mt_mat4x4_mult_vec3(mt_mat4x4_create_rotation(rotation), (MT_Vec3){0, -1, 0}));
+    plane->mat = mat;
+    return plane;
 }
 
-void mt__environment_delete(MT_Environment *environment)
+static inline MT_Vec3 mt__sphere_cloud_center(const MT_SphereCloud *cloud, uint32_t sphere)
 {
-    if (environment)
+    const MT_SphereBlock *block = &cloud->blocks[sphere / MT_TRI_BLOCK_WIDTH];
+    uint32_t lane = sphere % MT_TRI_BLOCK_WIDTH;
+    return (MT_Vec3){block->center[0][lane], block->center[1][lane], block->center[2][lane]};
+}
+
+static inline float mt__sphere_cloud_radius(const MT_SphereCloud *cloud, uint32_t sphere)
+{
+    return cloud->blocks[sphere / MT_TRI_BLOCK_WIDTH].radius[sphere % MT_TRI_BLOCK_WIDTH];
+}
+
+static inline void mt__sphere_cloud_set(MT_SphereCloud *cloud, uint32_t sphere, MT_Vec3 center, float radius)
+{
+    MT_SphereBlock *block = &cloud->blocks[sphere / MT_TRI_BLOCK_WIDTH];
+    uint32_t lane = sphere % MT_TRI_BLOCK_WIDTH;
+    block->center[0][lane] = center.x;
+    block->center[1][lane] = center.y;
+    block->center[2][lane] = center.z;
+    block->radius[lane] = radius;
+}
+
+static inline uint32_t mt__sphere_block_count(unsigned int sphere_count)
+{
+    return (sphere_count + MT_TRI_BLOCK_WIDTH - 1) / MT_TRI_BLOCK_WIDTH;
+}
+
+// zeroed blocks with room for max_spheres, always at least one so a cloud's blocks are never NULL
+static MT_SphereBlock *mt__sphere_blocks_create(unsigned int max_spheres)
+{
+    size_t size = sizeof(MT_SphereBlock) * (max_spheres > 0 ? mt__sphere_block_count(max_spheres) : 1);
+    MT_SphereBlock *blocks = (MT_SphereBlock *)mt__aligned_malloc(size, MT_TRI_BLOCK_ALIGN);
+    memset(blocks, 0, size);
+    return blocks;
+}
+
+// copies arrays a snapshot lent the cloud into its own memory, before they are replaced or resized
+static void mt__sphere_cloud_detach(MT_SphereCloud *cloud)
+{
+    if (!cloud->b_borrowed)
     {
-        free(environment);
+        return;
     }
+
+    MT_SphereBlock *blocks = mt__sphere_blocks_create(cloud->max_spheres);
+    uint32_t *sphere_materials = (uint32_t *)malloc(sizeof(uint32_t) * (cloud->max_spheres > 0 ? cloud->max_spheres : 1));
+    MT_Material **materials = (MT_Material **)malloc(sizeof(MT_Material *) * (cloud->material_count > 0 ? cloud->material_count : 1));
+    memcpy(blocks, cloud->blocks, sizeof(MT_SphereBlock) * mt__sphere_block_count(cloud->sphere_index));
+    memcpy(sphere_materials, cloud->sphere_materials, sizeof(uint32_t) * cloud->sphere_index);
+    memcpy(materials, cloud->materials, sizeof(MT_Material *) * cloud->material_count);
+
+    cloud->blocks = blocks;
+    cloud->sphere_materials = sphere_materials;
+    cloud->materials = materials;
+    cloud->max_materials = cloud->material_count;
+    cloud->b_borrowed = 0;
 }
 
-void mt_world_delete(MT_World *world)
+static void mt__sphere_cloud_reserve(MT_SphereCloud *cloud, unsigned int max_spheres)
 {
-    if (!world)
+    if (max_spheres <= cloud->max_spheres)
     {
         return;
     }
 
-    if (world->objects)
-    {
-        for (unsigned int i = 0; i < world->object_index; ++i)
-        {
-            if (!world->objects[i])
-            {
-                continue;
-            }
+    mt__sphere_cloud_detach(cloud);
+    MT_SphereBlock *blocks = mt__sphere_blocks_create(max_spheres);
+    memcpy(blocks, cloud->blocks, sizeof(MT_SphereBlock) * mt__sphere_block_count(cloud->sphere_index));
+    mt__aligned_free(cloud->blocks);
 
-            switch (world->objects_track[i])
-            {
-            case MT_OBJECT_MESH:
-                mt__world_mesh_delete(world->objects[i]);
-                break;
-            case MT_OBJECT_SPHERE:
-                mt__world_sphere_delete(world->objects[i]);
-                break;
-            }
-        }
-        free(world->objects);
-    }
+    cloud->blocks = blocks;
+    cloud->sphere_materials = (uint32_t *)realloc(cloud->sphere_materials, sizeof(uint32_t) * max_spheres);
+    cloud->max_spheres = max_spheres;
+}
 
-    if (world->objects_track)
+// finds mat in the cloud's material table, adding it if no sphere used it yet
+static uint32_t mt__sphere_cloud_material_index(MT_SphereCloud *cloud, MT_Material *mat)
+{
+    // particles are mostly added in runs sharing one material, so the table is searched from the last one added
+    for (uint32_t i = cloud->material_count; i-- > 0;)
     {
-        free(world->objects_track);
+        if (cloud->materials[i] == mat)
+        {
+            return i;
+        }
     }
 
-    mt__environment_delete(world->environment);
-
-    if (world->bvh)
+    mt__sphere_cloud_detach(cloud);
+    if (cloud->material_count >= cloud->max_materials)
     {
-        mt__world_bvh_delete(world->bvh);
+        cloud->max_materials = cloud->max_materials > 0 ? cloud->max_materials * 2 : 16;
+        cloud->materials = (MT_Material **)realloc(cloud->materials, sizeof(MT_Material *) * cloud->max_materials);
     }
 
-    free(world);
+    cloud->materials[cloud->material_count] = mat;
+    return cloud->material_count++;
 }
 
-/////////////////////////////////////////
-// ========== BVH FUNCTIONS ========== //
-/////////////////////////////////////////
-static MT_Bounds mt__bounds_create_invalid()
+MT_SphereCloud *mt_sphere_cloud_create(unsigned int max_spheres)
 {
-    MT_Bounds bounds;
-    bounds.start = (MT_Vec3){FLT_MAX, FLT_MAX, FLT_MAX};
-    bounds.end = (MT_Vec3){-FLT_MAX, -FLT_MAX, -FLT_MAX};
-    return bounds;
+    MT_SphereCloud *cloud = (MT_SphereCloud *)malloc(sizeof(MT_SphereCloud));
+    cloud->blocks = mt__sphere_blocks_create(max_spheres);
+    cloud->sphere_materials = max_spheres > 0 ? (uint32_t *)malloc(sizeof(uint32_t) * max_spheres) : NULL;
+    cloud->materials = NULL;
+    cloud->material_count = 0;
+    cloud->max_materials = 0;
+    cloud->b_borrowed = 0;
+    cloud->bvh = NULL;
+    cloud->b_bvh_dirty = 1;
+    cloud->b_bvh_slower = 0;
+    cloud->ray_cost = 0.0f;
+    cloud->max_spheres = max_spheres;
+    cloud->sphere_index = 0;
+    return cloud;
 }
 
-// branchless slab collision
-// source: https://tavianator.com/2022/ray_box_boundary.html
-static int mt__point_in_bounds(MT_Vec3 p, MT_Bounds bounds)
+// the cloud grows past max_spheres as needed, mark it dirty in its world after adding to it
+void mt_sphere_cloud_add_sphere(MT_SphereCloud *cloud, MT_Vec3 position, float radius, MT_Material *mat)
 {
-    int x = p.x >= bounds.start.x && p.x <= bounds.end.x;
-    int y = p.y >= bounds.start.y && p.y <= bounds.end.y;
-    int z = p.z >= bounds.start.z && p.z <= bounds.end.z;
+    if (cloud->sphere_index >= cloud->max_spheres)
+    {
+        mt__sphere_cloud_reserve(cloud, cloud->max_spheres ? cloud->max_spheres * 2 : 16);
+    }
 
-    return x && y && z;
+    mt__sphere_cloud_detach(cloud);
+    mt__sphere_cloud_set(cloud, cloud->sphere_index, position, radius);
+    cloud->sphere_materials[cloud->sphere_index] = mt__sphere_cloud_material_index(cloud, mat);
+
+    ++cloud->sphere_index;
+    cloud->b_bvh_dirty = 1;
 }
 
-static int mt__ray_hit_bounds(const MT_Ray *ray, MT_Bounds bounds)
+// removes every sphere but keeps the memory and materials, for particles that are added again each frame
+void mt_sphere_cloud_clear(MT_SphereCloud *cloud)
 {
-    float tmin = 0, tmax = FLT_MAX;
-
-    float i_dx = 1.0f / ray->direction.x;
-    float i_dy = 1.0f / ray->direction.y;
-    float i_dz = 1.0f / ray->direction.z;
-
-    float tx1 = (bounds.start.x - ray->origin.x) * i_dx;
-    float tx2 = (bounds.end.x - ray->origin.x) * i_dx;
-    tmin = fmaxf(tmin, fminf(tx1, tx2));
-    tmax = fminf(tmax, fmaxf(tx1, tx2));
-
-    float ty1 = (bounds.start.y - ray->origin.y) * i_dy;
-    float ty2 = (bounds.end.y - ray->origin.y) * i_dy;
-    tmin = fmaxf(tmin, fminf(ty1, ty2));
-    tmax = fminf(tmax, fmaxf(ty1, ty2));
-
-    float tz1 = (bounds.start.z - ray->origin.z) * i_dz;
-    float tz2 = (bounds.end.z - ray->origin.z) * i_dz;
-    tmin = fmaxf(tmin, fminf(tz1, tz2));
-    tmax = fminf(tmax, fmaxf(tz1, tz2));
-
-    return tmin < tmax;
+    mt__sphere_cloud_detach(cloud);
+    memset(cloud->blocks, 0, sizeof(MT_SphereBlock) * mt__sphere_block_count(cloud->sphere_index));
+    cloud->sphere_index = 0;
+    cloud->b_bvh_dirty = 1;
 }
 
-static MT_Bounds mt__bounds_union(MT_Bounds a, MT_Bounds b)
+// a placement of a mesh that is shared with other instances, its tris stay in the mesh's own space
+typedef struct MT_Instance
 {
-    MT_Bounds out;
-    out.start.x = fminf(a.start.x, b.start.x);
-    out.start.y = fminf(a.start.y, b.start.y);
-    out.start.z = fminf(a.start.z, b.start.z);
-    out.end.x = fmaxf(a.end.x, b.end.x);
-    out.end.y = fmaxf(a.end.y, b.end.y);
-    out.end.z = fmaxf(a.end.z, b.end.z);
-    return out;
-}
+    MT_Mesh *mesh;
 
-static void mt__bounds_shift_mesh(MT_Mesh *mesh, MT_Bounds *out)
+    MT_Mat4x4 object_to_world;
+    MT_Mat4x4 world_to_object;
+    MT_Mat4x4 normal_to_world; // inverse transpose of object_to_world
+} MT_Instance;
+
+static MT_Mat4x4 mt__mat4x4_transpose(MT_Mat4x4 m)
 {
-    for (int i = 0; i < mesh->tri_index; ++i)
+    MT_Mat4x4 out;
+    for (int i = 0; i < 4; ++i)
     {
-        MT_Tri *tri = mesh->tris[i];
-        for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 4; ++j)
         {
-            out->start.x = fminf(out->start.x, tri->p[i].x);
-            out->start.y = fminf(out->start.y, tri->p[i].y);
-            out->start.z = fminf(out->start.z, tri->p[i].z);
-
-            out->end.x = fmaxf(out->end.x, tri->p[i].x);
-            out->end.y = fmaxf(out->end.y, tri->p[i].y);
-            out->end.z = fmaxf(out->end.z, tri->p[i].z);
+            out.m[i][j] = m.m[j][i];
         }
     }
+    return out;
 }
 
-static MT_Bounds mt__bounds_calculate_mesh(MT_Mesh *mesh)
+// multiplies by the upper 3x3 only, for directions and normals
+static inline MT_Vec3 mt__mat4x4_mult_dir(const MT_Mat4x4 *m, MT_Vec3 v)
 {
-    MT_Bounds out = mt__bounds_create_invalid();
-    mt__bounds_shift_mesh(mesh, &out);
-    return out;
+    return (MT_Vec3){
+        v.x * m->m[0][0] + v.y * m->m[0][1] + v.z * m->m[0][2],
+        v.x * m->m[1][0] + v.y * m->m[1][1] + v.z * m->m[1][2],
+        v.x * m->m[2][0] + v.y * m->m[2][1] + v.z * m->m[2][2]};
 }
 
-static void mt__bounds_shift_sphere(MT_Sphere *sphere, MT_Bounds *out)
+MT_Instance *mt_instance_create(MT_Mesh *mesh, MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale)
 {
-    float r = sphere->radius;
-    MT_Vec3 p = sphere->position;
+    MT_Instance *instance = (MT_Instance *)malloc(sizeof(MT_Instance));
+    instance->mesh = mesh;
+    mt_instance_transform(instance, position, rotation, scale);
+    return instance;
+}
 
-    MT_Vec3 s_min = (MT_Vec3){p.x - r, p.y - r, p.z - r};
-    MT_Vec3 s_max = (MT_Vec3){p.x + r, p.y + r, p.z + r};
+// sets the instance's placement, unlike mt_mesh_transform this replaces the previous one
+void mt_instance_transform(MT_Instance *instance, MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale)
+{
+    MT_Mat4x4 translate_mat = mt_mat4x4_create_translation(position);
+    MT_Mat4x4 rotation_mat = mt_mat4x4_create_rotation(rotation);
+    MT_Mat4x4 scale_mat = mt_mat4x4_create_scale(scale);
 
-    out->start.x = fminf(out->start.x, s_min.x);
-    out->start.y = fminf(out->start.y, s_min.y);
-    out->start.z = fminf(out->start.z, s_min.z);
+    // rotations are orthonormal so their inverse is their transpose
+    MT_Mat4x4 inv_translate_mat = mt_mat4x4_create_translation(mt_vec3_negate(position));
+    MT_Mat4x4 inv_rotation_mat = mt__mat4x4_transpose(rotation_mat);
+    MT_Mat4x4 inv_scale_mat = mt_mat4x4_create_scale((MT_Vec3){1.0f / scale.x, 1.0f / scale.y, 1.0f / scale.z});
 
-    out->end.x = fmaxf(out->end.x, s_max.x);
-    out->end.y = fmaxf(out->end.y, s_max.y);
-    out->end.z = fmaxf(out->end.z, s_max.z);
+    instance->object_to_world = mt_mat4x4_mult(translate_mat, mt_mat4x4_mult(rotation_mat, scale_mat));
+    instance->world_to_object = mt_mat4x4_mult(inv_scale_mat, mt_mat4x4_mult(inv_rotation_mat, inv_translate_mat));
+    instance->normal_to_world = mt_mat4x4_mult(rotation_mat, inv_scale_mat);
 }
 
-static MT_Bounds mt__bounds_calculate_sphere(MT_Sphere *sphere)
+///////////////////////////////
+// ========== RAY ========== //
+///////////////////////////////
+typedef struct MT_Ray
 {
-    MT_Bounds out = mt__bounds_create_invalid();
-    mt__bounds_shift_sphere(sphere, &out);
-    return out;
+    MT_Vec3 origin;
+    MT_Vec3 direction;
+    MT_Vec3 throughput;
+    MT_Vec3 accumulated_radiance;
+} MT_Ray;
+
+typedef struct MT_RayHit
+{
+    int hit;
+    MT_Vec3 pos;
+    MT_Vec3 normal;
+    float t;
+    int is_backface;
+} MT_RayHit;
+
+static MT_Vec3 mt__ray_at(const MT_Ray *ray, float t)
+{
+    return (MT_Vec3){
+        ray->origin.x + t * ray->direction.x,
+        ray->origin.y + t * ray->direction.y,
+        ray->origin.z + t * ray->direction.z};
 }
 
-static MT_Bounds mt__world_calculate_bounds(MT_World *world)
+// Möller–Trumbore intersection, against a tri given as a corner and the two edges from it
+// source: https://www.youtube.com/watch?v=fK1RPmF_zjQ
+static inline int mt__ray_hit_tri_edges(const MT_Ray *ray, MT_Vec3 v0, MT_Vec3 edge1, MT_Vec3 edge2, float *out_t, float *out_u, float *out_v, int *out_backface)
 {
-    MT_Bounds bounds = mt__bounds_create_invalid();
+    MT_Vec3 cross_direction_edge2 = mt_vec3_cross(ray->direction, edge2);
 
-    for (int i = 0; i < world->object_index; ++i)
+    float det = mt_vec3_dot(edge1, cross_direction_edge2);
+    if (det > -MT_EPSILON && det < MT_EPSILON)
     {
-        switch (world->objects_track[i])
-        {
-        case MT_OBJECT_MESH:
-            mt__bounds_shift_mesh((MT_Mesh *)world->objects[i], &bounds);
-            break;
-        case MT_OBJECT_SPHERE:
-            mt__bounds_shift_sphere((MT_Sphere *)world->objects[i], &bounds);
-            break;
-        }
+        return 0;
     }
+    float inv_det = 1.0f / det;
 
-    return bounds;
-}
+    MT_Vec3 orig_minus_vert0 = mt_vec3_sub(ray->origin, v0);
 
-// morton numbers
-// source: https://stackoverflow.com/a/1024889
-static uint32_t mt__expand_bits10to30(uint32_t v)
-{
-    v = (v | (v << 16)) & 0x030000FF;
-    v = (v | (v << 8)) & 0x0300F00F;
-    v = (v | (v << 4)) & 0x030C30C3;
-    v = (v | (v << 2)) & 0x09249249;
-    return v;
+    // calculate u coordinate and test bounds
+    float baryU = mt_vec3_dot(orig_minus_vert0, cross_direction_edge2) * inv_det;
+    if (baryU < 0.0f || baryU > 1.0f)
+    {
+        return 0;
+    }
+
+    MT_Vec3 cross_originMinusVert0_edge1 = mt_vec3_cross(orig_minus_vert0, edge1);
+
+    float baryV = mt_vec3_dot(ray->direction, cross_originMinusVert0_edge1) * inv_det;
+    if (baryV < 0.0f || baryU + baryV > 1.0f)
+    {
+        return 0;
+    }
+
+    float t = mt_vec3_dot(edge2, cross_originMinusVert0_edge1) * inv_det;
+
+    if (t < 0.0f)
+    {
+        return 0;
+    }
+
+    *out_t = t;
+    *out_u = baryU;
+    *out_v = baryV;
+    *out_backface = (det < 0.0f);
+    return 1;
+}
+
+static inline int mt__ray_hit_tri_block(const MT_Ray *ray, const MT_TriBlock *block, uint32_t lane, float *out_t, float *out_u, float *out_v, int *out_backface)
+{
+    MT_Vec3 v0 = (MT_Vec3){block->v0[0][lane], block->v0[1][lane], block->v0[2][lane]};
+    MT_Vec3 e1 = (MT_Vec3){block->e1[0][lane], block->e1[1][lane], block->e1[2][lane]};
+    MT_Vec3 e2 = (MT_Vec3){block->e2[0][lane], block->e2[1][lane], block->e2[2][lane]};
+    return mt__ray_hit_tri_edges(ray, v0, e1, e2, out_t, out_u, out_v, out_backface);
+}
+
+// float threshold that rejects exactly the dets the double MT_EPSILON test above rejects
+static inline float mt__tri_det_epsilon(void)
+{
+    float epsilon = (float)MT_EPSILON;
+    return (epsilon < MT_EPSILON) ? nextafterf(epsilon, 1.0f) : epsilon;
+}
+
+// Möller–Trumbore against every lane of a block at once, returns a bit per lane hit in front of the ray before t_max
+// every lane takes the same float steps as mt__ray_hit_tri_edges, so both agree on which tris are hit and where
+// padding lanes are zero and always missed through their det
+static inline unsigned int mt__ray_hit_tri_block_wide(const MT_Ray *ray, const MT_TriBlock *block, float t_max, float *t_out, float *u_out, float *v_out, unsigned int *backface_out)
+{
+    unsigned int mask = 0;
+    unsigned int backface = 0;
+
+#if MT_TRI_BLOCK_WIDTH == 8 && defined(__AVX__)
+    __m256 o_x = _mm256_set1_ps(ray->origin.x);
+    __m256 o_y = _mm256_set1_ps(ray->origin.y);
+    __m256 o_z = _mm256_set1_ps(ray->origin.z);
+    __m256 d_x = _mm256_set1_ps(ray->direction.x);
+    __m256 d_y = _mm256_set1_ps(ray->direction.y);
+    __m256 d_z = _mm256_set1_ps(ray->direction.z);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+
+    __m256 e1_x = _mm256_loadu_ps(block->e1[0]);
+    __m256 e1_y = _mm256_loadu_ps(block->e1[1]);
+    __m256 e1_z = _mm256_loadu_ps(block->e1[2]);
+    __m256 e2_x = _mm256_loadu_ps(block->e2[0]);
+    __m256 e2_y = _mm256_loadu_ps(block->e2[1]);
+    __m256 e2_z = _mm256_loadu_ps(block->e2[2]);
+
+    // p = direction x edge2
+    __m256 p_x = _mm256_sub_ps(_mm256_mul_ps(d_y, e2_z), _mm256_mul_ps(d_z, e2_y));
+    __m256 p_y = _mm256_sub_ps(_mm256_mul_ps(d_z, e2_x), _mm256_mul_ps(d_x, e2_z));
+    __m256 p_z = _mm256_sub_ps(_mm256_mul_ps(d_x, e2_y), _mm256_mul_ps(d_y, e2_x));
+
+    __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1_x, p_x), _mm256_mul_ps(e1_y, p_y)), _mm256_mul_ps(e1_z, p_z));
+    __m256 inv_det = _mm256_div_ps(one, det);
+
+    // s = origin - v0
+    __m256 s_x = _mm256_sub_ps(o_x, _mm256_loadu_ps(block->v0[0]));
+    __m256 s_y = _mm256_sub_ps(o_y, _mm256_loadu_ps(block->v0[1]));
+    __m256 s_z = _mm256_sub_ps(o_z, _mm256_loadu_ps(block->v0[2]));
+
+    __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(s_x, p_x), _mm256_mul_ps(s_y, p_y)), _mm256_mul_ps(s_z, p_z)), inv_det);
+
+    // q = s x edge1
+    __m256 q_x = _mm256_sub_ps(_mm256_mul_ps(s_y, e1_z), _mm256_mul_ps(s_z, e1_y));
+    __m256 q_y = _mm256_sub_ps(_mm256_mul_ps(s_z, e1_x), _mm256_mul_ps(s_x, e1_z));
+    __m256 q_z = _mm256_sub_ps(_mm256_mul_ps(s_x, e1_y), _mm256_mul_ps(s_y, e1_x));
+
+    __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d_x, q_x), _mm256_mul_ps(d_y, q_y)), _mm256_mul_ps(d_z, q_z)), inv_det);
+    __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2_x, q_x), _mm256_mul_ps(e2_y, q_y)), _mm256_mul_ps(e2_z, q_z)), inv_det);
+
+    // misses are gathered with the same comparisons as the scalar early outs, so a nan u or v is let through there too
+    __m256 miss = _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), det), _mm256_set1_ps(mt__tri_det_epsilon()), _CMP_LT_OQ);
+    miss = _mm256_or_ps(miss, _mm256_cmp_ps(u, zero, _CMP_LT_OQ));
+    miss = _mm256_or_ps(miss, _mm256_cmp_ps(u, one, _CMP_GT_OQ));
+    miss = _mm256_or_ps(miss, _mm256_cmp_ps(v, zero, _CMP_LT_OQ));
+    miss = _mm256_or_ps(miss, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_GT_OQ));
+    miss = _mm256_or_ps(miss, _mm256_cmp_ps(t, zero, _CMP_LT_OQ));
+    __m256 hit = _mm256_andnot_ps(miss, _mm256_cmp_ps(t, _mm256_set1_ps(t_max), _CMP_LT_OQ));
+
+    _mm256_storeu_ps(t_out, t);
+    _mm256_storeu_ps(u_out, u);
+    _mm256_storeu_ps(v_out, v);
+    mask = (unsigned int)_mm256_movemask_ps(hit);
+    backface = (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(det, zero, _CMP_LT_OQ));
+#elif defined(__SSE__)
+    __m128 o_x = _mm_set1_ps(ray->origin.x);
+    __m128 o_y = _mm_set1_ps(ray->origin.y);
+    __m128 o_z = _mm_set1_ps(ray->origin.z);
+    __m128 d_x = _mm_set1_ps(ray->direction.x);
+    __m128 d_y = _mm_set1_ps(ray->direction.y);
+    __m128 d_z = _mm_set1_ps(ray->direction.z);
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 epsilon = _mm_set1_ps(mt__tri_det_epsilon());
+    __m128 closest = _mm_set1_ps(t_max);
+
+    for (int i = 0; i < MT_TRI_BLOCK_WIDTH; i += 4)
+    {
+        __m128 e1_x = _mm_loadu_ps(&block->e1[0][i]);
+        __m128 e1_y = _mm_loadu_ps(&block->e1[1][i]);
+        __m128 e1_z = _mm_loadu_ps(&block->e1[2][i]);
+        __m128 e2_x = _mm_loadu_ps(&block->e2[0][i]);
+        __m128 e2_y = _mm_loadu_ps(&block->e2[1][i]);
+        __m128 e2_z = _mm_loadu_ps(&block->e2[2][i]);
+
+        // p = direction x edge2
+        __m128 p_x = _mm_sub_ps(_mm_mul_ps(d_y, e2_z), _mm_mul_ps(d_z, e2_y));
+        __m128 p_y = _mm_sub_ps(_mm_mul_ps(d_z, e2_x), _mm_mul_ps(d_x, e2_z));
+        __m128 p_z = _mm_sub_ps(_mm_mul_ps(d_x, e2_y), _mm_mul_ps(d_y, e2_x));
+
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1_x, p_x), _mm_mul_ps(e1_y, p_y)), _mm_mul_ps(e1_z, p_z));
+        __m128 inv_det = _mm_div_ps(one, det);
+
+        // s = origin - v0
+        __m128 s_x = _mm_sub_ps(o_x, _mm_loadu_ps(&block->v0[0][i]));
+        __m128 s_y = _mm_sub_ps(o_y, _mm_loadu_ps(&block->v0[1][i]));
+        __m128 s_z = _mm_sub_ps(o_z, _mm_loadu_ps(&block->v0[2][i]));
+
+        __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(s_x, p_x), _mm_mul_ps(s_y, p_y)), _mm_mul_ps(s_z, p_z)), inv_det);
+
+        // q = s x edge1
+        __m128 q_x = _mm_sub_ps(_mm_mul_ps(s_y, e1_z), _mm_mul_ps(s_z, e1_y));
+        __m128 q_y = _mm_sub_ps(_mm_mul_ps(s_z, e1_x), _mm_mul_ps(s_x, e1_z));
+        __m128 q_z = _mm_sub_ps(_mm_mul_ps(s_x, e1_y), _mm_mul_ps(s_y, e1_x));
+
+        __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d_x, q_x), _mm_mul_ps(d_y, q_y)), _mm_mul_ps(d_z, q_z)), inv_det);
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2_x, q_x), _mm_mul_ps(e2_y, q_y)), _mm_mul_ps(e2_z, q_z)), inv_det);
+
+        // misses are gathered with the same comparisons as the scalar early outs, so a nan u or v is let through there too
+        __m128 miss = _mm_cmplt_ps(_mm_andnot_ps(sign, det), epsilon);
+        miss = _mm_or_ps(miss, _mm_cmplt_ps(u, zero));
+        miss = _mm_or_ps(miss, _mm_cmpgt_ps(u, one));
+        miss = _mm_or_ps(miss, _mm_cmplt_ps(v, zero));
+        miss = _mm_or_ps(miss, _mm_cmpgt_ps(_mm_add_ps(u, v), one));
+        miss = _mm_or_ps(miss, _mm_cmplt_ps(t, zero));
+        __m128 hit = _mm_andnot_ps(miss, _mm_cmplt_ps(t, closest));
+
+        _mm_storeu_ps(&t_out[i], t);
+        _mm_storeu_ps(&u_out[i], u);
+        _mm_storeu_ps(&v_out[i], v);
+        mask |= (unsigned int)_mm_movemask_ps(hit) << i;
+        backface |= (unsigned int)_mm_movemask_ps(_mm_cmplt_ps(det, zero)) << i;
+    }
+#else
+    for (uint32_t i = 0; i < MT_TRI_BLOCK_WIDTH; ++i)
+    {
+        int b_backface;
+        if (mt__ray_hit_tri_block(ray, block, i, &t_out[i], &u_out[i], &v_out[i], &b_backface) && t_out[i] < t_max)
+        {
+            mask |= 1u << i;
+            backface |= (unsigned int)b_backface << i;
+        }
+    }
+#endif
+
+    *backface_out = backface;
+    return mask;
+}
+
+// only finds the distance, the normal is worked out for the closest hit once every object is tested
+static int mt__ray_hit_sphere(const MT_Ray *ray, const MT_Sphere *sphere, float *out_t)
+{
+    MT_Vec3 oc = mt_vec3_sub(sphere->position, ray->origin);
+    float a = mt_vec3_length_squared(ray->direction);
+    float h = mt_vec3_dot(ray->direction, oc);
+    float c = mt_vec3_length_squared(oc) - sphere->radius * sphere->radius;
+    float discriminant = h * h - a * c;
+    if (discriminant < 0)
+    {
+        return 0;
+    }
+
+    float sqrt_disc = sqrtf(discriminant);
+    float t1 = (h - sqrt_disc) / a;
+    float t2 = (h + sqrt_disc) / a;
+
+    float t_hit = -1.0f;
+    if (t1 >= 0.0f)
+    {
+        t_hit = t1;
+    }
+    else if (t2 >= 0.0f)
+    {
+        t_hit = t2; // ray origin is inside sphere
+    }
+    else
+    {
+        return 0; // both behind ray
+    }
+
+    *out_t = t_hit;
+    return 1;
+}
+
+// mt__ray_hit_sphere against every lane of a block at once, returns a bit per lane hit in front of the ray before t_max
+// every lane takes the same float steps, so a cloud finds the same hits as the same spheres added one by one
+static inline unsigned int mt__ray_hit_sphere_block_wide(const MT_Ray *ray, const MT_SphereBlock *block, float t_max, float *t_out)
+{
+    unsigned int mask = 0;
+    float a = mt_vec3_length_squared(ray->direction);
+
+#if MT_TRI_BLOCK_WIDTH == 8 && defined(__AVX__)
+    __m256 d_x = _mm256_set1_ps(ray->direction.x);
+    __m256 d_y = _mm256_set1_ps(ray->direction.y);
+    __m256 d_z = _mm256_set1_ps(ray->direction.z);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 a_v = _mm256_set1_ps(a);
+
+    // oc = center - origin
+    __m256 oc_x = _mm256_sub_ps(_mm256_loadu_ps(block->center[0]), _mm256_set1_ps(ray->origin.x));
+    __m256 oc_y = _mm256_sub_ps(_mm256_loadu_ps(block->center[1]), _mm256_set1_ps(ray->origin.y));
+    __m256 oc_z = _mm256_sub_ps(_mm256_loadu_ps(block->center[2]), _mm256_set1_ps(ray->origin.z));
+    __m256 radius = _mm256_loadu_ps(block->radius);
+
+    __m256 h = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d_x, oc_x), _mm256_mul_ps(d_y, oc_y)), _mm256_mul_ps(d_z, oc_z));
+    __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(oc_x, oc_x), _mm256_mul_ps(oc_y, oc_y)), _mm256_mul_ps(oc_z, oc_z)), _mm256_mul_ps(radius, radius));
+    __m256 sqrt_disc = _mm256_sqrt_ps(_mm256_sub_ps(_mm256_mul_ps(h, h), _mm256_mul_ps(a_v, c)));
+    __m256 t1 = _mm256_div_ps(_mm256_sub_ps(h, sqrt_disc), a_v);
+    __m256 t2 = _mm256_div_ps(_mm256_add_ps(h, sqrt_disc), a_v);
+
+    // the far root only when the ray starts inside, a negative discriminant makes both nan and fails every compare like the scalar early out
+    __m256 t = _mm256_blendv_ps(t2, t1, _mm256_cmp_ps(t1, zero, _CMP_GE_OQ));
+    __m256 hit = _mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GE_OQ), _mm256_cmp_ps(t, _mm256_set1_ps(t_max), _CMP_LT_OQ));
+
+    _mm256_storeu_ps(t_out, t);
+    mask = (unsigned int)_mm256_movemask_ps(hit);
+#elif defined(__SSE__)
+    __m128 o_x = _mm_set1_ps(ray->origin.x);
+    __m128 o_y = _mm_set1_ps(ray->origin.y);
+    __m128 o_z = _mm_set1_ps(ray->origin.z);
+    __m128 d_x = _mm_set1_ps(ray->direction.x);
+    __m128 d_y = _mm_set1_ps(ray->direction.y);
+    __m128 d_z = _mm_set1_ps(ray->direction.z);
+    __m128 zero = _mm_setzero_ps();
+    __m128 a_v = _mm_set1_ps(a);
+    __m128 closest = _mm_set1_ps(t_max);
+
+    for (int i = 0; i < MT_TRI_BLOCK_WIDTH; i += 4)
+    {
+        // oc = center - origin
+        __m128 oc_x = _mm_sub_ps(_mm_loadu_ps(&block->center[0][i]), o_x);
+        __m128 oc_y = _mm_sub_ps(_mm_loadu_ps(&block->center[1][i]), o_y);
+        __m128 oc_z = _mm_sub_ps(_mm_loadu_ps(&block->center[2][i]), o_z);
+        __m128 radius = _mm_loadu_ps(&block->radius[i]);
+
+        __m128 h = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d_x, oc_x), _mm_mul_ps(d_y, oc_y)), _mm_mul_ps(d_z, oc_z));
+        __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(oc_x, oc_x), _mm_mul_ps(oc_y, oc_y)), _mm_mul_ps(oc_z, oc_z)), _mm_mul_ps(radius, radius));
+        __m128 sqrt_disc = _mm_sqrt_ps(_mm_sub_ps(_mm_mul_ps(h, h), _mm_mul_ps(a_v, c)));
+        __m128 t1 = _mm_div_ps(_mm_sub_ps(h, sqrt_disc), a_v);
+        __m128 t2 = _mm_div_ps(_mm_add_ps(h, sqrt_disc), a_v);
+
+        // the far root only when the ray starts inside, a negative discriminant makes both nan and fails every compare like the scalar early out
+        __m128 near = _mm_cmpge_ps(t1, zero);
+        __m128 t = _mm_or_ps(_mm_and_ps(near, t1), _mm_andnot_ps(near, t2));
+        __m128 hit = _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, closest));
+
+        _mm_storeu_ps(&t_out[i], t);
+        mask |= (unsigned int)_mm_movemask_ps(hit) << i;
+    }
+#else
+    (void)a;
+    for (uint32_t i = 0; i < MT_TRI_BLOCK_WIDTH; ++i)
+    {
+        MT_Sphere sphere = {{block->center[0][i], block->center[1][i], block->center[2][i]}, block->radius[i], NULL};
+        if (mt__ray_hit_sphere(ray, &sphere, &t_out[i]) && t_out[i] < t_max)
+        {
+            mask |= 1u << i;
+        }
+    }
+#endif
+
+    return mask;
+}
+
+// slab test in the box's own space, out_face is the axis times 2, plus 1 for its negative side
+// from inside the box the face it leaves through is hit from behind
+static int mt__ray_hit_box(const MT_Ray *ray, const MT_Box *box, float *out_t, uint32_t *out_face, int *out_backface)
+{
+    MT_Vec3 oc = mt_vec3_sub(ray->origin, box->position);
+    const float half_size[3] = {box->half_size.x, box->half_size.y, box->half_size.z};
+
+    float t_near = -FLT_MAX;
+    float t_far = FLT_MAX;
+    uint32_t near_face = 0;
+    uint32_t far_face = 0;
+
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        float o = mt_vec3_dot(oc, box->axes[i]);
+        float d = mt_vec3_dot(ray->direction, box->axes[i]);
+
+        // parallel to this slab, so either always inside it or never
+        if (d == 0.0f)
+        {
+            if (fabsf(o) > half_size[i])
+            {
+                return 0;
+            }
+            continue;
+        }
+
+        float inv_d = 1.0f / d;
+        float t_negative = (-half_size[i] - o) * inv_d;
+        float t_positive = (half_size[i] - o) * inv_d;
+
+        // a ray going along the axis enters through the negative face and leaves through the positive one
+        float t_enter = d > 0.0f ? t_negative : t_positive;
+        float t_exit = d > 0.0f ? t_positive : t_negative;
+
+        if (t_enter > t_near)
+        {
+            t_near = t_enter;
+            near_face = i * 2 + (d > 0.0f);
+        }
+        if (t_exit < t_far)
+        {
+            t_far = t_exit;
+            far_face = i * 2 + (d < 0.0f);
+        }
+    }
+
+    if (t_near > t_far || t_far < 0.0f)
+    {
+        return 0;
+    }
+
+    if (t_near >= 0.0f)
+    {
+        *out_t = t_near;
+        *out_face = near_face;
+        *out_backface = 0;
+    }
+    else
+    {
+        *out_t = t_far;
+        *out_face = far_face;
+        *out_backface = 1;
+    }
+    return 1;
+}
+
+// both sides are solid, out_backface is set when the ray comes from the side the normal points away from
+static int mt__ray_hit_plane(const MT_Ray *ray, const MT_Plane *plane, float *out_t, int *out_backface)
+{
+    float denom = mt_vec3_dot(ray->direction, plane->normal);
+    if (fabsf(denom) < MT_EPSILON)
+    {
+        return 0;
+    }
+
+    float t = mt_vec3_dot(mt_vec3_sub(plane->position, ray->origin), plane->normal) / denom;
+    if (t < 0.0f)
+    {
+        return 0;
+    }
+
+    *out_t = t;
+    *out_backface = denom > 0.0f;
+    return 1;
+}
+
+static void mt__ray_refract(MT_Ray *ray, MT_RayHit *hit, MT_Material *mat)
+{
+    float ior_air = 1.0f;
+    float ior_mat = mat->ior;
+    float n1, n2;
+
+    if (!hit->is_backface)
+    {
+        n1 = ior_air;
+        n2 = ior_mat;
+    }
+    else
+    {
+        n1 = ior_mat;
+        n2 = ior_air;
+    }
+
+    float eta = n1 / n2;
+    float cos_i = -mt_vec3_dot(hit->normal, ray->direction);    // incident cos
+    float cos_t_sq = 1.0f - eta * eta * (1.0f - cos_i * cos_i); // transmittance cos squared
+
+    // apply color
+    ray->throughput = mt_vec3_mult(ray->throughput, mat->color);
+
+    MT_Vec3 mat_emission = mt_vec3_mult_v(mat->emission, mat->emission_strength);
+    ray->accumulated_radiance = mt_vec3_add(ray->accumulated_radiance, mt_vec3_mult(ray->throughput, mat_emission));
+
+    if (cos_t_sq > 0.0f) // ray transmitted
+    {
+        float cos_t = sqrtf(cos_t_sq);
+
+        // snell's law
+        MT_Vec3 refracted = mt_vec3_add(
+            mt_vec3_mult_v(ray->direction, eta),
+            mt_vec3_mult_v(hit->normal, eta * cos_i - cos_t));
+
+        ray->direction = mt_vec3_normalize(refracted);
+        ray->origin = mt_vec3_add(hit->pos, mt_vec3_mult_v(ray->direction, MT_EPSILON * 10.0f));
+    }
+    else // internal reflection
+    {
+        MT_Vec3 n = hit->normal;
+        float d = mt_vec3_dot(ray->direction, n);
+        ray->direction = mt_vec3_sub(ray->direction, mt_vec3_mult_v(n, 2.0f * d));
+        ray->origin = mt_vec3_add(hit->pos, mt_vec3_mult_v(n, MT_EPSILON * 0.1f));
+    }
+}
+
+static void mt__ray_reflect(MT_Ray *ray, MT_RayHit *hit, MT_Material *mat)
+{
+    // apply color
+    ray->throughput = mt_vec3_mult(ray->throughput, mat->color);
+
+    MT_Vec3 mat_emission = mt_vec3_mult_v(mat->emission, mat->emission_strength);
+    ray->accumulated_radiance = mt_vec3_add(ray->accumulated_radiance, mt_vec3_mult(ray->throughput, mat_emission));
+
+    MT_Vec3 i_n = mt_vec3_normalize(ray->direction);
+    float d = mt_vec3_dot(i_n, hit->normal);
+    ray->origin = hit->pos;
+    ray->direction = mt_vec3_sub(i_n, mt_vec3_mult_v(hit->normal, 2.0f * d));
+
+    // scatter from roughness
+    ray->direction = mt_vec3_lerp(ray->direction, mt__random_hemi_normal_distribution(hit->normal), mat->roughness);
+    ray->direction = mt_vec3_normalize(ray->direction);
+
+    // fix self intersection
+    ray->origin = mt_vec3_add(hit->pos, mt_vec3_mult_v(hit->normal, MT_EPSILON * 10.0f));
+}
+
+static void mt__ray_bounce(MT_Ray *ray, MT_RayHit *hit, MT_Material *mat)
+{
+    if (mat->b_is_refractive)
+    {
+        // refractive bounce
+        mt__ray_refract(ray, hit, mat);
+    }
+    else
+    {
+        // reflective bounce
+        mt__ray_reflect(ray, hit, mat);
+    }
+}
+
+///////////////////////////////////////
+// ========== ENVIRONMENT ========== //
+///////////////////////////////////////
+MT_Environment *mt_environment_create()
+{
+    MT_Environment *environment = (MT_Environment *)malloc(sizeof(MT_Environment));
+    environment->zenith_color = (MT_Vec3){0.682f, 0.827f, 0.957f};
+    environment->horizon_color = (MT_Vec3){1.0f, 0.930f, 0.880f};
+    environment->brightness = 1.0f;
+    return environment;
+}
+
+static void mt__ray_hit_environment(MT_Environment *env, MT_Ray *ray)
+{
+    MT_Vec3 unit_direction = mt_vec3_negate(mt_vec3_normalize(ray->direction));
+    float t = 0.5f * (unit_direction.y + 1.0f);
+    MT_Vec3 color = mt_vec3_lerp(env->horizon_color, env->zenith_color, t);
+    color = mt_vec3_clamp(mt_vec3_mult_v(color, env->brightness), 0.0f, 1.0f);
+    ray->accumulated_radiance = mt_vec3_add(ray->accumulated_radiance, mt_vec3_mult(ray->throughput, color));
+}
+
+///////////////////////////////
+// ========== BVH ========== //
+///////////////////////////////
+typedef struct MT_Bounds
+{
+    MT_Vec3 start, end;
+} MT_Bounds;
+
+// per ray values shared by every box test of a traversal
+typedef struct MT_RaySlab
+{
+    MT_Vec3 origin;
+    MT_Vec3 inv_dir;
+    int sign[3]; // 1 where the direction is negative, picks which corner is the near plane
+} MT_RaySlab;
+
+// define MT_BVH_MORTON_63 for 21 bits per axis instead of 10, for scenes too dense for 30 bit codes
+#ifdef MT_BVH_MORTON_63
+typedef uint64_t MT_MortonCode;
+#define MT_BVH_MORTON_AXIS_BITS 21
+#define MT__MORTON_CLZ(v) __builtin_clzll(v)
+#else
+typedef uint32_t MT_MortonCode;
+#define MT_BVH_MORTON_AXIS_BITS 10
+#define MT__MORTON_CLZ(v) __builtin_clz(v)
+#endif
+
+typedef struct MT_BVHMorton
+{
+    MT_MortonCode morton_code;
+    int prim_index;
+} MT_BVHMorton;
+
+// nodes are stored depth first in one array, an interior node's left child is always the next node
+typedef struct MT_BVHNode
+{
+    MT_Bounds bounds;
+
+    uint32_t index;      // interior: right child node, leaf: first prim
+    uint32_t prim_count; // 0 for interior nodes
+} MT_BVHNode;
+
+// the binary tree collapsed into MT_BVH_WIDTH children per node, child bounds are stored SoA for simd slab tests
+typedef struct MT_BVHWideNode
+{
+    float min_x[MT_BVH_WIDTH], min_y[MT_BVH_WIDTH], min_z[MT_BVH_WIDTH];
+    float max_x[MT_BVH_WIDTH], max_y[MT_BVH_WIDTH], max_z[MT_BVH_WIDTH];
+
+    uint32_t child[MT_BVH_WIDTH];      // interior: wide node, leaf: first prim
+    uint32_t prim_count[MT_BVH_WIDTH]; // 0 for interior children
+    uint32_t child_count;
+} MT_BVHWideNode;
+
+// child bounds of the optional quantized wide bvh are stored in MT_BVH_QUANTIZE_BITS, 8 or 16, relative to the node's box
+#ifndef MT_BVH_QUANTIZE_BITS
+#define MT_BVH_QUANTIZE_BITS 8
+#endif
+
+#if MT_BVH_QUANTIZE_BITS == 16
+typedef uint16_t MT_BVHQuant;
+#else
+typedef uint8_t MT_BVHQuant;
+#endif
+#define MT_BVH_QUANTIZE_MAX ((1 << MT_BVH_QUANTIZE_BITS) - 1)
+
+// an MT_BVHWideNode with its child bounds on a grid, a lane's planes are origin + q * scale
+typedef struct MT_BVHQuantizedNode
+{
+    MT_Vec3 origin;
+    MT_Vec3 scale; // always a power of two
+
+    MT_BVHQuant min_x[MT_BVH_WIDTH], min_y[MT_BVH_WIDTH], min_z[MT_BVH_WIDTH];
+    MT_BVHQuant max_x[MT_BVH_WIDTH], max_y[MT_BVH_WIDTH], max_z[MT_BVH_WIDTH];
+
+    uint32_t child[MT_BVH_WIDTH];
+    uint32_t prim_count[MT_BVH_WIDTH];
+    uint32_t child_count;
+} MT_BVHQuantizedNode;
+
+// shared by the world (objects) and meshes (triangles), prims lists whichever was built in leaf order
+typedef struct MT_BVH
+{
+    MT_BVHNode *nodes;
+    uint32_t node_count;
+
+    MT_BVHWideNode *wide_nodes;           // NULL unless wide traversal is enabled
+    MT_BVHQuantizedNode *quantized_nodes; // replaces wide_nodes when quantized traversal is enabled
+    uint32_t wide_node_count;
+
+    uint32_t max_depth;
+    uint32_t wide_max_depth;
+    uint32_t stack_size; // stack entries a traversal of the active layout can need
+
+    uint32_t *prims; // NULL once the owner has reordered its primitives to match
+    uint32_t prim_count;
+
+    // refit data, a node's parent and where its bounds are mirrored in the wide layout
+    uint32_t *parents;
+    uint32_t *wide_slots; // wide node index * MT_BVH_WIDTH + lane, UINT32_MAX if the node is not a wide child
+    float padding;
+    double sah_sum;       // sah cost before dividing by the root area, kept up to date by refits
+    float build_sah_cost; // sah cost right after the build
+
+    float build_ms;
+    float treelet_ms;
+
+    int b_borrowed; // the arrays belong to someone else, e.g. a mapped snapshot, only the struct is freed
+} MT_BVH;
+
+typedef struct MT_BVHSettings
+{
+    MT_BVHBuilder builder;
+    int max_leaf_size;
+    int b_wide;
+    int b_quantized;
+    unsigned int thread_count;
+    float split_budget; // extra references the sbvh builder may make, as a fraction of the primitive count
+    int treelet_passes;
+} MT_BVHSettings;
+
+// triangles are often axis aligned and flat, pad them so the slab test can still hit them
+#define MT_BVH_OBJECT_PADDING 0.1f
+#define MT_BVH_TRI_PADDING 0.0001f
+
+// meshes and sphere clouds with fewer triangles or spheres than this are cheaper to test directly
+#define MT_BVH_MESH_MIN_TRIS 16
+#define MT_BVH_CLOUD_MIN_SPHERES 16
+
+// surface area heuristic
+#define MT_BVH_SAH_BINS 16
+#define MT_BVH_SAH_TRAVERSAL_COST 1.0f
+#define MT_BVH_SAH_INTERSECT_COST 1.0f
+
+// spatial splits are only tried where the object split's children overlap by this fraction of the root's area
+#define MT_BVH_SBVH_MIN_OVERLAP 0.00001f
+#define MT_BVH_SBVH_DEFAULT_BUDGET 0.3f
+
+// leaves per treelet when restructuring, each one is solved over all 2^n subsets of its leaves
+#define MT_BVH_TREELET_LEAVES 7
+
+// morton codes are radix sorted this many bits per pass, the pass count must be even for the sort to end in its input
+#define MT_BVH_RADIX_BITS 8
+#define MT_BVH_RADIX_BUCKETS (1 << MT_BVH_RADIX_BITS)
+
+// the morton builder hands out about this many independent subtrees per thread
+#define MT_BVH_SUBTREES_PER_THREAD 8
+
+// traversal stack entries kept on the thread's stack, deeper trees allocate theirs
+#define MT_BVH_STACK_SIZE 64
+
+// a refit tree is rebuilt once its sah cost grows past this multiple of its cost when built
+#define MT_BVH_REFIT_MAX_COST_GROWTH 1.5f
+
+////////////////////////////////
+// ========== GRID ========== //
+////////////////////////////////
+// a uniform grid over the world's objects, cells listing too many objects get a finer grid of their own
+typedef struct MT_Grid
+{
+    MT_Bounds bounds;
+    int res[3];
+    MT_Vec3 cell_size;
+    MT_Vec3 inv_cell_size;
+
+    uint32_t *cell_starts;     // a cell's objects are cell_objects[cell_starts[i]] up to cell_starts[i + 1]
+    uint32_t *cell_objects;    // object ids, an object is listed in every cell its bounds overlap
+    struct MT_Grid **subgrids; // NULL unless a cell was crowded, then one entry per cell, NULL for the others
+    uint32_t cell_count;
+
+    MT_Arena arena; // the top level grid's subgrids and their cells, freed with it in one go
+} MT_Grid;
+
+// cells per object the resolution heuristic aims for, the second level is finer since it only covers crowded cells
+#define MT_GRID_DENSITY 2.0f
+#define MT_GRID_SUBGRID_DENSITY 4.0f
+#define MT_GRID_MAX_RES 128
+
+// cells listing more objects than this get a second level grid
+#define MT_GRID_CROWDED_CELL 8
+
+// objects each ray remembers testing so ones spanning several cells are only tested once, must be a power of two
+#define MT_GRID_MAILBOX_SIZE 64
+
+/////////////////////////////////
+// ========== WORLD ========== //
+/////////////////////////////////
+typedef struct MT_World
+{
+    void **objects;
+    ObjectType *objects_track;
+    MT_BVH *bvh;
+    MT_BVHSettings bvh_settings;
+    MT_Grid *grid; // NULL until mt_world_recalculate_grid
+    int b_grid_dirty; // set once objects are added or moved after the grid was built, mt_render rebuilds it before using it
+
+    // expected nanoseconds per ray either way, estimated whenever the bvh is rebuilt
+    float brute_ray_cost;
+    float bvh_ray_cost;
+    int b_bvh_slower;
+
+    // cached per object bounds and the world bvh leaf holding each object, used by refits
+    MT_Bounds *object_bounds;
+    uint32_t *object_leaves;
+    unsigned int bvh_object_count; // objects the world bvh was built over, refits rebuild once more were added
+
+    // an sbvh can list an object in several leaves, object i's are leaf_refs[leaf_ref_starts[i]] up to leaf_ref_starts[i + 1]
+    // both NULL while every object is in one leaf, object_leaves is enough then
+    uint32_t *leaf_ref_starts;
+    uint32_t *leaf_refs;
+    unsigned char *objects_dirty;
+    unsigned int *dirty_objects;
+    unsigned int dirty_count;
+
+    // planes have no bounds to place them by, every ray tests them before traversing the bvh or grid
+    uint32_t *unbounded_objects;
+    unsigned int unbounded_count;
+
+    // meshes referenced by instances, owned by the world
+    MT_Mesh **shared_meshes;
+    uint32_t *shared_mesh_hashes;
+    unsigned int shared_mesh_index;
+    unsigned int max_shared_meshes;
+
+    MT_Environment *environment;
+
+    // objects the world created itself, freed together with the world instead of one by one
+    MT_Arena arena;
+    unsigned char *objects_in_arena; // set for the objects taken from the arena, so deleting the world never has to look them up
+    unsigned int arena_object_count;
+
+    // the file a snapshot loaded world was mapped from, its trees and materials live in it
+    void *snapshot;
+    size_t snapshot_size;
+
+    // a snapshot loaded world's material table, the tris of every mesh loaded with it index this one
+    MT_Material **materials;
+    uint32_t material_count;
+
+    unsigned int object_index;
+    unsigned int max_objects;
+} MT_World;
+
+MT_World *mt_world_create(unsigned int max_objects)
+{
+    MT_World *world = (MT_World *)malloc(sizeof(MT_World));
+    world->objects = (void **)malloc(sizeof(void *) * max_objects);
+    world->objects_track = (ObjectType *)malloc(sizeof(ObjectType) * max_objects);
+    world->bvh = NULL;
+    world->grid = NULL;
+    world->b_grid_dirty = 0;
+    world->brute_ray_cost = 0.0f;
+    world->bvh_ray_cost = 0.0f;
+    world->b_bvh_slower = 0;
+    world->bvh_settings = (MT_BVHSettings){MT_BVH_BUILDER_MORTON, 1, 0, 0, 1, MT_BVH_SBVH_DEFAULT_BUDGET, 0};
+    world->object_bounds = (MT_Bounds *)malloc(sizeof(MT_Bounds) * max_objects);
+    world->object_leaves = (uint32_t *)malloc(sizeof(uint32_t) * max_objects);
+    world->bvh_object_count = 0;
+    world->leaf_ref_starts = NULL;
+    world->leaf_refs = NULL;
+    world->objects_dirty = (unsigned char *)calloc(max_objects, sizeof(unsigned char));
+    world->dirty_objects = (unsigned int *)malloc(sizeof(unsigned int) * max_objects);
+    world->dirty_count = 0;
+    world->unbounded_objects = (uint32_t *)malloc(sizeof(uint32_t) * max_objects);
+    world->unbounded_count = 0;
+    world->shared_meshes = NULL;
+    world->shared_mesh_hashes = NULL;
+    world->shared_mesh_index = 0;
+    world->max_shared_meshes = 0;
+    world->environment = NULL;
+    mt__arena_init(&world->arena);
+    world->objects_in_arena = (unsigned char *)calloc(max_objects, sizeof(unsigned char));
+    world->arena_object_count = 0;
+    world->snapshot = NULL;
+    world->snapshot_size = 0;
+    world->materials = NULL;
+    world->material_count = 0;
+    world->object_index = 0;
+    world->max_objects = max_objects;
+    return world;
+}
+
+// returns the object's id, or -1 if the world is full
+int mt_world_add_object(MT_World *world, void *object, ObjectType object_type)
+{
+    if (world->object_index >= world->max_objects)
+    {
+        return -1;
+    }
+
+    world->objects[world->object_index] = object;
+    world->objects_track[world->object_index] = object_type;
+    world->b_grid_dirty = 1;
+    if (object_type == MT_OBJECT_PLANE)
+    {
+        world->unbounded_objects[world->unbounded_count++] = world->object_index;
+    }
+    return world->object_index++;
+}
+
+// call after moving or editing an object so the next mt_world_refit_bvh picks it up
+void mt_world_mark_object_dirty(MT_World *world, int object_id)
+{
+    if (object_id < 0 || object_id >= world->object_index)
+    {
+        return;
+    }
+
+    // the grid is rebuilt by then, but the object can still be waiting for its refit
+    world->b_grid_dirty = 1;
+    if (world->objects_dirty[object_id])
+    {
+        return;
+    }
+
+    world->objects_dirty[object_id] = 1;
+    world->dirty_objects[world->dirty_count++] = object_id;
+}
+
+// fnv-1a over the tri corners and materials, by position so welding the mesh does not change it
+static uint32_t mt__mesh_hash(const MT_Mesh *mesh)
+{
+    uint32_t hash = 2166136261u;
+
+    for (unsigned int i = 0; i < mesh->tri_index; ++i)
+    {
+        MT_Vec3 p[3];
+        mt__mesh_tri_corners(mesh, i, p);
+        MT_Material *mat = mt__mesh_tri_material(mesh, i);
+        const unsigned char *parts[2] = {(const unsigned char *)p, (const unsigned char *)&mat};
+        const size_t part_sizes[2] = {sizeof(p), sizeof(mat)};
+
+        for (int j = 0; j < 2; ++j)
+        {
+            for (size_t k = 0; k < part_sizes[j]; ++k)
+            {
+                hash = (hash ^ parts[j][k]) * 16777619u;
+            }
+        }
+    }
+
+    return hash;
+}
+
+static int mt__mesh_equal(const MT_Mesh *a, const MT_Mesh *b)
+{
+    // streamed meshes hold no tris to compare
+    if (a->stream || b->stream)
+    {
+        return a == b;
+    }
+
+    if (a->tri_index != b->tri_index)
+    {
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < a->tri_index; ++i)
+    {
+        MT_Vec3 p_a[3];
+        MT_Vec3 p_b[3];
+        mt__mesh_tri_corners(a, i, p_a);
+        mt__mesh_tri_corners(b, i, p_b);
+
+        if (mt__mesh_tri_material(a, i) != mt__mesh_tri_material(b, i) || memcmp(p_a, p_b, sizeof(p_a)) != 0)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// moves a mesh into the world so instances can reference it, deleting the world will delete it
+// if an identical mesh was already added the passed one is deleted and the existing one is returned instead
+MT_Mesh *mt_world_add_shared_mesh(MT_World *world, MT_Mesh *mesh)
+{
+    uint32_t hash = mt__mesh_hash(mesh);
+
+    for (unsigned int i = 0; i < world->shared_mesh_index; ++i)
+    {
+        if (world->shared_mesh_hashes[i] == hash && mt__mesh_equal(world->shared_meshes[i], mesh))
+        {
+            if (world->shared_meshes[i] != mesh)
+            {
+                mt__world_mesh_delete(mesh);
+            }
+            return world->shared_meshes[i];
+        }
+    }
+
+    if (world->shared_mesh_index >= world->max_shared_meshes)
+    {
+        world->max_shared_meshes = world->max_shared_meshes > 0 ? world->max_shared_meshes * 2 : 16;
+        world->shared_meshes = (MT_Mesh **)realloc(world->shared_meshes, sizeof(MT_Mesh *) * world->max_shared_meshes);
+        world->shared_mesh_hashes = (uint32_t *)realloc(world->shared_mesh_hashes, sizeof(uint32_t) * world->max_shared_meshes);
+    }
+
+    world->shared_meshes[world->shared_mesh_index] = mesh;
+    world->shared_mesh_hashes[world->shared_mesh_index] = hash;
+    ++world->shared_mesh_index;
+
+    return mesh;
+}
+
+// takes an object from the world's arena and adds it, returns NULL if the world is full
+static void *mt__world_create_object(MT_World *world, size_t size, ObjectType object_type)
+{
+    if (world->object_index >= world->max_objects)
+    {
+        return NULL;
+    }
+
+    void *object = mt__arena_alloc(&world->arena, size);
+    if (!object)
+    {
+        return NULL;
+    }
+
+    int id = mt_world_add_object(world, object, object_type);
+    world->objects_in_arena[id] = 1;
+    ++world->arena_object_count;
+    return object;
+}
+
+// creates a sphere in the world's arena and adds it, returns NULL if the world is full
+MT_Sphere *mt_world_create_sphere(MT_World *world, MT_Vec3 position, float radius, MT_Material *mat)
+{
+    MT_Sphere *sphere = (MT_Sphere *)mt__world_create_object(world, sizeof(MT_Sphere), MT_OBJECT_SPHERE);
+    if (sphere)
+    {
+        sphere->position = position;
+        sphere->radius = radius;
+        sphere->mat = mat;
+    }
+    return sphere;
+}
+
+// creates a box in the world's arena and adds it, returns NULL if the world is full
+MT_Box *mt_world_create_box(MT_World *world, MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale, MT_Material *mat)
+{
+    MT_Box *box = (MT_Box *)mt__world_create_object(world, sizeof(MT_Box), MT_OBJECT_BOX);
+    if (box)
+    {
+        mt__box_set(box, position, rotation, scale, mat);
+    }
+    return box;
+}
+
+// creates an instance in the world's arena and adds it, returns NULL if the world is full
+MT_Instance *mt_world_create_instance(MT_World *world, MT_Mesh *mesh, MT_Vec3 position, MT_Vec3 rotation, MT_Vec3 scale)
+{
+    MT_Instance *instance = (MT_Instance *)mt__world_create_object(world, sizeof(MT_Instance), MT_OBJECT_INSTANCE);
+    if (instance)
+    {
+        instance->mesh = mesh;
+        mt_instance_transform(instance, position, rotation, scale);
+    }
+    return instance;
+}
+
+// backs the arena chunks allocated from now on with huge pages where the system has them, fewer tlb misses on big scenes
+void mt_world_enable_huge_pages(MT_World *world, int b_enable)
+{
+    world->arena.b_huge_pages = b_enable;
+}
+
+void mt_world_set_environment(MT_World *world, MT_Environment *environment)
+{
+    world->environment = environment;
+}
+
+void mt_world_set_bvh_builder(MT_World *world, MT_BVHBuilder builder)
+{
+    world->bvh_settings.builder = builder;
+}
+
+void mt_world_set_bvh_leaf_size(MT_World *world, unsigned int max_leaf_size)
+{
+    world->bvh_settings.max_leaf_size = max_leaf_size > 0 ? max_leaf_size : 1;
+}
+
+void mt_world_enable_wide_bvh(MT_World *world, int b_enable)
+{
+    world->bvh_settings.b_wide = b_enable;
+}
+
+// wide nodes with their child bounds quantized, about half the memory for slightly looser bounds
+void mt_world_enable_quantized_bvh(MT_World *world, int b_enable)
+{
+    world->bvh_settings.b_quantized = b_enable;
+}
+
+// only used by the sbvh builder, 0.3 lets it make up to 30% more references than there are objects or tris
+void mt_world_set_bvh_split_budget(MT_World *world, float budget)
+{
+    world->bvh_settings.split_budget = budget > 0.0f ? budget : 0.0f;
+}
+
+// restructures small treelets of the built tree this many times, mostly worth it on morton built trees
+void mt_world_set_bvh_treelet_passes(MT_World *world, unsigned int passes)
+{
+    world->bvh_settings.treelet_passes = passes;
+}
+
+// threads used to build bvhs, set to the renderer's thread count by mt_renderer_set_world
+void mt_world_set_bvh_thread_count(MT_World *world, unsigned int thread_count)
+{
+    world->bvh_settings.thread_count = thread_count > 0 ? thread_count : 1;
+}
+
+static void mt__bvh_delete(MT_BVH *bvh)
+{
+    if (!bvh)
+    {
+        return;
+    }
+
+    if (bvh->b_borrowed)
+    {
+        free(bvh);
+        return;
+    }
+
+    free(bvh->nodes);
+    free(bvh->parents);
+
+    if (bvh->wide_slots)
+    {
+        free(bvh->wide_nodes);
+        free(bvh->quantized_nodes);
+        free(bvh->wide_slots);
+    }
+
+    if (bvh->prims)
+    {
+        free(bvh->prims);
+    }
+
+    free(bvh);
+}
+
+static void mt__grid_delete(MT_Grid *grid)
+{
+    if (!grid)
+    {
+        return;
+    }
+
+    free(grid->subgrids);
+    free(grid->cell_starts);
+    free(grid->cell_objects);
+    mt__arena_delete(&grid->arena);
+    free(grid);
+}
+
+static void mt__stream_delete(struct MT_MeshStream *stream);
+
+static void mt__world_mesh_delete(MT_Mesh *mesh)
+{
+    if (!mesh)
+    {
+        return;
+    }
+
+    if (!mesh->b_borrowed)
+    {
+        free(mesh->vertices);
+        free(mesh->indices);
+        free(mesh->normals);
+        free(mesh->tri_materials);
+        free(mesh->materials);
+    }
+    mt__aligned_free(mesh->tri_blocks);
+
+    mt__bvh_delete(mesh->bvh);
+    mt__stream_delete(mesh->stream);
+
+    free(mesh);
+}
+
+static void mt__world_sphere_delete(MT_Sphere *sphere)
+{
+    if (sphere)
+    {
+        free(sphere);
+    }
+}
+
+static void mt__world_sphere_cloud_delete(MT_SphereCloud *cloud)
+{
+    if (!cloud)
+    {
+        return;
+    }
+
+    if (!cloud->b_borrowed)
+    {
+        mt__aligned_free(cloud->blocks);
+        free(cloud->sphere_materials);
+        free(cloud->materials);
+    }
+
+    mt__bvh_delete(cloud->bvh);
+
+    free(cloud);
+}
+
+// the referenced mesh is left alone, it belongs to the world's shared meshes or to the caller
+static void mt__world_instance_delete(MT_Instance *instance)
+{
+    if (instance)
+    {
+        free(instance);
+    }
+}
+
+void mt__environment_delete(MT_Environment *environment)
+{
+    if (environment)
+    {
+        free(environment);
+    }
+}
+
+void mt_world_delete(MT_World *world)
+{
+    if (!world)
+    {
+        return;
+    }
+
+    // objects in the arena go with its chunks below, a world made only of them is not walked at all
+    if (world->objects && world->arena_object_count < world->object_index)
+    {
+        for (unsigned int i = 0; i < world->object_index; ++i)
+        {
+            if (!world->objects[i] || world->objects_in_arena[i])
+            {
+                continue;
+            }
+
+            switch (world->objects_track[i])
+            {
+            case MT_OBJECT_MESH:
+                mt__world_mesh_delete(world->objects[i]);
+                break;
+            case MT_OBJECT_SPHERE:
+                mt__world_sphere_delete(world->objects[i]);
+                break;
+            case MT_OBJECT_INSTANCE:
+                mt__world_instance_delete(world->objects[i]);
+                break;
+            case MT_OBJECT_BOX:
+            case MT_OBJECT_PLANE:
+                free(world->objects[i]);
+                break;
+            case MT_OBJECT_SPHERE_CLOUD:
+                mt__world_sphere_cloud_delete(world->objects[i]);
+                break;
+            }
+        }
+    }
+
+    free(world->objects);
+
+    if (world->objects_track)
+    {
+        free(world->objects_track);
+    }
+    free(world->objects_in_arena);
+
+    free(world->object_bounds);
+    free(world->object_leaves);
+    free(world->leaf_ref_starts);
+    free(world->leaf_refs);
+    free(world->objects_dirty);
+    free(world->dirty_objects);
+    free(world->unbounded_objects);
+
+    if (world->shared_meshes)
+    {
+        for (unsigned int i = 0; i < world->shared_mesh_index; ++i)
+        {
+            mt__world_mesh_delete(world->shared_meshes[i]);
+        }
+        free(world->shared_meshes);
+        free(world->shared_mesh_hashes);
+    }
+
+    mt__environment_delete(world->environment);
+
+    mt__bvh_delete(world->bvh);
+    mt__grid_delete(world->grid);
+
+    free(world->materials);
+    mt__file_unmap(world->snapshot, world->snapshot_size);
+    mt__arena_delete(&world->arena);
+
+    free(world);
+}
+
+/////////////////////////////////////////
+// ========== BVH FUNCTIONS ========== //
+/////////////////////////////////////////
+static MT_Bounds mt__bounds_create_invalid()
+{
+    MT_Bounds bounds;
+    bounds.start = (MT_Vec3){FLT_MAX, FLT_MAX, FLT_MAX};
+    bounds.end = (MT_Vec3){-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    return bounds;
+}
+
+// branchless slab collision
+// source: https://tavianator.com/2022/ray_box_boundary.html
+static int mt__point_in_bounds(MT_Vec3 p, MT_Bounds bounds)
+{
+    int x = p.x >= bounds.start.x && p.x <= bounds.end.x;
+    int y = p.y >= bounds.start.y && p.y <= bounds.end.y;
+    int z = p.z >= bounds.start.z && p.z <= bounds.end.z;
+
+    return x && y && z;
+}
+
+static MT_RaySlab mt__ray_slab_create(const MT_Ray *ray)
+{
+    MT_RaySlab slab;
+    slab.origin = ray->origin;
+    slab.inv_dir = (MT_Vec3){1.0f / ray->direction.x, 1.0f / ray->direction.y, 1.0f / ray->direction.z};
+    slab.sign[0] = slab.inv_dir.x < 0.0f;
+    slab.sign[1] = slab.inv_dir.y < 0.0f;
+    slab.sign[2] = slab.inv_dir.z < 0.0f;
+    return slab;
+}
+
+// returns the distance the ray enters the bounds at, INFINITY if it misses them or only enters past t_max
+static inline float mt__ray_hit_bounds(const MT_RaySlab *slab, const MT_Bounds *bounds, float t_max)
+{
+    MT_Vec3 near = (MT_Vec3){slab->sign[0] ? bounds->end.x : bounds->start.x,
+                             slab->sign[1] ? bounds->end.y : bounds->start.y,
+                             slab->sign[2] ? bounds->end.z : bounds->start.z};
+    MT_Vec3 far = (MT_Vec3){slab->sign[0] ? bounds->start.x : bounds->end.x,
+                            slab->sign[1] ? bounds->start.y : bounds->end.y,
+                            slab->sign[2] ? bounds->start.z : bounds->end.z};
+
+    float tmin = fmaxf((near.x - slab->origin.x) * slab->inv_dir.x, 0.0f);
+    tmin = fmaxf((near.y - slab->origin.y) * slab->inv_dir.y, tmin);
+    tmin = fmaxf((near.z - slab->origin.z) * slab->inv_dir.z, tmin);
+
+    float tmax = fminf((far.x - slab->origin.x) * slab->inv_dir.x, t_max);
+    tmax = fminf((far.y - slab->origin.y) * slab->inv_dir.y, tmax);
+    tmax = fminf((far.z - slab->origin.z) * slab->inv_dir.z, tmax);
+
+    return tmin <= tmax ? tmin : INFINITY;
+}
+
+static float mt__bounds_area(MT_Bounds bounds)
+{
+    MT_Vec3 size = mt_vec3_sub(bounds.end, bounds.start);
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static MT_Vec3 mt__bounds_center(MT_Bounds bounds)
+{
+    return mt_vec3_mult_v(mt_vec3_add(bounds.start, bounds.end), 0.5f);
+}
+
+static MT_Bounds mt__bounds_union(MT_Bounds a, MT_Bounds b)
+{
+    MT_Bounds out;
+    out.start.x = fminf(a.start.x, b.start.x);
+    out.start.y = fminf(a.start.y, b.start.y);
+    out.start.z = fminf(a.start.z, b.start.z);
+    out.end.x = fmaxf(a.end.x, b.end.x);
+    out.end.y = fmaxf(a.end.y, b.end.y);
+    out.end.z = fmaxf(a.end.z, b.end.z);
+    return out;
+}
+
+static void mt__bounds_shift_point(MT_Vec3 p, MT_Bounds *out)
+{
+    out->start.x = fminf(out->start.x, p.x);
+    out->start.y = fminf(out->start.y, p.y);
+    out->start.z = fminf(out->start.z, p.z);
+
+    out->end.x = fmaxf(out->end.x, p.x);
+    out->end.y = fmaxf(out->end.y, p.y);
+    out->end.z = fmaxf(out->end.z, p.z);
+}
+
+static void mt__bounds_shift_mesh_tri(const MT_Mesh *mesh, uint32_t tri, MT_Bounds *out)
+{
+    const uint32_t *index = &mesh->indices[tri * 3];
+    mt__bounds_shift_point(mesh->vertices[index[0]], out);
+    mt__bounds_shift_point(mesh->vertices[index[1]], out);
+    mt__bounds_shift_point(mesh->vertices[index[2]], out);
+}
+
+// every vertex belongs to a tri, so the vertices alone bound the mesh
+static void mt__bounds_shift_mesh(MT_Mesh *mesh, MT_Bounds *out)
+{
+    for (uint32_t i = 0; i < mesh->vertex_index; ++i)
+    {
+        mt__bounds_shift_point(mesh->vertices[i], out);
+    }
+}
+
+static MT_Bounds mt__bounds_calculate_mesh(MT_Mesh *mesh)
+{
+    MT_Bounds out = mt__bounds_create_invalid();
+    mt__bounds_shift_mesh(mesh, &out);
+    return out;
+}
+
+// world space bounds of the instance's transformed object space bounds
+static MT_Bounds mt__bounds_calculate_instance(MT_Instance *instance)
+{
+    MT_Mesh *mesh = instance->mesh;
+    MT_Bounds local = mesh->bvh ? mesh->bvh->nodes[0].bounds : mt__bounds_calculate_mesh(mesh);
+
+    MT_Bounds out = mt__bounds_create_invalid();
+    for (int i = 0; i < 8; ++i)
+    {
+        MT_Vec3 corner = (MT_Vec3){
+            (i & 1) ? local.end.x : local.start.x,
+            (i & 2) ? local.end.y : local.start.y,
+            (i & 4) ? local.end.z : local.start.z};
+        corner = mt_mat4x4_mult_vec3(instance->object_to_world, corner);
+
+        out.start.x = fminf(out.start.x, corner.x);
+        out.start.y = fminf(out.start.y, corner.y);
+        out.start.z = fminf(out.start.z, corner.z);
+
+        out.end.x = fmaxf(out.end.x, corner.x);
+        out.end.y = fmaxf(out.end.y, corner.y);
+        out.end.z = fmaxf(out.end.z, corner.z);
+    }
+
+    return out;
+}
+
+static void mt__bounds_shift_sphere(MT_Sphere *sphere, MT_Bounds *out)
+{
+    float r = sphere->radius;
+    MT_Vec3 p = sphere->position;
+
+    MT_Vec3 s_min = (MT_Vec3){p.x - r, p.y - r, p.z - r};
+    MT_Vec3 s_max = (MT_Vec3){p.x + r, p.y + r, p.z + r};
+
+    out->start.x = fminf(out->start.x, s_min.x);
+    out->start.y = fminf(out->start.y, s_min.y);
+    out->start.z = fminf(out->start.z, s_min.z);
+
+    out->end.x = fmaxf(out->end.x, s_max.x);
+    out->end.y = fmaxf(out->end.y, s_max.y);
+    out->end.z = fmaxf(out->end.z, s_max.z);
+}
+
+static MT_Bounds mt__bounds_calculate_sphere(MT_Sphere *sphere)
+{
+    MT_Bounds out = mt__bounds_create_invalid();
+    mt__bounds_shift_sphere(sphere, &out);
+    return out;
+}
+
+// exact, each axis reaches as far as the box's three half extents projected onto it
+static MT_Bounds mt__bounds_calculate_box(MT_Box *box)
+{
+    MT_Vec3 extent;
+    extent.x = fabsf(box->axes[0].x) * box->half_size.x + fabsf(box->axes[1].x) * box->half_size.y + fabsf(box->axes[2].x) * box->half_size.z;
+    extent.y = fabsf(box->axes[0].y) * box->half_size.x + fabsf(box->axes[1].y) * box->half_size.y + fabsf(box->axes[2].y) * box->half_size.z;
+    extent.z = fabsf(box->axes[0].z) * box->half_size.x + fabsf(box->axes[1].z) * box->half_size.y + fabsf(box->axes[2].z) * box->half_size.z;
+
+    MT_Bounds out;
+    out.start = mt_vec3_sub(box->position, extent);
+    out.end = mt_vec3_add(box->position, extent);
+    return out;
+}
+
+static void mt__bounds_shift_cloud_sphere(const MT_SphereCloud *cloud, uint32_t index, MT_Bounds *out)
+{
+    MT_Sphere sphere = {mt__sphere_cloud_center(cloud, index), mt__sphere_cloud_radius(cloud, index), NULL};
+    mt__bounds_shift_sphere(&sphere, out);
+}
+
+static MT_Bounds mt__bounds_calculate_sphere_cloud(const MT_SphereCloud *cloud)
+{
+    MT_Bounds out = mt__bounds_create_invalid();
+    for (uint32_t i = 0; i < cloud->sphere_index; ++i)
+    {
+        mt__bounds_shift_cloud_sphere(cloud, i, &out);
+    }
+    return out;
+}
+
+// morton numbers
+// source: https://stackoverflow.com/a/1024889
+#ifdef MT_BVH_MORTON_63
+static uint64_t mt__expand_bits(uint64_t v)
+{
+    v = (v | (v << 32)) & 0x001F00000000FFFFull;
+    v = (v | (v << 16)) & 0x001F0000FF0000FFull;
+    v = (v | (v << 8)) & 0x100F00F00F00F00Full;
+    v = (v | (v << 4)) & 0x10C30C30C30C30C3ull;
+    v = (v | (v << 2)) & 0x1249249249249249ull;
+    return v;
+}
+#else
+static uint32_t mt__expand_bits(uint32_t v)
+{
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+#endif
+
+static MT_MortonCode mt__morton_code(MT_MortonCode x, MT_MortonCode y, MT_MortonCode z)
+{
+    MT_MortonCode e_x = mt__expand_bits(x);
+    MT_MortonCode e_y = mt__expand_bits(y);
+    MT_MortonCode e_z = mt__expand_bits(z);
+    return e_x | (e_y << 1) | (e_z << 2);
+}
+//
+
+static int mt__morton_find_split(MT_BVHMorton *mortons, int start, int end)
+{
+    if (start == end)
+    {
+        return start;
+    }
+
+    MT_MortonCode first_code = mortons[start].morton_code;
+    MT_MortonCode last_code = mortons[end].morton_code;
+
+    if (first_code == last_code)
+    {
+        return (start + end) / 2;
+    }
+
+    int common_prefix = MT__MORTON_CLZ(first_code ^ last_code);
+    int split = start;
+    int step = end - start;
+
+    do
+    {
+        step = (step + 1) >> 1;
+        int new_split = split + step;
+
+        if (new_split < end)
+        {
+            MT_MortonCode split_code = mortons[new_split].morton_code;
+            if (MT__MORTON_CLZ(first_code ^ split_code) > common_prefix)
+            {
+                split = new_split;
+            }
+        }
+    } while (step > 1);
+
+    return split;
+}
+
+static uint32_t mt__bvh_node_create(MT_BVH *bvh, const MT_Bounds *prim_bounds, MT_BVHMorton *mortons, int start, int end, const MT_BVHSettings *settings, float padding)
+{
+    uint32_t node_index = bvh->node_count++;
+    MT_BVHNode *node = &bvh->nodes[node_index];
+
+    // determine if it will be a leaf node
+    if (end - start + 1 <= settings->max_leaf_size)
+    {
+        MT_Bounds bounds = mt__bounds_create_invalid();
+        for (int i = start; i <= end; ++i)
+        {
+            bounds = mt__bounds_union(bounds, prim_bounds[mortons[i].prim_index]);
+        }
+
+        bounds.start = mt_vec3_sub_v(bounds.start, padding);
+        bounds.end = mt_vec3_add_v(bounds.end, padding);
+
+        node->bounds = bounds;
+        node->index = start;
+        node->prim_count = end - start + 1;
+    }
+    else
+    {
+        int split_pos = mt__morton_find_split(mortons, start, end);
+
+        mt__bvh_node_create(bvh, prim_bounds, mortons, start, split_pos, settings, padding);
+        node->index = mt__bvh_node_create(bvh, prim_bounds, mortons, split_pos + 1, end, settings, padding);
+        node->bounds = mt__bounds_union(bvh->nodes[node_index + 1].bounds, bvh->nodes[node->index].bounds);
+        node->prim_count = 0;
+    }
+
+    return node_index;
+}
+
+// sorts primitives along a morton curve by their position and builds a tree over them
+typedef struct MT_BVHRadixJob
+{
+    MT_BVHMorton *src;
+    MT_BVHMorton *dst;
+    uint32_t *histograms; // MT_BVH_RADIX_BUCKETS per thread, turned into write offsets before scattering
+    int shift;
+} MT_BVHRadixJob;
+
+static void mt__bvh_radix_count(void *data, unsigned int start, unsigned int end, unsigned int thread_index)
+{
+    MT_BVHRadixJob *job = (MT_BVHRadixJob *)data;
+    uint32_t *histogram = &job->histograms[thread_index * MT_BVH_RADIX_BUCKETS];
+
+    memset(histogram, 0, sizeof(uint32_t) * MT_BVH_RADIX_BUCKETS);
+    for (unsigned int i = start; i < end; ++i)
+    {
+        ++histogram[(job->src[i].morton_code >> job->shift) & (MT_BVH_RADIX_BUCKETS - 1)];
+    }
+}
+
+static void mt__bvh_radix_scatter(void *data, unsigned int start, unsigned int end, unsigned int thread_index)
+{
+    MT_BVHRadixJob *job = (MT_BVHRadixJob *)data;
+    uint32_t *offsets = &job->histograms[thread_index * MT_BVH_RADIX_BUCKETS];
+
+    for (unsigned int i = start; i < end; ++i)
+    {
+        job->dst[offsets[(job->src[i].morton_code >> job->shift) & (MT_BVH_RADIX_BUCKETS - 1)]++] = job->src[i];
+    }
+}
+
+// lsd radix sort, each pass is stable so equal codes keep their input order
+static void mt__bvh_radix_sort(MT_BVHMorton *mortons, int count, unsigned int thread_count)
+{
+    MT_BVHRadixJob job;
+    job.src = mortons;
+    job.dst = (MT_BVHMorton *)malloc(sizeof(MT_BVHMorton) * count);
+    job.histograms = (uint32_t *)malloc(sizeof(uint32_t) * MT_BVH_RADIX_BUCKETS * thread_count);
+
+    for (job.shift = 0; job.shift < (int)sizeof(MT_MortonCode) * 8; job.shift += MT_BVH_RADIX_BITS)
+    {
+        mt__parallel_for(thread_count, count, mt__bvh_radix_count, &job);
+
+        // bucket major prefix sum, each thread writes its run of a bucket right after the previous thread's run
+        uint32_t sum = 0;
+        for (int bucket = 0; bucket < MT_BVH_RADIX_BUCKETS; ++bucket)
+        {
+            for (unsigned int t = 0; t < thread_count; ++t)
+            {
+                uint32_t bucket_count = job.histograms[t * MT_BVH_RADIX_BUCKETS + bucket];
+                job.histograms[t * MT_BVH_RADIX_BUCKETS + bucket] = sum;
+                sum += bucket_count;
+            }
+        }
+
+        mt__parallel_for(thread_count, count, mt__bvh_radix_scatter, &job);
+
+        MT_BVHMorton *temp = job.src;
+        job.src = job.dst;
+        job.dst = temp;
+    }
+
+    free(job.dst);
+    free(job.histograms);
+}
+
+typedef struct MT_BVHMortonJob
+{
+    const MT_Bounds *prim_bounds;
+    const MT_Vec3 *prim_positions;
+    MT_BVHMorton *mortons;
+
+    MT_Bounds *thread_bounds;
+    MT_Bounds bounds;
+    MT_Vec3 bound_size;
+} MT_BVHMortonJob;
+
+static void mt__bvh_morton_bounds_range(void *data, unsigned int start, unsigned int end, unsigned int thread_index)
+{
+    MT_BVHMortonJob *job = (MT_BVHMortonJob *)data;
+
+    MT_Bounds bounds = mt__bounds_create_invalid();
+    for (unsigned int i = start; i < end; ++i)
+    {
+        bounds = mt__bounds_union(bounds, job->prim_bounds[i]);
+    }
+    job->thread_bounds[thread_index] = bounds;
+}
+
+static void mt__bvh_morton_code_range(void *data, unsigned int start, unsigned int end, unsigned int thread_index)
+{
+    MT_BVHMortonJob *job = (MT_BVHMortonJob *)data;
+
+    // needs to be 2^bits - 1 for the codes to use every bit
+    const float scale = (float)((1u << MT_BVH_MORTON_AXIS_BITS) - 1);
+
+    for (unsigned int i = start; i < end; ++i)
+    {
+        MT_Vec3 pos = job->prim_positions[i];
+
+        MT_MortonCode x_rel = (MT_MortonCode)fminf(scale, fmaxf(0, floorf((pos.x - job->bounds.start.x) / job->bound_size.x * scale)));
+        MT_MortonCode y_rel = (MT_MortonCode)fminf(scale, fmaxf(0, floorf((pos.y - job->bounds.start.y) / job->bound_size.y * scale)));
+        MT_MortonCode z_rel = (MT_MortonCode)fminf(scale, fmaxf(0, floorf((pos.z - job->bounds.start.z) / job->bound_size.z * scale)));
+
+        job->mortons[i].morton_code = mt__morton_code(x_rel, y_rel, z_rel);
+        job->mortons[i].prim_index = i;
+    }
+}
+
+// a range of sorted codes built into its own node array by one thread
+typedef struct MT_BVHSubtree
+{
+    int start;
+    int end;
+    MT_BVH bvh; // only nodes and node_count are used
+} MT_BVHSubtree;
+
+typedef struct MT_BVHSubtreeJob
+{
+    MT_BVHSubtree *subtrees;
+    const MT_Bounds *prim_bounds;
+    MT_BVHMorton *mortons;
+    const MT_BVHSettings *settings;
+    float padding;
+} MT_BVHSubtreeJob;
+
+static inline int mt__bvh_is_subtree(int start, int end, int subtree_size, const MT_BVHSettings *settings)
+{
+    int count = end - start + 1;
+    return count <= subtree_size || count <= settings->max_leaf_size;
+}
+
+// splits the sorted codes the same way mt__bvh_node_create would, stopping at subtree sized ranges
+static void mt__bvh_subtrees_find(MT_BVHMorton *mortons, int start, int end, int subtree_size, const MT_BVHSettings *settings, MT_BVHSubtree *subtrees, int *subtree_count)
+{
+    if (mt__bvh_is_subtree(start, end, subtree_size, settings))
+    {
+        subtrees[*subtree_count].start = start;
+        subtrees[*subtree_count].end = end;
+        ++*subtree_count;
+        return;
+    }
+
+    int split_pos = mt__morton_find_split(mortons, start, end);
+    mt__bvh_subtrees_find(mortons, start, split_pos, subtree_size, settings, subtrees, subtree_count);
+    mt__bvh_subtrees_find(mortons, split_pos + 1, end, subtree_size, settings, subtrees, subtree_count);
+}
+
+static void mt__bvh_subtrees_build_range(void *data, unsigned int start, unsigned int end, unsigned int thread_index)
+{
+    MT_BVHSubtreeJob *job = (MT_BVHSubtreeJob *)data;
+
+    for (unsigned int i = start; i < end; ++i)
+    {
+        MT_BVHSubtree *subtree = &job->subtrees[i];
+        int count = subtree->end - subtree->start + 1;
+
+        subtree->bvh.nodes = (MT_BVHNode *)malloc(sizeof(MT_BVHNode) * (2 * count - 1));
+        subtree->bvh.node_count = 0;
+        mt__bvh_node_create(&subtree->bvh, job->prim_bounds, job->mortons, subtree->start, subtree->end, job->settings, job->padding);
+    }
+}
+
+// emits the nodes above the subtrees in depth first order and copies each built subtree in where it belongs
+static uint32_t mt__bvh_subtrees_emit(MT_BVH *bvh, MT_BVHMorton *mortons, int start, int end, int subtree_size, const MT_BVHSettings *settings, MT_BVHSubtree *subtrees, int *subtree_index)
+{
+    uint32_t node_index = bvh->node_count;
+
+    if (mt__bvh_is_subtree(start, end, subtree_size, settings))
+    {
+        MT_BVHSubtree *subtree = &subtrees[(*subtree_index)++];
+
+        memcpy(&bvh->nodes[node_index], subtree->bvh.nodes, sizeof(MT_BVHNode) * subtree->bvh.node_count);
+        for (uint32_t i = node_index; i < node_index + subtree->bvh.node_count; ++i)
+        {
+            if (bvh->nodes[i].prim_count == 0)
+            {
+                bvh->nodes[i].index += node_index;
+            }
+        }
+        bvh->node_count += subtree->bvh.node_count;
+
+        free(subtree->bvh.nodes);
+        return node_index;
+    }
+
+    ++bvh->node_count;
+
+    int split_pos = mt__morton_find_split(mortons, start, end);
+    mt__bvh_subtrees_emit(bvh, mortons, start, split_pos, subtree_size, settings, subtrees, subtree_index);
+    uint32_t right_index = mt__bvh_subtrees_emit(bvh, mortons, split_pos + 1, end, subtree_size, settings, subtrees, subtree_index);
+
+    MT_BVHNode *node = &bvh->nodes[node_index];
+    node->index = right_index;
+    node->bounds = mt__bounds_union(bvh->nodes[node_index + 1].bounds, bvh->nodes[right_index].bounds);
+    node->prim_count = 0;
+
+    return node_index;
+}
+
+static void mt__bvh_build_morton(MT_BVH *bvh, const MT_BVHSettings *settings, const MT_Bounds *prim_bounds, const MT_Vec3 *prim_positions, int prim_count, float padding)
+{
+    unsigned int thread_count = mt__parallel_thread_count(settings->thread_count, prim_count);
+
+    MT_BVHMortonJob job;
+    job.prim_bounds = prim_bounds;
+    job.prim_positions = prim_positions;
+    job.mortons = (MT_BVHMorton *)malloc(sizeof(MT_BVHMorton) * prim_count);
+    job.thread_bounds = (MT_Bounds *)malloc(sizeof(MT_Bounds) * thread_count);
+
+    mt__parallel_for(thread_count, prim_count, mt__bvh_morton_bounds_range, &job);
+
+    job.bounds = mt__bounds_create_invalid();
+    for (unsigned int i = 0; i < thread_count; ++i)
+    {
+        job.bounds = mt__bounds_union(job.bounds, job.thread_bounds[i]);
+    }
+
+    job.bound_size.x = fmaxf(job.bounds.end.x - job.bounds.start.x, MT_EPSILON);
+    job.bound_size.y = fmaxf(job.bounds.end.y - job.bounds.start.y, MT_EPSILON);
+    job.bound_size.z = fmaxf(job.bounds.end.z - job.bounds.start.z, MT_EPSILON);
+
+    mt__parallel_for(thread_count, prim_count, mt__bvh_morton_code_range, &job);
+    mt__bvh_radix_sort(job.mortons, prim_count, thread_count);
+
+    MT_BVHMorton *mortons = job.mortons;
+
+    if (thread_count > 1)
+    {
+        int subtree_size = prim_count / (thread_count * MT_BVH_SUBTREES_PER_THREAD);
+
+        // a subtree is made for every range at or below subtree_size, there can't be more of them than prims
+        int subtree_count = 0;
+        MT_BVHSubtree *subtrees = (MT_BVHSubtree *)malloc(sizeof(MT_BVHSubtree) * prim_count);
+        mt__bvh_subtrees_find(mortons, 0, prim_count - 1, subtree_size, settings, subtrees, &subtree_count);
+
+        MT_BVHSubtreeJob subtree_job = {subtrees, prim_bounds, mortons, settings, padding};
+        mt__parallel_for(thread_count < subtree_count ? thread_count : subtree_count, subtree_count, mt__bvh_subtrees_build_range, &subtree_job);
+
+        int subtree_index = 0;
+        mt__bvh_subtrees_emit(bvh, mortons, 0, prim_count - 1, subtree_size, settings, subtrees, &subtree_index);
+
+        free(subtrees);
+    }
+    else
+    {
+        mt__bvh_node_create(bvh, prim_bounds, mortons, 0, prim_count - 1, settings, padding);
+    }
+
+    for (int i = 0; i < prim_count; ++i)
+    {
+        bvh->prims[i] = mortons[i].prim_index;
+    }
+
+    free(job.mortons);
+    free(job.thread_bounds);
+}
+
+typedef struct MT_BVHBin
+{
+    MT_Bounds bounds;
+    int count;
+} MT_BVHBin;
+
+static inline float mt__vec3_axis(MT_Vec3 v, int axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static inline int mt__bvh_bin_index(float center, float center_min, float bin_scale)
+{
+    int bin = (int)((center - center_min) * bin_scale);
+    return bin < 0 ? 0 : (bin >= MT_BVH_SAH_BINS ? MT_BVH_SAH_BINS - 1 : bin);
+}
+
+// binned surface area heuristic
+// source: https://www.sci.utah.edu/~wald/Publications/2007/ParallelBVHBuild/fastbuild.pdf
+static uint32_t mt__bvh_node_create_sah(MT_BVH *bvh, const MT_Bounds *prim_bounds, const MT_Vec3 *centers, int start, int count, const MT_BVHSettings *settings)
+{
+    uint32_t *prims = bvh->prims;
+    uint32_t node_index = bvh->node_count++;
+    MT_BVHNode *node = &bvh->nodes[node_index];
+
+    MT_Bounds bounds = mt__bounds_create_invalid();
+    MT_Bounds center_bounds = mt__bounds_create_invalid();
+    for (int i = start; i < start + count; ++i)
+    {
+        bounds = mt__bounds_union(bounds, prim_bounds[prims[i]]);
+        center_bounds = mt__bounds_union(center_bounds, (MT_Bounds){centers[prims[i]], centers[prims[i]]});
+    }
+
+    node->bounds = bounds;
+    node->index = start;
+    node->prim_count = count;
+
+    if (count == 1)
+    {
+        return node_index;
+    }
+
+    float parent_area = fmaxf(mt__bounds_area(bounds), FLT_MIN);
+    float best_cost = FLT_MAX;
+    int best_axis = -1;
+    int best_split = 0;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float center_min = mt__vec3_axis(center_bounds.start, axis);
+        float center_max = mt__vec3_axis(center_bounds.end, axis);
+        if (center_max <= center_min)
+        {
+            continue;
+        }
+
+        float bin_scale = MT_BVH_SAH_BINS / (center_max - center_min);
+
+        MT_BVHBin bins[MT_BVH_SAH_BINS];
+        for (int b = 0; b < MT_BVH_SAH_BINS; ++b)
+        {
+            bins[b].bounds = mt__bounds_create_invalid();
+            bins[b].count = 0;
+        }
+
+        for (int i = start; i < start + count; ++i)
+        {
+            int b = mt__bvh_bin_index(mt__vec3_axis(centers[prims[i]], axis), center_min, bin_scale);
+            bins[b].bounds = mt__bounds_union(bins[b].bounds, prim_bounds[prims[i]]);
+            ++bins[b].count;
+        }
+
+        // sweep from the right to get the cost of everything past each split plane
+        float right_area[MT_BVH_SAH_BINS - 1];
+        int right_count[MT_BVH_SAH_BINS - 1];
+        MT_Bounds sweep_bounds = mt__bounds_create_invalid();
+        int sweep_count = 0;
+        for (int b = MT_BVH_SAH_BINS - 1; b > 0; --b)
+        {
+            sweep_bounds = mt__bounds_union(sweep_bounds, bins[b].bounds);
+            sweep_count += bins[b].count;
+            right_area[b - 1] = mt__bounds_area(sweep_bounds);
+            right_count[b - 1] = sweep_count;
+        }
+
+        sweep_bounds = mt__bounds_create_invalid();
+        sweep_count = 0;
+        for (int b = 0; b < MT_BVH_SAH_BINS - 1; ++b)
+        {
+            sweep_bounds = mt__bounds_union(sweep_bounds, bins[b].bounds);
+            sweep_count += bins[b].count;
+            if (sweep_count == 0 || right_count[b] == 0)
+            {
+                continue;
+            }
+
+            float cost = MT_BVH_SAH_TRAVERSAL_COST +
+                         (mt__bounds_area(sweep_bounds) * sweep_count + right_area[b] * right_count[b]) / parent_area * MT_BVH_SAH_INTERSECT_COST;
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    int left_count = count / 2;
+
+    if (best_axis == -1)
+    {
+        // every center is in the same spot, only split if the leaf would be too big
+        if (count <= settings->max_leaf_size)
+        {
+            return node_index;
+        }
+    }
+    else
+    {
+        if (count <= settings->max_leaf_size && count * MT_BVH_SAH_INTERSECT_COST <= best_cost)
+        {
+            return node_index;
+        }
+
+        float center_min = mt__vec3_axis(center_bounds.start, best_axis);
+        float bin_scale = MT_BVH_SAH_BINS / (mt__vec3_axis(center_bounds.end, best_axis) - center_min);
+
+        int i = start;
+        int j = start + count - 1;
+        while (i <= j)
+        {
+            if (mt__bvh_bin_index(mt__vec3_axis(centers[prims[i]], best_axis), center_min, bin_scale) <= best_split)
+            {
+                ++i;
+            }
+            else
+            {
+                uint32_t temp = prims[i];
+                prims[i] = prims[j];
+                prims[j] = temp;
+                --j;
+            }
+        }
+
+        left_count = i - start;
+    }
+
+    mt__bvh_node_create_sah(bvh, prim_bounds, centers, start, left_count, settings);
+    node->index = mt__bvh_node_create_sah(bvh, prim_bounds, centers, start + left_count, count - left_count, settings);
+    node->prim_count = 0;
+
+    return node_index;
+}
+
+static void mt__bvh_build_sah(MT_BVH *bvh, const MT_BVHSettings *settings, const MT_Bounds *prim_bounds, int prim_count)
+{
+    MT_Vec3 *centers = (MT_Vec3 *)malloc(sizeof(MT_Vec3) * prim_count);
+
+    for (int i = 0; i < prim_count; ++i)
+    {
+        centers[i] = mt__bounds_center(prim_bounds[i]);
+        bvh->prims[i] = i;
+    }
+
+    mt__bvh_node_create_sah(bvh, prim_bounds, centers, 0, prim_count, settings);
+    free(centers);
+}
+
+// splits a primitive at an axis aligned plane, out_left and out_right bound the parts of it on either side
+typedef void (*MT_BVHSplitFn)(const void *data, uint32_t prim, int axis, float position, MT_Bounds *out_left, MT_Bounds *out_right);
+
+// one reference to a primitive, spatial splits can leave several of them with clipped bounds
+typedef struct MT_BVHRef
+{
+    MT_Bounds bounds;
+    uint32_t prim;
+} MT_BVHRef;
+
+typedef struct MT_BVHSpatialBin
+{
+    MT_Bounds bounds;
+    int entry_count;
+    int exit_count;
+} MT_BVHSpatialBin;
+
+typedef struct MT_BVHSplitBuild
+{
+    MT_BVH *bvh;
+    const MT_BVHSettings *settings;
+    MT_BVHSplitFn split_fn; // NULL clips the reference's bounds instead of the primitive
+    const void *split_data;
+
+    float root_area;
+    uint32_t ref_count; // references made so far, duplicates included
+    uint32_t max_refs;
+    uint32_t prim_cursor;
+} MT_BVHSplitBuild;
+
+static inline void mt__vec3_set_axis(MT_Vec3 *v, int axis, float value)
+{
+    if (axis == 0)
+    {
+        v->x = value;
+    }
+    else if (axis == 1)
+    {
+        v->y = value;
+    }
+    else
+    {
+        v->z = value;
+    }
+}
+
+static MT_Bounds mt__bounds_intersect(MT_Bounds a, MT_Bounds b)
+{
+    MT_Bounds out;
+    out.start.x = fmaxf(a.start.x, b.start.x);
+    out.start.y = fmaxf(a.start.y, b.start.y);
+    out.start.z = fmaxf(a.start.z, b.start.z);
+    out.end.x = fminf(a.end.x, b.end.x);
+    out.end.y = fminf(a.end.y, b.end.y);
+    out.end.z = fminf(a.end.z, b.end.z);
+    return out;
+}
+
+static inline int mt__bounds_valid(MT_Bounds bounds)
+{
+    return bounds.start.x <= bounds.end.x && bounds.start.y <= bounds.end.y && bounds.start.z <= bounds.end.z;
+}
+
+static void mt__bvh_ref_split(const MT_BVHSplitBuild *build, const MT_BVHRef *ref, int axis, float position, MT_BVHRef *out_left, MT_BVHRef *out_right)
+{
+    out_left->prim = ref->prim;
+    out_right->prim = ref->prim;
+    out_left->bounds = ref->bounds;
+    out_right->bounds = ref->bounds;
+
+    if (build->split_fn)
+    {
+        build->split_fn(build->split_data, ref->prim, axis, position, &out_left->bounds, &out_right->bounds);
+        out_left->bounds = mt__bounds_intersect(out_left->bounds, ref->bounds);
+        out_right->bounds = mt__bounds_intersect(out_right->bounds, ref->bounds);
+    }
+
+    // the plane itself is exact, so both parts meet there even if the clipped points rounded away from it
+    mt__vec3_set_axis(&out_left->bounds.end, axis, fminf(mt__vec3_axis(out_left->bounds.end, axis), position));
+    mt__vec3_set_axis(&out_right->bounds.start, axis, fmaxf(mt__vec3_axis(out_right->bounds.start, axis), position));
+}
+
+// like mt__bvh_node_create_sbvh this takes ownership of refs
+static uint32_t mt__bvh_node_create_sbvh_leaf(MT_BVHSplitBuild *build, uint32_t node_index, MT_BVHRef *refs, int count)
+{
+    MT_BVHNode *node = &build->bvh->nodes[node_index];
+    node->index = build->prim_cursor;
+    node->prim_count = count;
+
+    for (int i = 0; i < count; ++i)
+    {
+        build->bvh->prims[build->prim_cursor++] = refs[i].prim;
+    }
+    free(refs);
+
+    return node_index;
+}
+
+// spatial split bvh, a node either splits its references by center like the sah builder
+// or splits space at a plane and references straddling primitives from both sides, whichever is cheaper
+// source: https://www.nvidia.in/docs/IO/77714/sbvh.pdf
+// refs must be heap allocated, it is freed once the node's children have their own copies
+static uint32_t mt__bvh_node_create_sbvh(MT_BVHSplitBuild *build, MT_BVHRef *refs, int count)
+{
+    const MT_BVHSettings *settings = build->settings;
+    uint32_t node_index = build->bvh->node_count++;
+
+    MT_Bounds bounds = mt__bounds_create_invalid();
+    MT_Bounds center_bounds = mt__bounds_create_invalid();
+    for (int i = 0; i < count; ++i)
+    {
+        MT_Vec3 center = mt__bounds_center(refs[i].bounds);
+        bounds = mt__bounds_union(bounds, refs[i].bounds);
+        center_bounds = mt__bounds_union(center_bounds, (MT_Bounds){center, center});
+    }
+    build->bvh->nodes[node_index].bounds = bounds;
+
+    if (count == 1)
+    {
+        return mt__bvh_node_create_sbvh_leaf(build, node_index, refs, count);
+    }
+
+    float parent_area = fmaxf(mt__bounds_area(bounds), FLT_MIN);
+
+    // object split, the same binning as the sah builder but over reference centers
+    float object_cost = FLT_MAX;
+    int object_axis = -1;
+    int object_split = 0;
+    MT_Bounds object_left = mt__bounds_create_invalid();
+    MT_Bounds object_right = mt__bounds_create_invalid();
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float center_min = mt__vec3_axis(center_bounds.start, axis);
+        float center_max = mt__vec3_axis(center_bounds.end, axis);
+        if (center_max <= center_min)
+        {
+            continue;
+        }
+
+        float bin_scale = MT_BVH_SAH_BINS / (center_max - center_min);
+
+        MT_BVHBin bins[MT_BVH_SAH_BINS];
+        for (int b = 0; b < MT_BVH_SAH_BINS; ++b)
+        {
+            bins[b].bounds = mt__bounds_create_invalid();
+            bins[b].count = 0;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            int b = mt__bvh_bin_index(mt__vec3_axis(mt__bounds_center(refs[i].bounds), axis), center_min, bin_scale);
+            bins[b].bounds = mt__bounds_union(bins[b].bounds, refs[i].bounds);
+            ++bins[b].count;
+        }
+
+        MT_Bounds right_bounds[MT_BVH_SAH_BINS - 1];
+        int right_count[MT_BVH_SAH_BINS - 1];
+        MT_Bounds sweep_bounds = mt__bounds_create_invalid();
+        int sweep_count = 0;
+        for (int b = MT_BVH_SAH_BINS - 1; b > 0; --b)
+        {
+            sweep_bounds = mt__bounds_union(sweep_bounds, bins[b].bounds);
+            sweep_count += bins[b].count;
+            right_bounds[b - 1] = sweep_bounds;
+            right_count[b - 1] = sweep_count;
+        }
+
+        sweep_bounds = mt__bounds_create_invalid();
+        sweep_count = 0;
+        for (int b = 0; b < MT_BVH_SAH_BINS - 1; ++b)
+        {
+            sweep_bounds = mt__bounds_union(sweep_bounds, bins[b].bounds);
+            sweep_count += bins[b].count;
+            if (sweep_count == 0 || right_count[b] == 0)
+            {
+                continue;
+            }
+
+            float cost = MT_BVH_SAH_TRAVERSAL_COST +
+                         (mt__bounds_area(sweep_bounds) * sweep_count + mt__bounds_area(right_bounds[b]) * right_count[b]) / parent_area * MT_BVH_SAH_INTERSECT_COST;
+            if (cost < object_cost)
+            {
+                object_cost = cost;
+                object_axis = axis;
+                object_split = b;
+                object_left = sweep_bounds;
+                object_right = right_bounds[b];
+            }
+        }
+    }
+
+    // spatial splits are only tried where the object split's children overlap enough to matter
+    float spatial_cost = FLT_MAX;
+    int spatial_axis = -1;
+    int spatial_split = 0;
+
+    MT_Bounds overlap = mt__bounds_intersect(object_left, object_right);
+    int b_try_spatial = object_axis == -1 || (mt__bounds_valid(overlap) && mt__bounds_area(overlap) > MT_BVH_SBVH_MIN_OVERLAP * build->root_area);
+
+    for (int axis = 0; axis < 3 && b_try_spatial && build->ref_count < build->max_refs; ++axis)
+    {
+        float bounds_min = mt__vec3_axis(bounds.start, axis);
+        float bounds_max = mt__vec3_axis(bounds.end, axis);
+        if (bounds_max <= bounds_min)
+        {
+            continue;
+        }
+
+        float bin_width = (bounds_max - bounds_min) / MT_BVH_SAH_BINS;
+        float bin_scale = 1.0f / bin_width;
+
+        MT_BVHSpatialBin bins[MT_BVH_SAH_BINS];
+        for (int b = 0; b < MT_BVH_SAH_BINS; ++b)
+        {
+            bins[b].bounds = mt__bounds_create_invalid();
+            bins[b].entry_count = 0;
+            bins[b].exit_count = 0;
+        }
+
+        // each reference is chopped at every bin plane it crosses and its pieces go into those bins
+        for (int i = 0; i < count; ++i)
+        {
+            int first_bin = mt__bvh_bin_index(mt__vec3_axis(refs[i].bounds.start, axis), bounds_min, bin_scale);
+            int last_bin = mt__bvh_bin_index(mt__vec3_axis(refs[i].bounds.end, axis), bounds_min, bin_scale);
+
+            MT_BVHRef rest = refs[i];
+            for (int b = first_bin; b < last_bin; ++b)
+            {
+                MT_BVHRef piece;
+                mt__bvh_ref_split(build, &rest, axis, bounds_min + (b + 1) * bin_width, &piece, &rest);
+                if (mt__bounds_valid(piece.bounds))
+                {
+                    bins[b].bounds = mt__bounds_union(bins[b].bounds, piece.bounds);
+                }
+            }
+            if (mt__bounds_valid(rest.bounds))
+            {
+                bins[last_bin].bounds = mt__bounds_union(bins[last_bin].bounds, rest.bounds);
+            }
+
+            ++bins[first_bin].entry_count;
+            ++bins[last_bin].exit_count;
+        }
+
+        float right_area[MT_BVH_SAH_BINS - 1];
+        int right_count[MT_BVH_SAH_BINS - 1];
+        MT_Bounds sweep_bounds = mt__bounds_create_invalid();
+        int sweep_count = 0;
+        for (int b = MT_BVH_SAH_BINS - 1; b > 0; --b)
+        {
+            sweep_bounds = mt__bounds_union(sweep_bounds, bins[b].bounds);
+            sweep_count += bins[b].exit_count;
+            right_area[b - 1] = mt__bounds_area(sweep_bounds);
+            right_count[b - 1] = sweep_count;
+        }
+
+        sweep_bounds = mt__bounds_create_invalid();
+        sweep_count = 0;
+        for (int b = 0; b < MT_BVH_SAH_BINS - 1; ++b)
+        {
+            sweep_bounds = mt__bounds_union(sweep_bounds, bins[b].bounds);
+            sweep_count += bins[b].entry_count;
+            if (sweep_count == 0 || right_count[b] == 0 || (sweep_count == count && right_count[b] == count))
+            {
+                continue;
+            }
+
+            float cost = MT_BVH_SAH_TRAVERSAL_COST +
+                         (mt__bounds_area(sweep_bounds) * sweep_count + right_area[b] * right_count[b]) / parent_area * MT_BVH_SAH_INTERSECT_COST;
+            if (cost < spatial_cost)
+            {
+                spatial_cost = cost;
+                spatial_axis = axis;
+                spatial_split = b;
+            }
+        }
+    }
+
+    float best_cost = fminf(object_cost, spatial_cost);
+    if (count <= settings->max_leaf_size && (best_cost == FLT_MAX || count * MT_BVH_SAH_INTERSECT_COST <= best_cost))
+    {
+        return mt__bvh_node_create_sbvh_leaf(build, node_index, refs, count);
+    }
+
+    MT_BVHRef *left = NULL;
+    MT_BVHRef *right = NULL;
+    int left_count = 0;
+    int right_count = 0;
+
+    if (spatial_cost < object_cost)
+    {
+        float bounds_min = mt__vec3_axis(bounds.start, spatial_axis);
+        float bin_width = (mt__vec3_axis(bounds.end, spatial_axis) - bounds_min) / MT_BVH_SAH_BINS;
+        float bin_scale = 1.0f / bin_width;
+        float position = bounds_min + (spatial_split + 1) * bin_width;
+
+        // straddling references are split in two, which needs room in the budget for the extra ones
+        int straddle_count = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            int first_bin = mt__bvh_bin_index(mt__vec3_axis(refs[i].bounds.start, spatial_axis), bounds_min, bin_scale);
+            int last_bin = mt__bvh_bin_index(mt__vec3_axis(refs[i].bounds.end, spatial_axis), bounds_min, bin_scale);
+            straddle_count += first_bin <= spatial_split && last_bin > spatial_split;
+        }
+
+        if (build->ref_count + straddle_count <= build->max_refs)
+        {
+            left = (MT_BVHRef *)malloc(sizeof(MT_BVHRef) * count);
+            right = (MT_BVHRef *)malloc(sizeof(MT_BVHRef) * count);
+
+            for (int i = 0; i < count; ++i)
+            {
+                int first_bin = mt__bvh_bin_index(mt__vec3_axis(refs[i].bounds.start, spatial_axis), bounds_min, bin_scale);
+                int last_bin = mt__bvh_bin_index(mt__vec3_axis(refs[i].bounds.end, spatial_axis), bounds_min, bin_scale);
+
+                if (last_bin <= spatial_split)
+                {
+                    left[left_count++] = refs[i];
+                }
+                else if (first_bin > spatial_split)
+                {
+                    right[right_count++] = refs[i];
+                }
+                else
+                {
+                    MT_BVHRef left_ref, right_ref;
+                    mt__bvh_ref_split(build, &refs[i], spatial_axis, position, &left_ref, &right_ref);
+
+                    // a clipped primitive can turn out not to reach one of the sides after all
+                    int b_left = mt__bounds_valid(left_ref.bounds);
+                    int b_right = mt__bounds_valid(right_ref.bounds);
+                    if (b_left)
+                    {
+                        left[left_count++] = left_ref;
+                    }
+                    if (b_right)
+                    {
+                        right[right_count++] = right_ref;
+                    }
+                    if (!b_left && !b_right)
+                    {
+                        left[left_count++] = refs[i];
+                    }
+                    build->ref_count += b_left && b_right;
+                }
+            }
+
+            if (left_count == 0 || right_count == 0)
+            {
+                build->ref_count -= left_count + right_count - count;
+                free(left);
+                free(right);
+                left = NULL;
+                right = NULL;
+                left_count = 0;
+                right_count = 0;
+            }
+        }
+    }
+
+    if (!left)
+    {
+        left = (MT_BVHRef *)malloc(sizeof(MT_BVHRef) * count);
+        right = (MT_BVHRef *)malloc(sizeof(MT_BVHRef) * count);
+
+        if (object_axis == -1)
+        {
+            // every center is in the same spot, split down the middle
+            left_count = count / 2;
+            right_count = count - left_count;
+            memcpy(left, refs, sizeof(MT_BVHRef) * left_count);
+            memcpy(right, refs + left_count, sizeof(MT_BVHRef) * right_count);
+        }
+        else
+        {
+            float center_min = mt__vec3_axis(center_bounds.start, object_axis);
+            float bin_scale = MT_BVH_SAH_BINS / (mt__vec3_axis(center_bounds.end, object_axis) - center_min);
+
+            for (int i = 0; i < count; ++i)
+            {
+                if (mt__bvh_bin_index(mt__vec3_axis(mt__bounds_center(refs[i].bounds), object_axis), center_min, bin_scale) <= object_split)
+                {
+                    left[left_count++] = refs[i];
+                }
+                else
+                {
+                    right[right_count++] = refs[i];
+                }
+            }
+        }
+    }
+
+    // the children copied what they need, so this node's references can go before recursing
+    free(refs);
+
+    mt__bvh_node_create_sbvh(build, left, left_count);
+    uint32_t right_index = mt__bvh_node_create_sbvh(build, right, right_count);
+
+    MT_BVHNode *node = &build->bvh->nodes[node_index];
+    node->index = right_index;
+    node->prim_count = 0;
+
+    return node_index;
+}
+
+static void mt__bvh_build_sbvh(MT_BVH *bvh, const MT_BVHSettings *settings, const MT_Bounds *prim_bounds, int prim_count, MT_BVHSplitFn split_fn, const void *split_data)
+{
+    MT_BVHSplitBuild build = {bvh, settings, split_fn, split_data, 0.0f, prim_count, prim_count, 0};
+
+    MT_BVHRef *refs = (MT_BVHRef *)malloc(sizeof(MT_BVHRef) * prim_count);
+    MT_Bounds root_bounds = mt__bounds_create_invalid();
+    for (int i = 0; i < prim_count; ++i)
+    {
+        refs[i].bounds = prim_bounds[i];
+        refs[i].prim = i;
+        root_bounds = mt__bounds_union(root_bounds, prim_bounds[i]);
+    }
+
+    build.root_area = mt__bounds_area(root_bounds);
+    build.max_refs = prim_count + (uint32_t)(prim_count * settings->split_budget);
+
+    mt__bvh_node_create_sbvh(&build, refs, prim_count);
+    bvh->prim_count = build.prim_cursor;
+}
+
+// pulls up to MT_BVH_WIDTH descendants into one node by repeatedly opening the largest interior child
+static uint32_t mt__bvh_collapse_wide(MT_BVH *bvh, uint32_t node_index, uint32_t depth)
+{
+    const MT_BVHNode *nodes = bvh->nodes;
+    uint32_t wide_index = bvh->wide_node_count++;
+
+    if (depth > bvh->wide_max_depth)
+    {
+        bvh->wide_max_depth = depth;
+    }
+
+    uint32_t children[MT_BVH_WIDTH];
+    int child_count = 0;
+
+    if (nodes[node_index].prim_count > 0)
+    {
+        children[child_count++] = node_index;
+    }
+    else
+    {
+        children[child_count++] = node_index + 1;
+        children[child_count++] = nodes[node_index].index;
+    }
+
+    while (child_count < MT_BVH_WIDTH)
+    {
+        int largest = -1;
+        float largest_area = -1.0f;
+        for (int i = 0; i < child_count; ++i)
+        {
+            const MT_BVHNode *child = &nodes[children[i]];
+            if (child->prim_count == 0 && mt__bounds_area(child->bounds) > largest_area)
+            {
+                largest = i;
+                largest_area = mt__bounds_area(child->bounds);
+            }
+        }
+
+        if (largest == -1)
+        {
+            break;
+        }
+
+        uint32_t opened = children[largest];
+        children[largest] = opened + 1;
+        children[child_count++] = nodes[opened].index;
+    }
+
+    MT_BVHWideNode *wide = &bvh->wide_nodes[wide_index];
+    memset(wide, 0, sizeof(MT_BVHWideNode));
+    wide->child_count = child_count;
+
+    for (int i = 0; i < child_count; ++i)
+    {
+        const MT_BVHNode *child = &nodes[children[i]];
+        bvh->wide_slots[children[i]] = wide_index * MT_BVH_WIDTH + i;
+
+        wide->min_x[i] = child->bounds.start.x;
+        wide->min_y[i] = child->bounds.start.y;
+        wide->min_z[i] = child->bounds.start.z;
+        wide->max_x[i] = child->bounds.end.x;
+        wide->max_y[i] = child->bounds.end.y;
+        wide->max_z[i] = child->bounds.end.z;
+
+        if (child->prim_count > 0)
+        {
+            wide->child[i] = child->index;
+            wide->prim_count[i] = child->prim_count;
+        }
+        else
+        {
+            wide->child[i] = mt__bvh_collapse_wide(bvh, children[i], depth + 1);
+            wide->prim_count[i] = 0;
+        }
+    }
+
+    return wide_index;
+}
+
+// lanes only ever round outwards, a decoded box always holds the one it was made from
+static void mt__bvh_quantize_lane(MT_BVHQuantizedNode *node, int lane, MT_Bounds bounds)
+{
+    const float *start = &bounds.start.x;
+    const float *end = &bounds.end.x;
+    const float *origin = &node->origin.x;
+    const float *scale = &node->scale.x;
+    MT_BVHQuant *mins[3] = {node->min_x, node->min_y, node->min_z};
+    MT_BVHQuant *maxs[3] = {node->max_x, node->max_y, node->max_z};
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float q_min = floorf((start[axis] - origin[axis]) / scale[axis]);
+        float q_max = ceilf((end[axis] - origin[axis]) / scale[axis]);
+        q_min = fminf(fmaxf(q_min, 0.0f), (float)MT_BVH_QUANTIZE_MAX);
+        q_max = fminf(fmaxf(q_max, 0.0f), (float)MT_BVH_QUANTIZE_MAX);
+
+        // the divide can round either way, step out until the decoded planes really hold the bounds
+        while (q_min > 0.0f && origin[axis] + q_min * scale[axis] > start[axis])
+        {
+            q_min -= 1.0f;
+        }
+        while (q_max < MT_BVH_QUANTIZE_MAX && origin[axis] + q_max * scale[axis] < end[axis])
+        {
+            q_max += 1.0f;
+        }
+
+        mins[axis][lane] = (MT_BVHQuant)q_min;
+        maxs[axis][lane] = (MT_BVHQuant)q_max;
+    }
+}
+
+static MT_Bounds mt__bvh_dequantize_lane(const MT_BVHQuantizedNode *node, int lane)
+{
+    MT_Bounds bounds;
+    bounds.start.x = node->origin.x + node->min_x[lane] * node->scale.x;
+    bounds.start.y = node->origin.y + node->min_y[lane] * node->scale.y;
+    bounds.start.z = node->origin.z + node->min_z[lane] * node->scale.z;
+    bounds.end.x = node->origin.x + node->max_x[lane] * node->scale.x;
+    bounds.end.y = node->origin.y + node->max_y[lane] * node->scale.y;
+    bounds.end.z = node->origin.z + node->max_z[lane] * node->scale.z;
+    return bounds;
+}
+
+// the grid spans the node's box in power of two steps, so q * scale is exact and only the final add rounds
+static void mt__bvh_quantize_node(MT_BVHQuantizedNode *node, const MT_Bounds *lanes, int lane_count)
+{
+    MT_Bounds bounds = mt__bounds_create_invalid();
+    for (int i = 0; i < lane_count; ++i)
+    {
+        bounds = mt__bounds_union(bounds, lanes[i]);
+    }
+
+    node->origin = bounds.start;
+
+    const float *start = &bounds.start.x;
+    const float *end = &bounds.end.x;
+    float *scale = &node->scale.x;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        int exponent;
+        frexpf((end[axis] - start[axis]) / MT_BVH_QUANTIZE_MAX, &exponent);
+        scale[axis] = ldexpf(1.0f, exponent);
+
+        while (start[axis] + MT_BVH_QUANTIZE_MAX * scale[axis] < end[axis])
+        {
+            scale[axis] *= 2.0f;
+        }
+    }
+
+    for (int i = 0; i < lane_count; ++i)
+    {
+        mt__bvh_quantize_lane(node, i, lanes[i]);
+    }
+}
+
+static void mt__bvh_quantize_wide(MT_BVH *bvh)
+{
+    bvh->quantized_nodes = (MT_BVHQuantizedNode *)malloc(sizeof(MT_BVHQuantizedNode) * bvh->wide_node_count);
+
+    for (uint32_t i = 0; i < bvh->wide_node_count; ++i)
+    {
+        const MT_BVHWideNode *wide = &bvh->wide_nodes[i];
+        MT_BVHQuantizedNode *node = &bvh->quantized_nodes[i];
+        memset(node, 0, sizeof(MT_BVHQuantizedNode));
+
+        MT_Bounds lanes[MT_BVH_WIDTH];
+        for (uint32_t lane = 0; lane < wide->child_count; ++lane)
+        {
+            lanes[lane].start = (MT_Vec3){wide->min_x[lane], wide->min_y[lane], wide->min_z[lane]};
+            lanes[lane].end = (MT_Vec3){wide->max_x[lane], wide->max_y[lane], wide->max_z[lane]};
+            node->child[lane] = wide->child[lane];
+            node->prim_count[lane] = wide->prim_count[lane];
+        }
+        node->child_count = wide->child_count;
+
+        mt__bvh_quantize_node(node, lanes, wide->child_count);
+    }
+
+    free(bvh->wide_nodes);
+    bvh->wide_nodes = NULL;
+}
+
+static inline float mt__bvh_node_sah_weight(const MT_BVHNode *node)
+{
+    return node->prim_count > 0 ? node->prim_count * MT_BVH_SAH_INTERSECT_COST : MT_BVH_SAH_TRAVERSAL_COST;
+}
+
+static float mt__bvh_sah_cost(const MT_BVH *bvh)
+{
+    float root_area = mt__bounds_area(bvh->nodes[0].bounds);
+    return root_area > 0.0f ? (float)(bvh->sah_sum / root_area) : 1.0f;
+}
+
+// the tree as explicit children while treelets are being rearranged, it is emitted back in depth first order afterwards
+typedef struct MT_BVHTreeletTree
+{
+    MT_BVHNode *nodes; // bounds and leaf ranges, interior indices are ignored
+    uint32_t *left;
+    uint32_t *right;
+    float *costs; // sah cost of each node's subtree, not divided by the root area
+    unsigned char *b_subtree_roots;
+} MT_BVHTreeletTree;
+
+static float mt__bvh_treelet_cost_calculate(MT_BVHTreeletTree *tree, uint32_t node_index)
+{
+    const MT_BVHNode *node = &tree->nodes[node_index];
+    float cost = mt__bvh_node_sah_weight(node) * mt__bounds_area(node->bounds);
+
+    if (node->prim_count == 0)
+    {
+        cost += mt__bvh_treelet_cost_calculate(tree, tree->left[node_index]);
+        cost += mt__bvh_treelet_cost_calculate(tree, tree->right[node_index]);
+    }
+
+    tree->costs[node_index] = cost;
+    return cost;
+}
+
+// gives the treelet's internal nodes back out in the topology the subset table picked, returns the node for subset
+static uint32_t mt__bvh_treelet_emit(MT_BVHTreeletTree *tree, int subset, const int *splits, const uint32_t *leaves, const uint32_t *internals, int *internal_index)
+{
+    if ((subset & (subset - 1)) == 0)
+    {
+        return leaves[__builtin_ctz(subset)];
+    }
+
+    uint32_t node_index = internals[(*internal_index)++];
+    uint32_t left = mt__bvh_treelet_emit(tree, splits[subset], splits, leaves, internals, internal_index);
+    uint32_t right = mt__bvh_treelet_emit(tree, subset & ~splits[subset], splits, leaves, internals, internal_index);
+
+    tree->left[node_index] = left;
+    tree->right[node_index] = right;
+    tree->nodes[node_index].bounds = mt__bounds_union(tree->nodes[left].bounds, tree->nodes[right].bounds);
+    tree->costs[node_index] = MT_BVH_SAH_TRAVERSAL_COST * mt__bounds_area(tree->nodes[node_index].bounds) + tree->costs[left] + tree->costs[right];
+
+    return node_index;
+}
+
+// grows a treelet under the node by opening its largest leaves, then rearranges it into the cheapest topology
+// source: https://research.nvidia.com/sites/default/files/pubs/2013-07_Fast-Parallel-Construction/karras2013hpg_paper.pdf
+static void mt__bvh_treelet_restructure(MT_BVHTreeletTree *tree, uint32_t node_index)
+{
+    uint32_t leaves[MT_BVH_TREELET_LEAVES];
+    uint32_t internals[MT_BVH_TREELET_LEAVES - 1];
+    int leaf_count = 0;
+    int internal_count = 0;
+
+    internals[internal_count++] = node_index;
+    leaves[leaf_count++] = tree->left[node_index];
+    leaves[leaf_count++] = tree->right[node_index];
+
+    while (leaf_count < MT_BVH_TREELET_LEAVES)
+    {
+        int largest = -1;
+        float largest_area = -1.0f;
+        for (int i = 0; i < leaf_count; ++i)
+        {
+            const MT_BVHNode *leaf = &tree->nodes[leaves[i]];
+            if (leaf->prim_count == 0 && mt__bounds_area(leaf->bounds) > largest_area)
+            {
+                largest = i;
+                largest_area = mt__bounds_area(leaf->bounds);
+            }
+        }
+
+        if (largest == -1)
+        {
+            break;
+        }
+
+        uint32_t opened = leaves[largest];
+        internals[internal_count++] = opened;
+        leaves[largest] = tree->left[opened];
+        leaves[leaf_count++] = tree->right[opened];
+    }
+
+    if (leaf_count < 3)
+    {
+        return;
+    }
+
+    // cheapest cost of every subset of the treelet's leaves, built up from the smaller subsets
+    int subset_count = 1 << leaf_count;
+    float areas[1 << MT_BVH_TREELET_LEAVES];
+    float costs[1 << MT_BVH_TREELET_LEAVES];
+    int splits[1 << MT_BVH_TREELET_LEAVES];
+
+    // every subset's bounds are a smaller subset's bounds grown by its lowest leaf
+    MT_Bounds bounds[1 << MT_BVH_TREELET_LEAVES];
+    bounds[0] = mt__bounds_create_invalid();
+    for (int subset = 1; subset < subset_count; ++subset)
+    {
+        int lowest = subset & -subset;
+        bounds[subset] = mt__bounds_union(bounds[subset & ~lowest], tree->nodes[leaves[__builtin_ctz(lowest)]].bounds);
+        areas[subset] = mt__bounds_area(bounds[subset]);
+    }
+
+    for (int i = 0; i < leaf_count; ++i)
+    {
+        costs[1 << i] = tree->costs[leaves[i]];
+    }
+
+    // subsets are visited in increasing order so every proper part of one is already solved
+    for (int subset = 1; subset < subset_count; ++subset)
+    {
+        if ((subset & (subset - 1)) == 0)
+        {
+            continue;
+        }
+
+        // only parts holding the lowest leaf are tried, the rest are the same splits mirrored
+        int lowest = subset & -subset;
+        int rest = subset & ~lowest;
+        float best_cost = costs[lowest] + costs[rest];
+        int best_split = lowest;
+        for (int others = (rest - 1) & rest; others > 0; others = (others - 1) & rest)
+        {
+            int part = lowest | others;
+            float cost = costs[part] + costs[subset & ~part];
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_split = part;
+            }
+        }
+
+        costs[subset] = MT_BVH_SAH_TRAVERSAL_COST * areas[subset] + best_cost;
+        splits[subset] = best_split;
+    }
+
+    if (costs[subset_count - 1] >= tree->costs[node_index] * (1.0f - MT_EPSILON))
+    {
+        return;
+    }
+
+    // the treelet root keeps its index so its parent still points at it
+    int internal_index = 0;
+    mt__bvh_treelet_emit(tree, subset_count - 1, splits, leaves, internals, &internal_index);
+}
+
+// restructures bottom up so every treelet is formed from already improved subtrees
+static void mt__bvh_treelet_optimize(MT_BVHTreeletTree *tree, uint32_t node_index, int b_stop_at_subtrees)
+{
+    if (tree->nodes[node_index].prim_count > 0 || (b_stop_at_subtrees && tree->b_subtree_roots[node_index]))
+    {
+        return;
+    }
+
+    mt__bvh_treelet_optimize(tree, tree->left[node_index], b_stop_at_subtrees);
+    mt__bvh_treelet_optimize(tree, tree->right[node_index], b_stop_at_subtrees);
+    mt__bvh_treelet_restructure(tree, node_index);
+}
+
+typedef struct MT_BVHTreeletJob
+{
+    MT_BVHTreeletTree *tree;
+    uint32_t *subtree_roots;
+} MT_BVHTreeletJob;
+
+static void mt__bvh_treelet_optimize_range(void *data, unsigned int start, unsigned int end, unsigned int thread_index)
+{
+    MT_BVHTreeletJob *job = (MT_BVHTreeletJob *)data;
+
+    for (unsigned int i = start; i < end; ++i)
+    {
+        mt__bvh_treelet_optimize(job->tree, job->subtree_roots[i], 0);
+    }
+}
+
+// marks the roots of disjoint subtrees of about subtree_size prims, which can be optimized at the same time
+static uint32_t mt__bvh_treelet_find_subtrees(MT_BVHTreeletTree *tree, uint32_t node_index, uint32_t subtree_size, uint32_t *subtree_roots, uint32_t *subtree_count)
+{
+    const MT_BVHNode *node = &tree->nodes[node_index];
+    if (node->prim_count > 0)
+    {
+        return node->prim_count;
+    }
+
+    uint32_t left_size = mt__bvh_treelet_find_subtrees(tree, tree->left[node_index], subtree_size, subtree_roots, subtree_count);
+    uint32_t right_size = mt__bvh_treelet_find_subtrees(tree, tree->right[node_index], subtree_size, subtree_roots, subtree_count);
+    uint32_t size = left_size + right_size;
+
+    // the first node up from the bottom to pass the size takes both children as subtrees
+    if (left_size <= subtree_size && right_size <= subtree_size && size > subtree_size)
+    {
+        subtree_roots[(*subtree_count)++] = tree->left[node_index];
+        subtree_roots[(*subtree_count)++] = tree->right[node_index];
+        tree->b_subtree_roots[tree->left[node_index]] = 1;
+        tree->b_subtree_roots[tree->right[node_index]] = 1;
+    }
+
+    // anything past the size is never part of a subtree further up
+    return size > subtree_size ? UINT32_MAX / 2 : size;
+}
+
+static uint32_t mt__bvh_treelet_flatten(const MT_BVHTreeletTree *tree, uint32_t node_index, MT_BVHNode *out_nodes, uint32_t *out_count)
+{
+    uint32_t out_index = (*out_count)++;
+    out_nodes[out_index] = tree->nodes[node_index];
+
+    if (tree->nodes[node_index].prim_count == 0)
+    {
+        mt__bvh_treelet_flatten(tree, tree->left[node_index], out_nodes, out_count);
+        out_nodes[out_index].index = mt__bvh_treelet_flatten(tree, tree->right[node_index], out_nodes, out_count);
+    }
+
+    return out_index;
+}
+
+static void mt__bvh_optimize_treelets(MT_BVH *bvh, const MT_BVHSettings *settings)
+{
+    MT_BVHTreeletTree tree;
+    tree.nodes = bvh->nodes;
+    tree.left = (uint32_t *)malloc(sizeof(uint32_t) * bvh->node_count);
+    tree.right = (uint32_t *)malloc(sizeof(uint32_t) * bvh->node_count);
+    tree.costs = (float *)malloc(sizeof(float) * bvh->node_count);
+    tree.b_subtree_roots = (unsigned char *)calloc(bvh->node_count, sizeof(unsigned char));
+
+    for (uint32_t i = 0; i < bvh->node_count; ++i)
+    {
+        tree.left[i] = i + 1;
+        tree.right[i] = bvh->nodes[i].index;
+    }
+
+    mt__bvh_treelet_cost_calculate(&tree, 0);
+
+    unsigned int thread_count = mt__parallel_thread_count(settings->thread_count, bvh->prim_count);
+    uint32_t *subtree_roots = (uint32_t *)malloc(sizeof(uint32_t) * bvh->node_count);
+    uint32_t subtree_count = 0;
+
+    MT_BVHTreeletJob job = {&tree, subtree_roots};
+    for (int pass = 0; pass < settings->treelet_passes; ++pass)
+    {
+        // the serial pass over the top can move nodes between subtrees, so they are found again every pass
+        if (thread_count > 1)
+        {
+            memset(tree.b_subtree_roots, 0, bvh->node_count);
+            subtree_count = 0;
+            mt__bvh_treelet_find_subtrees(&tree, 0, bvh->prim_count / (thread_count * MT_BVH_SUBTREES_PER_THREAD), subtree_roots, &subtree_count);
+        }
+
+        if (subtree_count > 0)
+        {
+            mt__parallel_for(thread_count < subtree_count ? thread_count : subtree_count, subtree_count, mt__bvh_treelet_optimize_range, &job);
+        }
+        mt__bvh_treelet_optimize(&tree, 0, subtree_count > 0);
+    }
+
+    MT_BVHNode *nodes = (MT_BVHNode *)malloc(sizeof(MT_BVHNode) * bvh->node_count);
+    uint32_t node_count = 0;
+    mt__bvh_treelet_flatten(&tree, 0, nodes, &node_count);
+
+    free(bvh->nodes);
+    bvh->nodes = nodes;
+
+    free(tree.left);
+    free(tree.right);
+    free(tree.costs);
+    free(tree.b_subtree_roots);
+    free(subtree_roots);
+}
+
+// padding is only applied by the morton builder, the sah builders always use tight bounds
+// split_fn is only used by the sbvh builder, which clips plain bounds without it
+static MT_BVH *mt__bvh_build(const MT_BVHSettings *settings, const MT_Bounds *prim_bounds, const MT_Vec3 *prim_positions, int prim_count, float padding, MT_BVHSplitFn split_fn, const void *split_data)
+{
+    if (prim_count <= 0)
+    {
+        return NULL;
+    }
+
+    // spatial splits can reference a primitive from several leaves, up to the budget
+    int max_refs = prim_count;
+    if (settings->builder == MT_BVH_BUILDER_SBVH)
+    {
+        max_refs += (int)(prim_count * settings->split_budget);
+    }
+
+    // a binary tree never has more than 2n - 1 nodes, trimmed once built
+    MT_BVH *bvh = (MT_BVH *)malloc(sizeof(MT_BVH));
+    bvh->nodes = (MT_BVHNode *)malloc(sizeof(MT_BVHNode) * (2 * max_refs - 1));
+    bvh->node_count = 0;
+    bvh->wide_nodes = NULL;
+    bvh->quantized_nodes = NULL;
+    bvh->wide_node_count = 0;
+    bvh->max_depth = 0;
+    bvh->wide_max_depth = 0;
+    bvh->prims = (uint32_t *)malloc(sizeof(uint32_t) * max_refs);
+    bvh->prim_count = prim_count;
+    bvh->wide_slots = NULL;
+    bvh->padding = settings->builder == MT_BVH_BUILDER_MORTON ? padding : 0.0f;
+    bvh->sah_sum = 0.0;
+    bvh->b_borrowed = 0;
+
+    double build_start = mt__time_ms();
+
+    switch (settings->builder)
+    {
+    case MT_BVH_BUILDER_SAH:
+        mt__bvh_build_sah(bvh, settings, prim_bounds, prim_count);
+        break;
+    case MT_BVH_BUILDER_SBVH:
+        mt__bvh_build_sbvh(bvh, settings, prim_bounds, prim_count, split_fn, split_data);
+        bvh->prims = (uint32_t *)realloc(bvh->prims, sizeof(uint32_t) * bvh->prim_count);
+        break;
+    case MT_BVH_BUILDER_MORTON:
+    default:
+        mt__bvh_build_morton(bvh, settings, prim_bounds, prim_positions, prim_count, padding);
+        break;
+    }
+
+    bvh->nodes = (MT_BVHNode *)realloc(bvh->nodes, sizeof(MT_BVHNode) * bvh->node_count);
+
+    double treelet_start = mt__time_ms();
+    if (settings->treelet_passes > 0 && bvh->node_count > 1)
+    {
+        mt__bvh_optimize_treelets(bvh, settings);
+    }
+    bvh->treelet_ms = (float)(mt__time_ms() - treelet_start);
+
+    // parents always come before their children so depths and parents can be filled in one forward pass
+    uint32_t *depths = (uint32_t *)malloc(sizeof(uint32_t) * bvh->node_count);
+    bvh->parents = (uint32_t *)malloc(sizeof(uint32_t) * bvh->node_count);
+    depths[0] = 1;
+    bvh->parents[0] = 0;
+    for (uint32_t i = 0; i < bvh->node_count; ++i)
+    {
+        const MT_BVHNode *node = &bvh->nodes[i];
+
+        if (depths[i] > bvh->max_depth)
+        {
+            bvh->max_depth = depths[i];
+        }
+
+        bvh->sah_sum += mt__bvh_node_sah_weight(node) * mt__bounds_area(node->bounds);
+
+        if (node->prim_count == 0)
+        {
+            depths[i + 1] = depths[i] + 1;
+            depths[node->index] = depths[i] + 1;
+            bvh->parents[i + 1] = i;
+            bvh->parents[node->index] = i;
+        }
+    }
+    free(depths);
+
+    bvh->build_sah_cost = mt__bvh_sah_cost(bvh);
+
+    // a binary traversal keeps at most one node per level, a wide one at most every child but one per level
+    bvh->stack_size = bvh->max_depth + 1;
+
+    if (settings->b_wide || settings->b_quantized)
+    {
+        bvh->wide_nodes = (MT_BVHWideNode *)malloc(sizeof(MT_BVHWideNode) * bvh->node_count);
+        bvh->wide_slots = (uint32_t *)malloc(sizeof(uint32_t) * bvh->node_count);
+        memset(bvh->wide_slots, 0xFF, sizeof(uint32_t) * bvh->node_count);
+        mt__bvh_collapse_wide(bvh, 0, 1);
+        bvh->wide_nodes = (MT_BVHWideNode *)realloc(bvh->wide_nodes, sizeof(MT_BVHWideNode) * bvh->wide_node_count);
+        bvh->stack_size = bvh->wide_max_depth * (MT_BVH_WIDTH - 1) + 1;
+
+        if (settings->b_quantized)
+        {
+            mt__bvh_quantize_wide(bvh);
+        }
+    }
+
+    bvh->build_ms = (float)(mt__time_ms() - build_start);
+
+    return bvh;
+}
+
+// bounds the parts of a tri on either side of a plane from its corners and the points its edges cross the plane at
+static void mt__tri_split_bounds(const void *data, uint32_t prim, int axis, float position, MT_Bounds *out_left, MT_Bounds *out_right)
+{
+    const MT_Mesh *mesh = (const MT_Mesh *)data;
+    MT_Vec3 p[3];
+    mt__mesh_tri_corners(mesh, prim, p);
+
+    *out_left = mt__bounds_create_invalid();
+    *out_right = mt__bounds_create_invalid();
+
+    for (int i = 0; i < 3; ++i)
+    {
+        MT_Vec3 a = p[i];
+        MT_Vec3 b = p[(i + 1) % 3];
+        float a_pos = mt__vec3_axis(a, axis);
+        float b_pos = mt__vec3_axis(b, axis);
+
+        if (a_pos <= position)
+        {
+            mt__bounds_shift_point(a, out_left);
+        }
+        if (a_pos >= position)
+        {
+            mt__bounds_shift_point(a, out_right);
+        }
+
+        if ((a_pos < position && b_pos > position) || (a_pos > position && b_pos < position))
+        {
+            MT_Vec3 crossing = mt_vec3_lerp(a, b, (position - a_pos) / (b_pos - a_pos));
+            mt__vec3_set_axis(&crossing, axis, position);
+            mt__bounds_shift_point(crossing, out_left);
+            mt__bounds_shift_point(crossing, out_right);
+        }
+    }
+}
+
+static void mt__mesh_estimate_cost(MT_Mesh *mesh);
+static void mt__world_estimate_cost(MT_World *world);
+
+static void mt__mesh_recalculate_bvh(MT_Mesh *mesh, const MT_BVHSettings *settings)
+{
+    // a streamed mesh's tree was built when its file was written and is the only way to its tris
+    if (mesh->stream)
+    {
+        mesh->b_bvh_dirty = 0;
+        return;
+    }
+
+    mt__bvh_delete(mesh->bvh);
+    mesh->bvh = NULL;
+    mesh->b_bvh_dirty = 0;
+
+    mt__mesh_weld_vertices(mesh);
+
+    if (mesh->tri_index < MT_BVH_MESH_MIN_TRIS)
+    {
+        mt__mesh_update_tri_blocks(mesh);
+        mt__mesh_estimate_cost(mesh);
+        return;
+    }
+
+    MT_Bounds *tri_bounds = (MT_Bounds *)malloc(sizeof(MT_Bounds) * mesh->tri_index);
+    MT_Vec3 *tri_centers = (MT_Vec3 *)malloc(sizeof(MT_Vec3) * mesh->tri_index);
+
+    for (uint32_t i = 0; i < mesh->tri_index; ++i)
+    {
+        MT_Vec3 p[3];
+        mt__mesh_tri_corners(mesh, i, p);
+
+        tri_bounds[i] = mt__bounds_create_invalid();
+        mt__bounds_shift_mesh_tri(mesh, i, &tri_bounds[i]);
+        tri_centers[i] = mt_vec3_div_v(mt_vec3_add(mt_vec3_add(p[0], p[1]), p[2]), 3.0f);
+    }
+
+    mesh->bvh = mt__bvh_build(settings, tri_bounds, tri_centers, mesh->tri_index, MT_BVH_TRI_PADDING, mt__tri_split_bounds, mesh);
+
+    free(tri_bounds);
+    free(tri_centers);
+
+    mt__mesh_estimate_cost(mesh);
+
+    // store the triangles in leaf order so a leaf reads one contiguous run of them, and their vertices in the order those runs use them
+    // with tris referenced from several leaves the tree keeps its prims to look them up through instead
+    if (mesh->bvh->prim_count == mesh->tri_index)
+    {
+        mt__mesh_permute_tris(mesh, mesh->bvh->prims);
+        mt__mesh_reorder_vertices(mesh);
+
+        free(mesh->bvh->prims);
+        mesh->bvh->prims = NULL;
+    }
+
+    mt__mesh_update_tri_blocks(mesh);
+}
+
+// sorts the tris along a morton curve through their centers and renumbers the vertices to match, so nearby tris sit together in memory
+// meshes with a bvh are put in leaf order whenever it is built anyway, this is for the ones tested tri by tri
+void mt_mesh_reorder_tris(MT_Mesh *mesh)
+{
+    if (mesh->stream || mesh->tri_index < 2)
+    {
+        return;
+    }
+
+    mt__mesh_weld_vertices(mesh);
+
+    MT_Bounds *tri_bounds = (MT_Bounds *)malloc(sizeof(MT_Bounds) * mesh->tri_index);
+    MT_Vec3 *tri_centers = (MT_Vec3 *)malloc(sizeof(MT_Vec3) * mesh->tri_index);
+    for (uint32_t i = 0; i < mesh->tri_index; ++i)
+    {
+        MT_Vec3 p[3];
+        mt__mesh_tri_corners(mesh, i, p);
+
+        tri_bounds[i] = mt__bounds_create_invalid();
+        mt__bounds_shift_mesh_tri(mesh, i, &tri_bounds[i]);
+        tri_centers[i] = mt_vec3_div_v(mt_vec3_add(mt_vec3_add(p[0], p[1]), p[2]), 3.0f);
+    }
+
+    MT_Bounds bounds;
+    MT_BVHMortonJob job;
+    job.prim_bounds = tri_bounds;
+    job.prim_positions = tri_centers;
+    job.mortons = (MT_BVHMorton *)malloc(sizeof(MT_BVHMorton) * mesh->tri_index);
+    job.thread_bounds = &bounds;
+
+    mt__bvh_morton_bounds_range(&job, 0, mesh->tri_index, 0);
+    job.bounds = bounds;
+    job.bound_size.x = fmaxf(bounds.end.x - bounds.start.x, MT_EPSILON);
+    job.bound_size.y = fmaxf(bounds.end.y - bounds.start.y, MT_EPSILON);
+    job.bound_size.z = fmaxf(bounds.end.z - bounds.start.z, MT_EPSILON);
+
+    mt__bvh_morton_code_range(&job, 0, mesh->tri_index, 0);
+    mt__bvh_radix_sort(job.mortons, mesh->tri_index, 1);
+
+    uint32_t *order = (uint32_t *)malloc(sizeof(uint32_t) * mesh->tri_index);
+    for (uint32_t i = 0; i < mesh->tri_index; ++i)
+    {
+        order[i] = job.mortons[i].prim_index;
+    }
+
+    mt__mesh_permute_tris(mesh, order);
+    mt__mesh_reorder_vertices(mesh);
+
+    free(order);
+    free(job.mortons);
+    free(tri_bounds);
+    free(tri_centers);
+
+    // the old tree indexes tris by their old position, so it cannot be refit
+    mt__bvh_delete(mesh->bvh);
+    mesh->bvh = NULL;
+    mesh->b_bvh_dirty = 1;
+}
+
+// changes one node's bounds, keeping the sah sum and the wide copy of the bounds in step
+static void mt__bvh_node_set_bounds(MT_BVH *bvh, uint32_t node_index, MT_Bounds bounds)
+{
+    MT_BVHNode *node = &bvh->nodes[node_index];
+    bvh->sah_sum += mt__bvh_node_sah_weight(node) * (mt__bounds_area(bounds) - mt__bounds_area(node->bounds));
+    node->bounds = bounds;
+
+    if (bvh->quantized_nodes && bvh->wide_slots[node_index] != UINT32_MAX)
+    {
+        MT_BVHQuantizedNode *quantized = &bvh->quantized_nodes[bvh->wide_slots[node_index] / MT_BVH_WIDTH];
+        int lane = bvh->wide_slots[node_index] % MT_BVH_WIDTH;
+
+        MT_Vec3 grid_end = mt_vec3_add(quantized->origin, mt_vec3_mult_v(quantized->scale, MT_BVH_QUANTIZE_MAX));
+        int b_inside = bounds.start.x >= quantized->origin.x && bounds.start.y >= quantized->origin.y && bounds.start.z >= quantized->origin.z &&
+                       bounds.end.x <= grid_end.x && bounds.end.y <= grid_end.y && bounds.end.z <= grid_end.z;
+
+        // a lane that outgrew the node's grid moves every lane to a new one, the others are carried over from their decoded bounds
+        if (b_inside)
+        {
+            mt__bvh_quantize_lane(quantized, lane, bounds);
+        }
+        else
+        {
+            MT_Bounds lanes[MT_BVH_WIDTH];
+            for (uint32_t i = 0; i < quantized->child_count; ++i)
+            {
+                lanes[i] = mt__bvh_dequantize_lane(quantized, i);
+            }
+            lanes[lane] = bounds;
+            mt__bvh_quantize_node(quantized, lanes, quantized->child_count);
+        }
+    }
+    else if (bvh->wide_slots && bvh->wide_slots[node_index] != UINT32_MAX)
+    {
+        MT_BVHWideNode *wide = &bvh->wide_nodes[bvh->wide_slots[node_index] / MT_BVH_WIDTH];
+        int lane = bvh->wide_slots[node_index] % MT_BVH_WIDTH;
+
+        wide->min_x[lane] = bounds.start.x;
+        wide->min_y[lane] = bounds.start.y;
+        wide->min_z[lane] = bounds.start.z;
+        wide->max_x[lane] = bounds.end.x;
+        wide->max_y[lane] = bounds.end.y;
+        wide->max_z[lane] = bounds.end.z;
+    }
+}
+
+static MT_Bounds mt__bvh_pad_bounds(const MT_BVH *bvh, MT_Bounds bounds)
+{
+    bounds.start = mt_vec3_sub_v(bounds.start, bvh->padding);
+    bounds.end = mt_vec3_add_v(bounds.end, bvh->padding);
+    return bounds;
+}
+
+// refits one leaf and walks up its parents, stopping early once a parent's bounds no longer change
+static void mt__bvh_refit_leaf(MT_BVH *bvh, uint32_t node_index, const MT_Bounds *prim_bounds)
+{
+    const MT_BVHNode *leaf = &bvh->nodes[node_index];
+
+    MT_Bounds bounds = mt__bounds_create_invalid();
+    for (uint32_t i = leaf->index; i < leaf->index + leaf->prim_count; ++i)
+    {
+        bounds = mt__bounds_union(bounds, prim_bounds[bvh->prims[i]]);
+    }
+    mt__bvh_node_set_bounds(bvh, node_index, mt__bvh_pad_bounds(bvh, bounds));
+
+    while (node_index != 0)
+    {
+        node_index = bvh->parents[node_index];
+        const MT_BVHNode *node = &bvh->nodes[node_index];
+
+        bounds = mt__bounds_union(bvh->nodes[node_index + 1].bounds, bvh->nodes[node->index].bounds);
+        if (memcmp(&bounds, &node->bounds, sizeof(MT_Bounds)) == 0)
+        {
+            break;
+        }
+        mt__bvh_node_set_bounds(bvh, node_index, bounds);
+    }
+}
+
+// every triangle of a moved mesh has moved, so its whole tree is refit in one backwards pass
+// the mesh's tris are stored in leaf order, children always come after their parent
+static void mt__mesh_refit_bvh(MT_Mesh *mesh, const MT_BVHSettings *settings)
+{
+    // spatially split trees are rebuilt, their clipped leaf bounds would not survive the tris moving
+    MT_BVH *bvh = mesh->bvh;
+    if (!bvh || bvh->prims || bvh->prim_count != mesh->tri_index)
+    {
+        mt__mesh_recalculate_bvh(mesh, settings);
+        return;
+    }
+
+    for (uint32_t i = bvh->node_count; i-- > 0;)
+    {
+        const MT_BVHNode *node = &bvh->nodes[i];
+        MT_Bounds bounds = mt__bounds_create_invalid();
+
+        if (node->prim_count > 0)
+        {
+            for (uint32_t j = node->index; j < node->index + node->prim_count; ++j)
+            {
+                mt__bounds_shift_mesh_tri(mesh, j, &bounds);
+            }
+            bounds = mt__bvh_pad_bounds(bvh, bounds);
+        }
+        else
+        {
+            bounds = mt__bounds_union(bvh->nodes[i + 1].bounds, bvh->nodes[node->index].bounds);
+        }
+
+        mt__bvh_node_set_bounds(bvh, i, bounds);
+    }
+
+    mt__mesh_update_tri_blocks(mesh);
+    mesh->b_bvh_dirty = 0;
+
+    if (mt__bvh_sah_cost(bvh) > MT_BVH_REFIT_MAX_COST_GROWTH * bvh->build_sah_cost)
+    {
+        mt__mesh_recalculate_bvh(mesh, settings);
+    }
+}
+
+// stores sphere i where sphere order[i] was
+static void mt__sphere_cloud_permute(MT_SphereCloud *cloud, const uint32_t *order)
+{
+    mt__sphere_cloud_detach(cloud);
+
+    MT_SphereBlock *blocks = mt__sphere_blocks_create(cloud->max_spheres);
+    uint32_t *sphere_materials = (uint32_t *)malloc(sizeof(uint32_t) * (cloud->max_spheres > 0 ? cloud->max_spheres : 1));
+
+    for (uint32_t i = 0; i < cloud->sphere_index; ++i)
+    {
+        const MT_SphereBlock *src = &cloud->blocks[order[i] / MT_TRI_BLOCK_WIDTH];
+        uint32_t src_lane = order[i] % MT_TRI_BLOCK_WIDTH;
+        MT_SphereBlock *dst = &blocks[i / MT_TRI_BLOCK_WIDTH];
+        uint32_t dst_lane = i % MT_TRI_BLOCK_WIDTH;
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            dst->center[axis][dst_lane] = src->center[axis][src_lane];
+        }
+        dst->radius[dst_lane] = src->radius[src_lane];
+        sphere_materials[i] = cloud->sphere_materials[order[i]];
+    }
+
+    mt__aligned_free(cloud->blocks);
+    free(cloud->sphere_materials);
+    cloud->blocks = blocks;
+    cloud->sphere_materials = sphere_materials;
+}
+
+static void mt__sphere_cloud_estimate_cost(MT_SphereCloud *cloud);
+
+static void mt__sphere_cloud_recalculate_bvh(MT_SphereCloud *cloud, const MT_BVHSettings *settings)
+{
+    mt__bvh_delete(cloud->bvh);
+    cloud->bvh = NULL;
+    cloud->b_bvh_dirty = 0;
+
+    if (cloud->sphere_index < MT_BVH_CLOUD_MIN_SPHERES)
+    {
+        mt__sphere_cloud_estimate_cost(cloud);
+        return;
+    }
+
+    MT_Bounds *sphere_bounds = (MT_Bounds *)malloc(sizeof(MT_Bounds) * cloud->sphere_index);
+    MT_Vec3 *sphere_centers = (MT_Vec3 *)malloc(sizeof(MT_Vec3) * cloud->sphere_index);
+
+    for (uint32_t i = 0; i < cloud->sphere_index; ++i)
+    {
+        sphere_bounds[i] = mt__bounds_create_invalid();
+        mt__bounds_shift_cloud_sphere(cloud, i, &sphere_bounds[i]);
+        sphere_centers[i] = mt__sphere_cloud_center(cloud, i);
+    }
+
+    // leaves of up to a block of spheres, which the kernel tests as cheaply as one
+    MT_BVHSettings cloud_settings = *settings;
+    if (cloud_settings.max_leaf_size < MT_TRI_BLOCK_WIDTH)
+    {
+        cloud_settings.max_leaf_size = MT_TRI_BLOCK_WIDTH;
+    }
+    cloud->bvh = mt__bvh_build(&cloud_settings, sphere_bounds, sphere_centers, cloud->sphere_index, 0.0f, NULL, NULL);
+
+    free(sphere_bounds);
+    free(sphere_centers);
+
+    mt__sphere_cloud_estimate_cost(cloud);
+
+    // store the spheres in leaf order so a leaf is one contiguous run of lanes, split trees keep their prims to look them up through
+    if (cloud->bvh->prim_count == cloud->sphere_index)
+    {
+        mt__sphere_cloud_permute(cloud, cloud->bvh->prims);
+        free(cloud->bvh->prims);
+        cloud->bvh->prims = NULL;
+    }
+}
+
+// updates the object's cached bounds, refitting or rebuilding its own triangle bvh first
+static void mt__world_update_object_bounds(MT_World *world, int object_id, int b_refit, const MT_BVHSettings *settings, MT_Vec3 *out_position)
+{
+    MT_Bounds *bounds = &world->object_bounds[object_id];
+    MT_Vec3 position;
+
+    switch (world->objects_track[object_id])
+    {
+    case MT_OBJECT_MESH:
+        MT_Mesh *mesh = (MT_Mesh *)world->objects[object_id];
+        if (b_refit)
+        {
+            mt__mesh_refit_bvh(mesh, settings);
+        }
+        else
+        {
+            mt__mesh_recalculate_bvh(mesh, settings);
+        }
+        *bounds = mesh->bvh ? mesh->bvh->nodes[0].bounds : mt__bounds_calculate_mesh(mesh);
+        position = mesh->origin_offset;
+        break;
+    case MT_OBJECT_SPHERE:
+        MT_Sphere *sphere = (MT_Sphere *)world->objects[object_id];
+        *bounds = mt__bounds_calculate_sphere(sphere);
+        position = sphere->position;
+        break;
+    case MT_OBJECT_BOX:
+        MT_Box *box = (MT_Box *)world->objects[object_id];
+        *bounds = mt__bounds_calculate_box(box);
+        position = box->position;
+        break;
+    case MT_OBJECT_PLANE:
+        // left out of the world bvh and grid, rays find the plane through world->unbounded_objects
+        MT_Plane *plane = (MT_Plane *)world->objects[object_id];
+        bounds->start = plane->position;
+        bounds->end = plane->position;
+        position = plane->position;
+        break;
+    case MT_OBJECT_SPHERE_CLOUD:
+        // its spheres can only be added or cleared, so a refit rebuilds the tree if anything changed
+        MT_SphereCloud *cloud = (MT_SphereCloud *)world->objects[object_id];
+        if (!b_refit || cloud->b_bvh_dirty)
+        {
+            mt__sphere_cloud_recalculate_bvh(cloud, settings);
+        }
+        *bounds = cloud->bvh ? cloud->bvh->nodes[0].bounds : mt__bounds_calculate_sphere_cloud(cloud);
+        position = mt__bounds_center(*bounds);
+        break;
+    case MT_OBJECT_INSTANCE:
+        // shared meshes are only rebuilt once no matter how many instances reference them
+        MT_Instance *instance = (MT_Instance *)world->objects[object_id];
+        if (instance->mesh->b_bvh_dirty)
+        {
+            if (b_refit)
+            {
+                mt__mesh_refit_bvh(instance->mesh, settings);
+            }
+            else
+            {
+                mt__mesh_recalculate_bvh(instance->mesh, settings);
+            }
+        }
+        *bounds = mt__bounds_calculate_instance(instance);
+        position = mt__bounds_center(*bounds);
+        break;
+    }
+
+    if (out_position)
+    {
+        *out_position = position;
+    }
+}
+
+typedef struct MT_WorldBoundsJob
+{
+    MT_World *world;
+    const MT_BVHSettings *settings;
+    MT_Vec3 *positions;
+} MT_WorldBoundsJob;
+
+static void mt__world_update_bounds_range(void *data, unsigned int start, unsigned int end, unsigned int thread_index)
+{
+    MT_WorldBoundsJob *job = (MT_WorldBoundsJob *)data;
+
+    for (unsigned int i = start; i < end; ++i)
+    {
+        mt__world_update_object_bounds(job->world, i, 0, job->settings, &job->positions[i]);
+    }
+}
+
+// finds the leaves holding each object for refits, every one of them for objects the sbvh builder split between leaves
+// bvh_object_count must already be set, planes are in no leaf and keep leaf 0
+static void mt__world_index_leaves(MT_World *world)
+{
+    const MT_BVH *bvh = world->bvh;
+
+    free(world->leaf_ref_starts);
+    free(world->leaf_refs);
+    world->leaf_ref_starts = NULL;
+    world->leaf_refs = NULL;
+
+    memset(world->object_leaves, 0, sizeof(uint32_t) * world->bvh_object_count);
+    if (!bvh)
+    {
+        return;
+    }
+
+    uint32_t *starts = (uint32_t *)calloc(world->bvh_object_count + 1, sizeof(uint32_t));
+    int b_split = 0;
+    for (uint32_t i = 0; i < bvh->node_count; ++i)
+    {
+        const MT_BVHNode *node = &bvh->nodes[i];
+        for (uint32_t j = node->index; j < node->index + node->prim_count; ++j)
+        {
+            world->object_leaves[bvh->prims[j]] = i;
+            if (++starts[bvh->prims[j] + 1] > 1)
+            {
+                b_split = 1;
+            }
+        }
+    }
+
+    if (!b_split)
+    {
+        free(starts);
+        return;
+    }
+
+    world->leaf_ref_starts = starts;
+    world->leaf_refs = (uint32_t *)malloc(sizeof(uint32_t) * bvh->prim_count);
+    for (uint32_t i = 0; i < world->bvh_object_count; ++i)
+    {
+        world->leaf_ref_starts[i + 1] += world->leaf_ref_starts[i];
+    }
+
+    uint32_t *cursors = (uint32_t *)malloc(sizeof(uint32_t) * (world->bvh_object_count > 0 ? world->bvh_object_count : 1));
+    memcpy(cursors, world->leaf_ref_starts, sizeof(uint32_t) * world->bvh_object_count);
+    for (uint32_t i = 0; i < bvh->node_count; ++i)
+    {
+        const MT_BVHNode *node = &bvh->nodes[i];
+        for (uint32_t j = node->index; j < node->index + node->prim_count; ++j)
+        {
+            world->leaf_refs[cursors[bvh->prims[j]]++] = i;
+        }
+    }
+    free(cursors);
+}
+
+void mt_world_recalculate_bvh(MT_World *world)
+{
+    if (world->object_index <= 0)
+    {
+        return;
+    }
+
+    // instances can share a mesh, so their meshes are rebuilt here rather than by whichever thread reaches them first
+    for (unsigned int i = 0; i < world->object_index; ++i)
+    {
+        if (world->objects_track[i] == MT_OBJECT_INSTANCE)
+        {
+            MT_Instance *instance = (MT_Instance *)world->objects[i];
+            if (instance->mesh->b_bvh_dirty)
+            {
+                mt__mesh_recalculate_bvh(instance->mesh, &world->bvh_settings);
+            }
+        }
+    }
+
+    // with enough objects to split between threads each mesh's tree is built by one thread
+    unsigned int thread_count = mt__parallel_thread_count(world->bvh_settings.thread_count, world->object_index);
+    MT_BVHSettings object_settings = world->bvh_settings;
+    if (thread_count > 1)
+    {
+        object_settings.thread_count = 1;
+    }
+
+    MT_WorldBoundsJob job = {world, &object_settings, (MT_Vec3 *)malloc(sizeof(MT_Vec3) * world->object_index)};
+    mt__parallel_for(thread_count, world->object_index, mt__world_update_bounds_range, &job);
+    MT_Vec3 *object_positions = job.positions;
+
+    // planes are tested before every traversal, so the tree is built over the bounded objects only
+    MT_Bounds *bounds = world->object_bounds;
+    MT_Vec3 *positions = object_positions;
+    uint32_t *bounded = NULL;
+    unsigned int bounded_count = world->object_index;
+    if (world->unbounded_count > 0)
+    {
+        bounded = (uint32_t *)malloc(sizeof(uint32_t) * world->object_index);
+        bounds = (MT_Bounds *)malloc(sizeof(MT_Bounds) * world->object_index);
+        positions = (MT_Vec3 *)malloc(sizeof(MT_Vec3) * world->object_index);
+        bounded_count = 0;
+        for (unsigned int i = 0; i < world->object_index; ++i)
+        {
+            if (world->objects_track[i] != MT_OBJECT_PLANE)
+            {
+                bounded[bounded_count] = i;
+                bounds[bounded_count] = world->object_bounds[i];
+                positions[bounded_count] = object_positions[i];
+                ++bounded_count;
+            }
+        }
+    }
+
+    mt__bvh_delete(world->bvh);
+    world->bvh = mt__bvh_build(&world->bvh_settings, bounds, positions, bounded_count, MT_BVH_OBJECT_PADDING, NULL, NULL);
+    world->bvh_object_count = world->object_index;
+
+    if (bounded)
+    {
+        if (world->bvh)
+        {
+            for (uint32_t i = 0; i < world->bvh->prim_count; ++i)
+            {
+                world->bvh->prims[i] = bounded[world->bvh->prims[i]];
+            }
+        }
+        free(bounded);
+        free(bounds);
+        free(positions);
+    }
+
+    // the bounds were all worked out again, the grid may have been built over older ones
+    world->b_grid_dirty = 1;
+
+    mt__world_index_leaves(world);
+
+    // a full rebuild already picked up every pending change
+    for (unsigned int i = 0; i < world->dirty_count; ++i)
+    {
+        world->objects_dirty[world->dirty_objects[i]] = 0;
+    }
+    world->dirty_count = 0;
+
+    mt__world_estimate_cost(world);
+
+    free(object_positions);
+}
+
+// updates only the objects marked dirty and the nodes above them
+// an object the sbvh split between leaves is refit to its whole bounds in each of them, so moving one loosens the tree quickly
+// falls back to a full rebuild if objects were added since the last one or the tree got too loose
+void mt_world_refit_bvh(MT_World *world)
+{
+    if (world->bvh_object_count != world->object_index)
+    {
+        mt_world_recalculate_bvh(world);
+        return;
+    }
+
+    if (world->dirty_count > 0)
+    {
+        world->b_grid_dirty = 1;
+    }
+
+    for (unsigned int i = 0; i < world->dirty_count; ++i)
+    {
+        unsigned int object_id = world->dirty_objects[i];
+        world->objects_dirty[object_id] = 0;
+
+        mt__world_update_object_bounds(world, object_id, 1, &world->bvh_settings, NULL);
+        if (!world->bvh || world->objects_track[object_id] == MT_OBJECT_PLANE)
+        {
+            continue;
+        }
+
+        if (world->leaf_refs)
+        {
+            for (uint32_t j = world->leaf_ref_starts[object_id]; j < world->leaf_ref_starts[object_id + 1]; ++j)
+            {
+                mt__bvh_refit_leaf(world->bvh, world->leaf_refs[j], world->object_bounds);
+            }
+        }
+        else
+        {
+            mt__bvh_refit_leaf(world->bvh, world->object_leaves[object_id], world->object_bounds);
+        }
+    }
+    world->dirty_count = 0;
+
+    if (world->bvh && mt__bvh_sah_cost(world->bvh) > MT_BVH_REFIT_MAX_COST_GROWTH * world->bvh->build_sah_cost)
+    {
+        mt_world_recalculate_bvh(world);
+    }
+}
+
+static void mt__bvh_node_stats(MT_BVH *bvh, uint32_t node_index, unsigned int depth, float root_area, MT_BVHStats *stats)
+{
+    MT_BVHNode *node = &bvh->nodes[node_index];
+    float area_ratio = root_area > 0.0f ? mt__bounds_area(node->bounds) / root_area : 1.0f;
+
+    ++stats->node_count;
+    if (depth > stats->max_depth)
+    {
+        stats->max_depth = depth;
+    }
+
+    if (node->prim_count > 0)
+    {
+        ++stats->leaf_count;
+        stats->sah_cost += area_ratio * node->prim_count * MT_BVH_SAH_INTERSECT_COST;
+        return;
+    }
+
+    stats->sah_cost += area_ratio * MT_BVH_SAH_TRAVERSAL_COST;
+    mt__bvh_node_stats(bvh, node_index + 1, depth + 1, root_area, stats);
+    mt__bvh_node_stats(bvh, node->index, depth + 1, root_area, stats);
+}
+
+MT_BVHStats mt_world_get_bvh_stats(MT_World *world)
+{
+    MT_BVHStats stats = {0};
+
+    if (!world->bvh)
+    {
+        return stats;
+    }
+
+    mt__bvh_node_stats(world->bvh, 0, 1, mt__bounds_area(world->bvh->nodes[0].bounds), &stats);
+    stats.build_ms = world->bvh->build_ms;
+    stats.treelet_ms = world->bvh->treelet_ms;
+    stats.brute_ray_ns = world->brute_ray_cost;
+    stats.bvh_ray_ns = world->bvh_ray_cost;
+
+    MT_BVH *bvh = world->bvh;
+    stats.wide_node_bytes = sizeof(MT_BVHWideNode) * bvh->wide_node_count;
+    if (bvh->quantized_nodes)
+    {
+        stats.node_bytes = sizeof(MT_BVHQuantizedNode) * bvh->wide_node_count;
+    }
+    else if (bvh->wide_nodes)
+    {
+        stats.node_bytes = stats.wide_node_bytes;
+    }
+    else
+    {
+        stats.node_bytes = sizeof(MT_BVHNode) * bvh->node_count;
+    }
+    return stats;
+}
+
+typedef struct MT_BVHStackEntry
+{
+    uint32_t index;
+    uint32_t prim_count; // non zero if this entry is a leaf waiting to be tested
+    float t;             // distance the ray enters it at
+} MT_BVHStackEntry;
+
+// returns the closest hit distance found so far, nodes entered past it are skipped
+typedef float (*MT_BVHLeafFn)(void *data, MT_Ray *ray, uint32_t prim_start, uint32_t prim_count);
+
+// front to back, the nearer child is visited first and the farther one is only kept if it may still be closer than a hit
+static float mt__bvh_traverse_binary(const MT_BVH *bvh, const MT_RaySlab *slab, MT_Ray *ray, float t_max, MT_BVHLeafFn leaf_fn, void *data, MT_BVHStackEntry *stack)
+{
+    const MT_BVHNode *nodes = bvh->nodes;
+    int stack_ptr = 0;
+
+    if (mt__ray_hit_bounds(slab, &nodes[0].bounds, t_max) == INFINITY)
+    {
+        return t_max;
+    }
+
+    uint32_t node_index = 0;
+    while (1)
+    {
+        const MT_BVHNode *node = &nodes[node_index];
+
+        if (node->prim_count > 0)
+        {
+            t_max = leaf_fn(data, ray, node->index, node->prim_count);
+        }
+        else
+        {
+            uint32_t near_index = node_index + 1;
+            uint32_t far_index = node->index;
+            float t_near = mt__ray_hit_bounds(slab, &nodes[near_index].bounds, t_max);
+            float t_far = mt__ray_hit_bounds(slab, &nodes[far_index].bounds, t_max);
+
+            if (t_far < t_near)
+            {
+                uint32_t temp_index = near_index;
+                near_index = far_index;
+                far_index = temp_index;
+
+                float temp_t = t_near;
+                t_near = t_far;
+                t_far = temp_t;
+            }
+
+            if (t_near != INFINITY)
+            {
+                if (t_far != INFINITY)
+                {
+                    stack[stack_ptr++] = (MT_BVHStackEntry){far_index, 0, t_far};
+                }
+
+                node_index = near_index;
+                continue;
+            }
+        }
+
+        // pop the next node that could still hold a closer hit
+        do
+        {
+            if (stack_ptr == 0)
+            {
+                return t_max;
+            }
+            --stack_ptr;
+        } while (stack[stack_ptr].t > t_max);
+
+        node_index = stack[stack_ptr].index;
+    }
+}
+
+// slab tests every child of a wide node at once, returns a bit per child that was entered before t_max
+// the per axis near and far planes are picked from the ray's sign so no min or max is needed between them
+static inline unsigned int mt__ray_hit_wide_bounds(const MT_BVHWideNode *node, const MT_RaySlab *slab, float t_max, float *t_out)
+{
+    const float *near_x = slab->sign[0] ? node->max_x : node->min_x;
+    const float *near_y = slab->sign[1] ? node->max_y : node->min_y;
+    const float *near_z = slab->sign[2] ? node->max_z : node->min_z;
+    const float *far_x = slab->sign[0] ? node->min_x : node->max_x;
+    const float *far_y = slab->sign[1] ? node->min_y : node->max_y;
+    const float *far_z = slab->sign[2] ? node->min_z : node->max_z;
+
+    unsigned int mask = 0;
+
+    // a nan from 0 * inf is always passed as the first operand, min and max then return the second
+#if MT_BVH_WIDTH == 8 && defined(__AVX__)
+    __m256 o_x = _mm256_set1_ps(slab->origin.x);
+    __m256 o_y = _mm256_set1_ps(slab->origin.y);
+    __m256 o_z = _mm256_set1_ps(slab->origin.z);
+    __m256 i_x = _mm256_set1_ps(slab->inv_dir.x);
+    __m256 i_y = _mm256_set1_ps(slab->inv_dir.y);
+    __m256 i_z = _mm256_set1_ps(slab->inv_dir.z);
+
+    __m256 tmin = _mm256_setzero_ps();
+    tmin = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(near_z), o_z), i_z), tmin);
+    tmin = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(near_y), o_y), i_y), tmin);
+    tmin = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(near_x), o_x), i_x), tmin);
+
+    __m256 tmax = _mm256_set1_ps(t_max);
+    tmax = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(far_z), o_z), i_z), tmax);
+    tmax = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(far_y), o_y), i_y), tmax);
+    tmax = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(far_x), o_x), i_x), tmax);
+
+    _mm256_storeu_ps(t_out, tmin);
+    mask = (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(tmin, tmax, _CMP_LE_OQ));
+#elif defined(__SSE__)
+    __m128 o_x = _mm_set1_ps(slab->origin.x);
+    __m128 o_y = _mm_set1_ps(slab->origin.y);
+    __m128 o_z = _mm_set1_ps(slab->origin.z);
+    __m128 i_x = _mm_set1_ps(slab->inv_dir.x);
+    __m128 i_y = _mm_set1_ps(slab->inv_dir.y);
+    __m128 i_z = _mm_set1_ps(slab->inv_dir.z);
+
+    for (int i = 0; i < MT_BVH_WIDTH; i += 4)
+    {
+        __m128 tmin = _mm_setzero_ps();
+        tmin = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&near_z[i]), o_z), i_z), tmin);
+        tmin = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&near_y[i]), o_y), i_y), tmin);
+        tmin = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&near_x[i]), o_x), i_x), tmin);
+
+        __m128 tmax = _mm_set1_ps(t_max);
+        tmax = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&far_z[i]), o_z), i_z), tmax);
+        tmax = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&far_y[i]), o_y), i_y), tmax);
+        tmax = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&far_x[i]), o_x), i_x), tmax);
+
+        _mm_storeu_ps(&t_out[i], tmin);
+        mask |= (unsigned int)_mm_movemask_ps(_mm_cmple_ps(tmin, tmax)) << i;
+    }
+#else
+    for (int i = 0; i < MT_BVH_WIDTH; ++i)
+    {
+        float tmin = fmaxf((near_x[i] - slab->origin.x) * slab->inv_dir.x, 0.0f);
+        tmin = fmaxf((near_y[i] - slab->origin.y) * slab->inv_dir.y, tmin);
+        tmin = fmaxf((near_z[i] - slab->origin.z) * slab->inv_dir.z, tmin);
+
+        float tmax = fminf((far_x[i] - slab->origin.x) * slab->inv_dir.x, t_max);
+        tmax = fminf((far_y[i] - slab->origin.y) * slab->inv_dir.y, tmax);
+        tmax = fminf((far_z[i] - slab->origin.z) * slab->inv_dir.z, tmax);
+
+        t_out[i] = tmin;
+        mask |= (unsigned int)(tmin <= tmax) << i;
+    }
+#endif
+
+    return mask & ((1u << node->child_count) - 1);
+}
+
+#if defined(__SSE2__)
+// widens 4 quantized values to floats
+static inline __m128 mt__bvh_dequantize4(const MT_BVHQuant *q)
+{
+#if MT_BVH_QUANTIZE_BITS == 16
+    __m128i v = _mm_loadl_epi64((const __m128i *)q);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+#else
+    int32_t bits;
+    memcpy(&bits, q, sizeof(bits));
+    __m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bits), _mm_setzero_si128());
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+#endif
+}
+#endif
+
+// same test as the float wide node, each plane is decoded as origin + q * scale first
+// the origin is moved to the ray's origin once per node so decoding costs one multiply add per plane
+static inline unsigned int mt__ray_hit_quantized_bounds(const MT_BVHQuantizedNode *node, const MT_RaySlab *slab, float t_max, float *t_out)
+{
+    const MT_BVHQuant *near_x = slab->sign[0] ? node->max_x : node->min_x;
+    const MT_BVHQuant *near_y = slab->sign[1] ? node->max_y : node->min_y;
+    const MT_BVHQuant *near_z = slab->sign[2] ? node->max_z : node->min_z;
+    const MT_BVHQuant *far_x = slab->sign[0] ? node->min_x : node->max_x;
+    const MT_BVHQuant *far_y = slab->sign[1] ? node->min_y : node->max_y;
+    const MT_BVHQuant *far_z = slab->sign[2] ? node->min_z : node->max_z;
+
+    MT_Vec3 offset = mt_vec3_sub(node->origin, slab->origin);
+    unsigned int mask = 0;
+
+#if MT_BVH_WIDTH == 8 && defined(__AVX__) && defined(__SSE2__)
+#define MT__DEQUANTIZE8(q) _mm256_insertf128_ps(_mm256_castps128_ps256(mt__bvh_dequantize4(q)), mt__bvh_dequantize4((q) + 4), 1)
+    __m256 f_x = _mm256_set1_ps(offset.x);
+    __m256 f_y = _mm256_set1_ps(offset.y);
+    __m256 f_z = _mm256_set1_ps(offset.z);
+    __m256 s_x = _mm256_set1_ps(node->scale.x);
+    __m256 s_y = _mm256_set1_ps(node->scale.y);
+    __m256 s_z = _mm256_set1_ps(node->scale.z);
+    __m256 i_x = _mm256_set1_ps(slab->inv_dir.x);
+    __m256 i_y = _mm256_set1_ps(slab->inv_dir.y);
+    __m256 i_z = _mm256_set1_ps(slab->inv_dir.z);
+
+    __m256 tmin = _mm256_setzero_ps();
+    tmin = _mm256_max_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(MT__DEQUANTIZE8(near_z), s_z), f_z), i_z), tmin);
+    tmin = _mm256_max_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(MT__DEQUANTIZE8(near_y), s_y), f_y), i_y), tmin);
+    tmin = _mm256_max_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(MT__DEQUANTIZE8(near_x), s_x), f_x), i_x), tmin);
+
+    __m256 tmax = _mm256_set1_ps(t_max);
+    tmax = _mm256_min_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(MT__DEQUANTIZE8(far_z), s_z), f_z), i_z), tmax);
+    tmax = _mm256_min_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(MT__DEQUANTIZE8(far_y), s_y), f_y), i_y), tmax);
+    tmax = _mm256_min_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(MT__DEQUANTIZE8(far_x), s_x), f_x), i_x), tmax);
+#undef MT__DEQUANTIZE8
+
+    _mm256_storeu_ps(t_out, tmin);
+    mask = (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(tmin, tmax, _CMP_LE_OQ));
+#elif defined(__SSE2__)
+    __m128 f_x = _mm_set1_ps(offset.x);
+    __m128 f_y = _mm_set1_ps(offset.y);
+    __m128 f_z = _mm_set1_ps(offset.z);
+    __m128 s_x = _mm_set1_ps(node->scale.x);
+    __m128 s_y = _mm_set1_ps(node->scale.y);
+    __m128 s_z = _mm_set1_ps(node->scale.z);
+    __m128 i_x = _mm_set1_ps(slab->inv_dir.x);
+    __m128 i_y = _mm_set1_ps(slab->inv_dir.y);
+    __m128 i_z = _mm_set1_ps(slab->inv_dir.z);
+
+    for (int i = 0; i < MT_BVH_WIDTH; i += 4)
+    {
+        __m128 tmin = _mm_setzero_ps();
+        tmin = _mm_max_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(mt__bvh_dequantize4(&near_z[i]), s_z), f_z), i_z), tmin);
+        tmin = _mm_max_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(mt__bvh_dequantize4(&near_y[i]), s_y), f_y), i_y), tmin);
+        tmin = _mm_max_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(mt__bvh_dequantize4(&near_x[i]), s_x), f_x), i_x), tmin);
+
+        __m128 tmax = _mm_set1_ps(t_max);
+        tmax = _mm_min_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(mt__bvh_dequantize4(&far_z[i]), s_z), f_z), i_z), tmax);
+        tmax = _mm_min_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(mt__bvh_dequantize4(&far_y[i]), s_y), f_y), i_y), tmax);
+        tmax = _mm_min_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(mt__bvh_dequantize4(&far_x[i]), s_x), f_x), i_x), tmax);
+
+        _mm_storeu_ps(&t_out[i], tmin);
+        mask |= (unsigned int)_mm_movemask_ps(_mm_cmple_ps(tmin, tmax)) << i;
+    }
+#else
+    for (int i = 0; i < MT_BVH_WIDTH; ++i)
+    {
+        float tmin = fmaxf((near_x[i] * node->scale.x + offset.x) * slab->inv_dir.x, 0.0f);
+        tmin = fmaxf((near_y[i] * node->scale.y + offset.y) * slab->inv_dir.y, tmin);
+        tmin = fmaxf((near_z[i] * node->scale.z + offset.z) * slab->inv_dir.z, tmin);
+
+        float tmax = fminf((far_x[i] * node->scale.x + offset.x) * slab->inv_dir.x, t_max);
+        tmax = fminf((far_y[i] * node->scale.y + offset.y) * slab->inv_dir.y, tmax);
+        tmax = fminf((far_z[i] * node->scale.z + offset.z) * slab->inv_dir.z, tmax);
+
+        t_out[i] = tmin;
+        mask |= (unsigned int)(tmin <= tmax) << i;
+    }
+#endif
+
+    return mask & ((1u << node->child_count) - 1);
+}
+
+// hit children are pushed farthest first so the nearest one, leaf or node, is always popped next
+static float mt__bvh_traverse_wide(const MT_BVH *bvh, const MT_RaySlab *slab, MT_Ray *ray, float t_max, MT_BVHLeafFn leaf_fn, void *data, MT_BVHStackEntry *stack)
+{
+    const MT_BVHWideNode *nodes = bvh->wide_nodes;
+    const MT_BVHQuantizedNode *quantized_nodes = bvh->quantized_nodes;
+    int stack_ptr = 0;
+    stack[stack_ptr++] = (MT_BVHStackEntry){0, 0, 0.0f};
+
+    while (stack_ptr > 0)
+    {
+        MT_BVHStackEntry entry = stack[--stack_ptr];
+        if (entry.t > t_max)
+        {
+            continue;
+        }
+
+        if (entry.prim_count > 0)
+        {
+            t_max = leaf_fn(data, ray, entry.index, entry.prim_count);
+            continue;
+        }
+
+        // only the slab test differs between the two layouts
+        float child_t[MT_BVH_WIDTH];
+        unsigned int mask;
+        const uint32_t *child;
+        const uint32_t *prim_count;
+        if (quantized_nodes)
+        {
+            const MT_BVHQuantizedNode *node = &quantized_nodes[entry.index];
+            mask = mt__ray_hit_quantized_bounds(node, slab, t_max, child_t);
+            child = node->child;
+            prim_count = node->prim_count;
+        }
+        else
+        {
+            const MT_BVHWideNode *node = &nodes[entry.index];
+            mask = mt__ray_hit_wide_bounds(node, slab, t_max, child_t);
+            child = node->child;
+            prim_count = node->prim_count;
+        }
+
+        // insertion sort the hit children by distance, farthest first
+        int order[MT_BVH_WIDTH];
+        int order_count = 0;
+        while (mask)
+        {
+            int i = __builtin_ctz(mask);
+            mask &= mask - 1;
+
+            int j = order_count++;
+            while (j > 0 && child_t[order[j - 1]] < child_t[i])
+            {
+                order[j] = order[j - 1];
+                --j;
+            }
+            order[j] = i;
+        }
+
+        for (int j = 0; j < order_count; ++j)
+        {
+            int i = order[j];
+            stack[stack_ptr++] = (MT_BVHStackEntry){child[i], prim_count[i], child_t[i]};
+        }
+    }
+
+    return t_max;
+}
+
+// the stack lives on the thread's stack unless the tree is deep enough to need more, then it is allocated so nothing is dropped
+static float mt__bvh_traverse(const MT_BVH *bvh, MT_Ray *ray, float t_max, MT_BVHLeafFn leaf_fn, void *data)
+{
+    MT_RaySlab slab = mt__ray_slab_create(ray);
+
+    MT_BVHStackEntry stack_local[MT_BVH_STACK_SIZE];
+    MT_BVHStackEntry *stack = stack_local;
+    if (bvh->stack_size > MT_BVH_STACK_SIZE)
+    {
+        stack = (MT_BVHStackEntry *)malloc(sizeof(MT_BVHStackEntry) * bvh->stack_size);
+    }
+
+    if (bvh->wide_slots)
+    {
+        t_max = mt__bvh_traverse_wide(bvh, &slab, ray, t_max, leaf_fn, data, stack);
+    }
+    else
+    {
+        t_max = mt__bvh_traverse_binary(bvh, &slab, ray, t_max, leaf_fn, data, stack);
+    }
+
+    if (stack != stack_local)
+    {
+        free(stack);
+    }
+
+    return t_max;
+}
+
+//////////////////////////////////////////
+// ========== GRID FUNCTIONS ========== //
+//////////////////////////////////////////
+static inline int mt__grid_cell_coord(const MT_Grid *grid, float position, int axis)
+{
+    int coord = (int)floorf((position - mt__vec3_axis(grid->bounds.start, axis)) * mt__vec3_axis(grid->inv_cell_size, axis));
+    if (coord < 0)
+    {
+        return 0;
+    }
+    return coord < grid->res[axis] ? coord : grid->res[axis] - 1;
+}
+
+static inline uint32_t mt__grid_cell_index(const MT_Grid *grid, int x, int y, int z)
+{
+    return ((uint32_t)z * grid->res[1] + y) * grid->res[0] + x;
+}
+
+// picks about density cells per object, shaped like the bounds so cells stay close to cubes
+// source: Cleary and Wyvill, Analysis of an algorithm for fast ray tracing using uniform space subdivision
+static void mt__grid_set_resolution(MT_Grid *grid, uint32_t object_count, float density)
+{
+    MT_Vec3 size = mt_vec3_sub(grid->bounds.end, grid->bounds.start);
+    float max_size = fmaxf(size.x, fmaxf(size.y, size.z));
+
+    // flat axes still get a sliver of volume so the heuristic has something to divide by
+    float min_size = max_size > 0.0f ? max_size * 0.001f : 1.0f;
+    MT_Vec3 cell_space = (MT_Vec3){fmaxf(size.x, min_size), fmaxf(size.y, min_size), fmaxf(size.z, min_size)};
+    float cells_per_unit = cbrtf(density * object_count / (cell_space.x * cell_space.y * cell_space.z));
+
+    float *cell_size = &grid->cell_size.x;
+    float *inv_cell_size = &grid->inv_cell_size.x;
+    grid->cell_count = 1;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float axis_size = mt__vec3_axis(cell_space, axis);
+        int res = (int)ceilf(axis_size * cells_per_unit);
+        res = res < 1 ? 1 : (res > MT_GRID_MAX_RES ? MT_GRID_MAX_RES : res);
+
+        grid->res[axis] = res;
+        cell_size[axis] = axis_size / res;
+        inv_cell_size[axis] = res / axis_size;
+        grid->cell_count *= res;
+    }
+}
+
+// two passes over the objects, one counting how many land in each cell and one filling the cells in, both o(n)
+// the top level grid is built with no arena and gets one of its own, its subgrids are built into that and have none of their own
+static MT_Grid *mt__grid_build(const MT_Bounds *object_bounds, const uint32_t *objects, uint32_t object_count, MT_Bounds bounds, float density, MT_Arena *arena)
+{
+    MT_Grid *grid = arena ? (MT_Grid *)mt__arena_alloc(arena, sizeof(MT_Grid)) : (MT_Grid *)malloc(sizeof(MT_Grid));
+    grid->bounds = bounds;
+    grid->subgrids = NULL;
+    mt__arena_init(&grid->arena);
+    mt__grid_set_resolution(grid, object_count, density);
+
+    int(*ranges)[6] = (int(*)[6])malloc(sizeof(int[6]) * object_count);
+    grid->cell_starts = arena ? (uint32_t *)mt__arena_alloc(arena, sizeof(uint32_t) * (grid->cell_count + 1)) : (uint32_t *)calloc(grid->cell_count + 1, sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < object_count; ++i)
+    {
+        const MT_Bounds *b = &object_bounds[objects[i]];
+        int *range = ranges[i];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            range[axis] = mt__grid_cell_coord(grid, mt__vec3_axis(b->start, axis), axis);
+            range[axis + 3] = mt__grid_cell_coord(grid, mt__vec3_axis(b->end, axis), axis);
+        }
+
+        for (int z = range[2]; z <= range[5]; ++z)
+        {
+            for (int y = range[1]; y <= range[4]; ++y)
+            {
+                for (int x = range[0]; x <= range[3]; ++x)
+                {
+                    ++grid->cell_starts[mt__grid_cell_index(grid, x, y, z) + 1];
+                }
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < grid->cell_count; ++i)
+    {
+        grid->cell_starts[i + 1] += grid->cell_starts[i];
+    }
+
+    size_t cell_objects_size = sizeof(uint32_t) * grid->cell_starts[grid->cell_count];
+    grid->cell_objects = arena ? (uint32_t *)mt__arena_alloc(arena, cell_objects_size) : (uint32_t *)malloc(cell_objects_size);
+    uint32_t *cursors = (uint32_t *)malloc(sizeof(uint32_t) * grid->cell_count);
+    memcpy(cursors, grid->cell_starts, sizeof(uint32_t) * grid->cell_count);
+
+    for (uint32_t i = 0; i < object_count; ++i)
+    {
+        const int *range = ranges[i];
+        for (int z = range[2]; z <= range[5]; ++z)
+        {
+            for (int y = range[1]; y <= range[4]; ++y)
+            {
+                for (int x = range[0]; x <= range[3]; ++x)
+                {
+                    grid->cell_objects[cursors[mt__grid_cell_index(grid, x, y, z)]++] = objects[i];
+                }
+            }
+        }
+    }
+
+    free(cursors);
+    free(ranges);
+
+    if (arena)
+    {
+        return grid;
+    }
+
+    // crowded cells get a grid of their own, fitted to where their objects actually are inside the cell
+    for (int z = 0; z < grid->res[2]; ++z)
+    {
+        for (int y = 0; y < grid->res[1]; ++y)
+        {
+            for (int x = 0; x < grid->res[0]; ++x)
+            {
+                uint32_t cell_index = mt__grid_cell_index(grid, x, y, z);
+                uint32_t start = grid->cell_starts[cell_index];
+                uint32_t count = grid->cell_starts[cell_index + 1] - start;
+                if (count <= MT_GRID_CROWDED_CELL)
+                {
+                    continue;
+                }
+
+                MT_Bounds cell_bounds;
+                cell_bounds.start = mt_vec3_add(bounds.start, mt_vec3_mult(grid->cell_size, (MT_Vec3){x, y, z}));
+                cell_bounds.end = mt_vec3_add(cell_bounds.start, grid->cell_size);
+
+                MT_Bounds object_union = mt__bounds_create_invalid();
+                for (uint32_t i = start; i < start + count; ++i)
+                {
+                    object_union = mt__bounds_union(object_union, object_bounds[grid->cell_objects[i]]);
+                }
+
+                MT_Bounds sub_bounds = mt__bounds_intersect(cell_bounds, object_union);
+                if (!mt__bounds_valid(sub_bounds))
+                {
+                    sub_bounds = cell_bounds;
+                }
+
+                if (!grid->subgrids)
+                {
+                    grid->subgrids = (MT_Grid **)calloc(grid->cell_count, sizeof(MT_Grid *));
+                }
+                grid->subgrids[cell_index] = mt__grid_build(object_bounds, &grid->cell_objects[start], count, sub_bounds, MT_GRID_SUBGRID_DENSITY, &grid->arena);
+            }
+        }
+    }
+
+    return grid;
+}
+
+// narrows [t_enter, t_exit] to the part of the ray inside the bounds, returns 0 if nothing is left
+static inline int mt__ray_clip_bounds(const MT_RaySlab *slab, const MT_Bounds *bounds, float *t_enter, float *t_exit)
+{
+    MT_Vec3 near = (MT_Vec3){slab->sign[0] ? bounds->end.x : bounds->start.x,
+                             slab->sign[1] ? bounds->end.y : bounds->start.y,
+                             slab->sign[2] ? bounds->end.z : bounds->start.z};
+    MT_Vec3 far = (MT_Vec3){slab->sign[0] ? bounds->start.x : bounds->end.x,
+                            slab->sign[1] ? bounds->start.y : bounds->end.y,
+                            slab->sign[2] ? bounds->start.z : bounds->end.z};
+
+    float tmin = fmaxf((near.x - slab->origin.x) * slab->inv_dir.x, *t_enter);
+    tmin = fmaxf((near.y - slab->origin.y) * slab->inv_dir.y, tmin);
+    tmin = fmaxf((near.z - slab->origin.z) * slab->inv_dir.z, tmin);
+
+    float tmax = fminf((far.x - slab->origin.x) * slab->inv_dir.x, *t_exit);
+    tmax = fminf((far.y - slab->origin.y) * slab->inv_dir.y, tmax);
+    tmax = fminf((far.z - slab->origin.z) * slab->inv_dir.z, tmax);
+
+    *t_enter = tmin;
+    *t_exit = tmax;
+    return tmin <= tmax;
+}
+
+// returns the closest hit distance found so far, like a bvh leaf callback but for a single object
+typedef float (*MT_GridObjectFn)(void *data, MT_Ray *ray, uint32_t object);
+
+// 3d-dda, cells are walked in the order the ray passes through them and the walk stops once the closest hit is inside the current cell
+// source: Amanatides and Woo, A Fast Voxel Traversal Algorithm for Ray Tracing
+static float mt__grid_traverse_range(const MT_Grid *grid, const MT_RaySlab *slab, MT_Ray *ray, float t_enter, float t_exit, float t_max, MT_GridObjectFn object_fn, void *data, uint32_t *mailbox)
+{
+    if (!mt__ray_clip_bounds(slab, &grid->bounds, &t_enter, &t_exit))
+    {
+        return t_max;
+    }
+
+    MT_Vec3 entry = mt__ray_at(ray, t_enter);
+    int cell[3], step[3];
+    float t_next[3], t_delta[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float origin = mt__vec3_axis(slab->origin, axis);
+        float direction = mt__vec3_axis(ray->direction, axis);
+        float inv_dir = mt__vec3_axis(slab->inv_dir, axis);
+        float cell_size = mt__vec3_axis(grid->cell_size, axis);
+        float grid_start = mt__vec3_axis(grid->bounds.start, axis);
+
+        cell[axis] = mt__grid_cell_coord(grid, mt__vec3_axis(entry, axis), axis);
+
+        if (direction > 0.0f)
+        {
+            step[axis] = 1;
+            t_next[axis] = (grid_start + (cell[axis] + 1) * cell_size - origin) * inv_dir;
+            t_delta[axis] = cell_size * inv_dir;
+        }
+        else if (direction < 0.0f)
+        {
+            step[axis] = -1;
+            t_next[axis] = (grid_start + cell[axis] * cell_size - origin) * inv_dir;
+            t_delta[axis] = -cell_size * inv_dir;
+        }
+        else
+        {
+            step[axis] = 0;
+            t_next[axis] = INFINITY;
+            t_delta[axis] = INFINITY;
+        }
+    }
+
+    float t_cell_enter = t_enter;
+    while (1)
+    {
+        uint32_t cell_index = mt__grid_cell_index(grid, cell[0], cell[1], cell[2]);
+        float t_cell_exit = fminf(fminf(t_next[0], t_next[1]), fminf(t_next[2], t_exit));
+
+        if (grid->subgrids && grid->subgrids[cell_index])
+        {
+            t_max = mt__grid_traverse_range(grid->subgrids[cell_index], slab, ray, t_cell_enter, t_cell_exit, t_max, object_fn, data, mailbox);
+        }
+        else
+        {
+            for (uint32_t i = grid->cell_starts[cell_index]; i < grid->cell_starts[cell_index + 1]; ++i)
+            {
+                // a collision in the mailbox only costs a retest
+                uint32_t object = grid->cell_objects[i];
+                uint32_t *slot = &mailbox[object & (MT_GRID_MAILBOX_SIZE - 1)];
+                if (*slot == object)
+                {
+                    continue;
+                }
+                *slot = object;
+
+                t_max = object_fn(data, ray, object);
+            }
+        }
+
+        // a hit past this cell may still be beaten by an object in a later one
+        if (t_max <= t_cell_exit || t_cell_exit >= t_exit)
+        {
+            return t_max;
+        }
+
+        int axis = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
+        cell[axis] += step[axis];
+        if (cell[axis] < 0 || cell[axis] >= grid->res[axis])
+        {
+            return t_max;
+        }
+
+        t_cell_enter = t_next[axis];
+        t_next[axis] += t_delta[axis];
+    }
+}
+
+static float mt__grid_traverse(const MT_Grid *grid, MT_Ray *ray, float t_max, MT_GridObjectFn object_fn, void *data)
+{
+    MT_RaySlab slab = mt__ray_slab_create(ray);
+
+    uint32_t mailbox[MT_GRID_MAILBOX_SIZE];
+    memset(mailbox, 0xFF, sizeof(mailbox));
+
+    return mt__grid_traverse_range(grid, &slab, ray, 0.0f, t_max, t_max, object_fn, data, mailbox);
+}
+
+// unchanged meshes keep their triangle bvhs, so a grid can be rebuilt every frame for the cost of the moved objects
+static void mt__world_update_grid_bounds_range(void *data, unsigned int start, unsigned int end, unsigned int thread_index)
+{
+    MT_WorldBoundsJob *job = (MT_WorldBoundsJob *)data;
+    MT_World *world = job->world;
+
+    for (unsigned int i = start; i < end; ++i)
+    {
+        if (world->objects_track[i] == MT_OBJECT_MESH)
+        {
+            MT_Mesh *mesh = (MT_Mesh *)world->objects[i];
+            if (!mesh->b_bvh_dirty && mesh->bvh)
+            {
+                world->object_bounds[i] = mesh->bvh->nodes[0].bounds;
+                continue;
+            }
+        }
+
+        mt__world_update_object_bounds(world, i, 1, job->settings, NULL);
+    }
+}
+
+// builds a two level grid over the world's objects, used instead of the world bvh by mt_renderer_enable_grid
+void mt_world_recalculate_grid(MT_World *world)
+{
+    mt__grid_delete(world->grid);
+    world->grid = NULL;
+    world->b_grid_dirty = 0;
+
+    if (world->object_index <= 0)
+    {
+        return;
+    }
+
+    // shared meshes are refit once up front, same as the bvh build
+    for (unsigned int i = 0; i < world->object_index; ++i)
+    {
+        if (world->objects_track[i] == MT_OBJECT_INSTANCE)
+        {
+            MT_Instance *instance = (MT_Instance *)world->objects[i];
+            if (instance->mesh->b_bvh_dirty)
+            {
+                mt__mesh_refit_bvh(instance->mesh, &world->bvh_settings);
+            }
+        }
+    }
+
+    unsigned int thread_count = mt__parallel_thread_count(world->bvh_settings.thread_count, world->object_index);
+    MT_BVHSettings object_settings = world->bvh_settings;
+    if (thread_count > 1)
+    {
+        object_settings.thread_count = 1;
+    }
+
+    MT_WorldBoundsJob job = {world, &object_settings, NULL};
+    mt__parallel_for(thread_count, world->object_index, mt__world_update_grid_bounds_range, &job);
+
+    // planes are tested before every traversal and stay out of the cells
+    uint32_t *objects = (uint32_t *)malloc(sizeof(uint32_t) * world->object_index);
+    unsigned int object_count = 0;
+    MT_Bounds bounds = mt__bounds_create_invalid();
+    for (unsigned int i = 0; i < world->object_index; ++i)
+    {
+        if (world->objects_track[i] != MT_OBJECT_PLANE)
+        {
+            objects[object_count++] = i;
+            bounds = mt__bounds_union(bounds, world->object_bounds[i]);
+        }
+    }
+
+    if (object_count == 0)
+    {
+        free(objects);
+        return;
+    }
+
+    // grown a little so rays entering right at the edge still start inside a cell
+    MT_Vec3 margin = mt_vec3_mult_v(mt_vec3_sub(bounds.end, bounds.start), 0.0001f);
+    bounds.start = mt_vec3_sub(mt_vec3_sub_v(bounds.start, MT_EPSILON), margin);
+    bounds.end = mt_vec3_add(mt_vec3_add_v(bounds.end, MT_EPSILON), margin);
+
+    world->grid = mt__grid_build(world->object_bounds, objects, object_count, bounds, MT_GRID_DENSITY, NULL);
+
+    free(objects);
+}
+
+////////////////////////////////////
+// ========== SNAPSHOT ========== //
+////////////////////////////////////
+// a snapshot is one pointer free file, a header followed by sections at MT_SNAPSHOT_ALIGN byte offsets
+// pointers are stored as indices into the file's tables and sections as offsets from the start of the file
+#define MT_SNAPSHOT_MAGIC "MTSNAP"
+#define MT_SNAPSHOT_VERSION 4
+#define MT_SNAPSHOT_BYTE_ORDER 0x01020304u
+#define MT_SNAPSHOT_ALIGN 64
+
+// stands in for a NULL pointer in index fields
+#define MT_SNAPSHOT_NONE UINT32_MAX
+
+// what a file's contents depend on, snapshots and mesh streams both start with one
+typedef struct MT_SnapshotLayout
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // reads back as something else on a machine of the other endianness
+
+    // the trees are stored in the layout they are traversed in, which depends on these
+    uint32_t bvh_width;
+    uint32_t quantize_bits;
+    uint32_t node_size;
+    uint32_t wide_node_size;
+    uint32_t quantized_node_size;
+    uint32_t material_size;
+    uint32_t sphere_block_size; // sphere clouds keep their blocks as they are, which depends on MT_TRI_BLOCK_WIDTH
+
+    uint64_t file_size;
+} MT_SnapshotLayout;
+
+typedef struct MT_SnapshotHeader
+{
+    MT_SnapshotLayout layout;
+
+    uint64_t materials, meshes, spheres, instances, boxes, planes, sphere_clouds, objects, bvhs;
+    uint32_t material_count, mesh_count, sphere_count, instance_count, box_count, plane_count, sphere_cloud_count, object_count, bvh_count;
+
+    MT_BVHSettings bvh_settings;
+    uint32_t bvh; // the world bvh's index in the bvh table
+    float brute_ray_cost;
+    float bvh_ray_cost;
+    int32_t b_bvh_slower;
+
+    int32_t b_has_environment;
+    MT_Environment environment;
+} MT_SnapshotHeader;
+
+// the vertex, index and normal sections are the mesh's own arrays, in the order its bvh expects
+typedef struct MT_SnapshotMesh
+{
+    uint64_t vertices;  // vertex_count MT_Vec3
+    uint64_t indices;   // 3 * tri_count uint32_t
+    uint64_t normals;   // tri_count packed normals
+    uint64_t materials; // tri_count material indices
+    uint32_t vertex_count;
+    uint32_t tri_count;
+    uint32_t bvh;
+    uint32_t object; // the mesh object it is, MT_SNAPSHOT_NONE for meshes only referenced by instances
+    uint32_t hash;
+    MT_Vec3 origin_offset;
+    float ray_cost;
+    int32_t b_bvh_dirty;
+    int32_t b_bvh_slower;
+} MT_SnapshotMesh;
+
+typedef struct MT_SnapshotSphere
+{
+    MT_Vec3 position;
+    float radius;
+    uint32_t material;
+} MT_SnapshotSphere;
+
+typedef struct MT_SnapshotBox
+{
+    MT_Vec3 position;
+    MT_Vec3 axes[3];
+    MT_Vec3 half_size;
+    uint32_t material;
+} MT_SnapshotBox;
+
+typedef struct MT_SnapshotPlane
+{
+    MT_Vec3 position;
+    MT_Vec3 normal;
+    uint32_t material;
+} MT_SnapshotPlane;
+
+// the blocks and sphere materials are the cloud's own arrays, in the order its bvh expects
+typedef struct MT_SnapshotSphereCloud
+{
+    uint64_t blocks;    // enough MT_SphereBlock for sphere_count spheres
+    uint64_t materials; // sphere_count material indices
+    uint32_t sphere_count;
+    uint32_t bvh;
+    float ray_cost;
+    int32_t b_bvh_dirty;
+    int32_t b_bvh_slower;
+} MT_SnapshotSphereCloud;
+
+typedef struct MT_SnapshotInstance
+{
+    uint32_t mesh;
+    MT_Mat4x4 object_to_world;
+    MT_Mat4x4 world_to_object;
+    MT_Mat4x4 normal_to_world;
+} MT_SnapshotInstance;
+
+typedef struct MT_SnapshotObject
+{
+    uint32_t type;
+    uint32_t index; // into the table of its type
+    uint32_t leaf;  // the world bvh leaf holding it
+    int32_t b_dirty;
+    MT_Bounds bounds;
+} MT_SnapshotObject;
+
+// a bvh's arrays are used straight from the mapped file, an offset of 0 means the tree has no such array
+typedef struct MT_SnapshotBVH
+{
+    uint64_t nodes, wide_nodes, quantized_nodes, prims, parents, wide_slots;
+    uint32_t node_count;
+    uint32_t wide_node_count;
+    uint32_t prim_count;
+    uint32_t max_depth;
+    uint32_t wide_max_depth;
+    uint32_t stack_size;
+    float padding;
+    float build_sah_cost;
+    float build_ms;
+    float treelet_ms;
+    double sah_sum;
+} MT_SnapshotBVH;
+
+static MT_SnapshotLayout mt__snapshot_layout(const char *magic, uint64_t file_size)
+{
+    MT_SnapshotLayout layout = {0};
+    strncpy(layout.magic, magic, sizeof(layout.magic) - 1);
+    layout.version = MT_SNAPSHOT_VERSION;
+    layout.byte_order = MT_SNAPSHOT_BYTE_ORDER;
+    layout.bvh_width = MT_BVH_WIDTH;
+    layout.quantize_bits = MT_BVH_QUANTIZE_BITS;
+    layout.node_size = sizeof(MT_BVHNode);
+    layout.wide_node_size = sizeof(MT_BVHWideNode);
+    layout.quantized_node_size = sizeof(MT_BVHQuantizedNode);
+    layout.material_size = sizeof(MT_Material);
+    layout.sphere_block_size = sizeof(MT_SphereBlock);
+    layout.file_size = file_size;
+    return layout;
+}
+
+typedef struct MT_SnapshotWriter
+{
+    FILE *fp;
+    uint64_t offset;
+    int b_failed;
+
+    const MT_Material **materials;
+    uint32_t material_count;
+    uint32_t max_materials;
+    uint32_t last_material;
+
+    MT_SnapshotBVH *bvhs;
+    uint32_t bvh_count;
+    uint32_t max_bvhs;
+} MT_SnapshotWriter;
+
+// appends a section at the next aligned offset and returns where it starts, 0 if there is nothing to write
+static uint64_t mt__snapshot_write(MT_SnapshotWriter *writer, const void *data, size_t size)
+{
+    static const unsigned char zeros[MT_SNAPSHOT_ALIGN] = {0};
+
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    size_t pad = (MT_SNAPSHOT_ALIGN - writer->offset % MT_SNAPSHOT_ALIGN) % MT_SNAPSHOT_ALIGN;
+    if (fwrite(zeros, 1, pad, writer->fp) != pad || fwrite(data, 1, size, writer->fp) != size)
+    {
+        writer->b_failed = 1;
+    }
+
+    uint64_t start = writer->offset + pad;
+    writer->offset = start + size;
+    return start;
+}
+
+static uint32_t mt__snapshot_material_index(MT_SnapshotWriter *writer, const MT_Material *mat)
+{
+    if (!mat)
+    {
+        return MT_SNAPSHOT_NONE;
+    }
+
+    // tris of a mesh mostly share one material, so the last one found is checked first
+    if (writer->material_count > 0 && writer->materials[writer->last_material] == mat)
+    {
+        return writer->last_material;
+    }
+
+    for (uint32_t i = 0; i < writer->material_count; ++i)
+    {
+        if (writer->materials[i] == mat)
+        {
+            writer->last_material = i;
+            return i;
+        }
+    }
+
+    if (writer->material_count >= writer->max_materials)
+    {
+        writer->max_materials = writer->max_materials > 0 ? writer->max_materials * 2 : 16;
+        writer->materials = (const MT_Material **)realloc(writer->materials, sizeof(MT_Material *) * writer->max_materials);
+    }
+
+    writer->last_material = writer->material_count;
+    writer->materials[writer->material_count] = mat;
+    return writer->material_count++;
+}
+
+static uint32_t mt__snapshot_write_bvh(MT_SnapshotWriter *writer, const MT_BVH *bvh)
+{
+    if (!bvh)
+    {
+        return MT_SNAPSHOT_NONE;
+    }
+
+    MT_SnapshotBVH record = {0};
+    record.nodes = mt__snapshot_write(writer, bvh->nodes, sizeof(MT_BVHNode) * bvh->node_count);
+    record.parents = mt__snapshot_write(writer, bvh->parents, sizeof(uint32_t) * bvh->node_count);
+    if (bvh->prims)
+    {
+        record.prims = mt__snapshot_write(writer, bvh->prims, sizeof(uint32_t) * bvh->prim_count);
+    }
+    if (bvh->wide_slots)
+    {
+        record.wide_slots = mt__snapshot_write(writer, bvh->wide_slots, sizeof(uint32_t) * bvh->node_count);
+        if (bvh->quantized_nodes)
+        {
+            record.quantized_nodes = mt__snapshot_write(writer, bvh->quantized_nodes, sizeof(MT_BVHQuantizedNode) * bvh->wide_node_count);
+        }
+        else
+        {
+            record.wide_nodes = mt__snapshot_write(writer, bvh->wide_nodes, sizeof(MT_BVHWideNode) * bvh->wide_node_count);
+        }
+    }
+
+    record.node_count = bvh->node_count;
+    record.wide_node_count = bvh->wide_node_count;
+    record.prim_count = bvh->prim_count;
+    record.max_depth = bvh->max_depth;
+    record.wide_max_depth = bvh->wide_max_depth;
+    record.stack_size = bvh->stack_size;
+    record.padding = bvh->padding;
+    record.build_sah_cost = bvh->build_sah_cost;
+    record.build_ms = bvh->build_ms;
+    record.treelet_ms = bvh->treelet_ms;
+    record.sah_sum = bvh->sah_sum;
+
+    if (writer->bvh_count >= writer->max_bvhs)
+    {
+        writer->max_bvhs = writer->max_bvhs > 0 ? writer->max_bvhs * 2 : 16;
+        writer->bvhs = (MT_SnapshotBVH *)realloc(writer->bvhs, sizeof(MT_SnapshotBVH) * writer->max_bvhs);
+    }
+
+    writer->bvhs[writer->bvh_count] = record;
+    return writer->bvh_count++;
+}
+
+static MT_SnapshotMesh mt__snapshot_write_mesh(MT_SnapshotWriter *writer, const MT_Mesh *mesh, uint32_t object)
+{
+    uint32_t *materials = (uint32_t *)malloc(sizeof(uint32_t) * (mesh->tri_index > 0 ? mesh->tri_index : 1));
+    for (unsigned int i = 0; i < mesh->tri_index; ++i)
+    {
+        materials[i] = mt__snapshot_material_index(writer, mt__mesh_tri_material(mesh, i));
+    }
+
+    MT_SnapshotMesh record = {0};
+    record.vertices = mt__snapshot_write(writer, mesh->vertices, sizeof(MT_Vec3) * mesh->vertex_index);
+    record.indices = mt__snapshot_write(writer, mesh->indices, sizeof(uint32_t) * 3 * mesh->tri_index);
+    record.normals = mt__snapshot_write(writer, mesh->normals, sizeof(uint32_t) * mesh->tri_index);
+    record.materials = mt__snapshot_write(writer, materials, sizeof(uint32_t) * mesh->tri_index);
+    record.vertex_count = mesh->vertex_index;
+    record.tri_count = mesh->tri_index;
+    record.object = object;
+    record.hash = mt__mesh_hash(mesh);
+    record.origin_offset = mesh->origin_offset;
+    record.ray_cost = mesh->ray_cost;
+    record.b_bvh_slower = mesh->b_bvh_slower;
+
+    // a tree that no longer matches its tris is left out and rebuilt after loading
+    record.b_bvh_dirty = mesh->b_bvh_dirty;
+    record.bvh = mesh->b_bvh_dirty ? MT_SNAPSHOT_NONE : mt__snapshot_write_bvh(writer, mesh->bvh);
+
+    free(materials);
+    return record;
+}
+
+static MT_SnapshotSphereCloud mt__snapshot_write_sphere_cloud(MT_SnapshotWriter *writer, const MT_SphereCloud *cloud)
+{
+    uint32_t *materials = (uint32_t *)malloc(sizeof(uint32_t) * (cloud->sphere_index > 0 ? cloud->sphere_index : 1));
+    for (unsigned int i = 0; i < cloud->sphere_index; ++i)
+    {
+        materials[i] = mt__snapshot_material_index(writer, cloud->materials[cloud->sphere_materials[i]]);
+    }
+
+    MT_SnapshotSphereCloud record = {0};
+    record.blocks = mt__snapshot_write(writer, cloud->blocks, sizeof(MT_SphereBlock) * mt__sphere_block_count(cloud->sphere_index));
+    record.materials = mt__snapshot_write(writer, materials, sizeof(uint32_t) * cloud->sphere_index);
+    record.sphere_count = cloud->sphere_index;
+    record.ray_cost = cloud->ray_cost;
+    record.b_bvh_slower = cloud->b_bvh_slower;
+    record.b_bvh_dirty = cloud->b_bvh_dirty;
+    record.bvh = cloud->b_bvh_dirty ? MT_SNAPSHOT_NONE : mt__snapshot_write_bvh(writer, cloud->bvh);
+
+    free(materials);
+    return record;
+}
+
+static uint32_t mt__snapshot_find_mesh(const MT_Mesh **meshes, uint32_t mesh_count, const MT_Mesh *mesh)
+{
+    for (uint32_t i = 0; i < mesh_count; ++i)
+    {
+        if (meshes[i] == mesh)
+        {
+            return i;
+        }
+    }
+    return MT_SNAPSHOT_NONE;
+}
+
+// writes the world's geometry, materials and built trees so mt_world_load_snapshot can map them back in without rebuilding anything
+// the grid and the renderer's settings are not part of a snapshot, returns 0 if the file could not be written
+int mt_world_save_snapshot(MT_World *world, const char *path)
+{
+    // a streamed mesh's tris are only in its own file, instances of it cannot be written without them
+    for (unsigned int i = 0; i < world->object_index; ++i)
+    {
+        const MT_Mesh *mesh = NULL;
+        if (world->objects_track[i] == MT_OBJECT_MESH)
+        {
+            mesh = (const MT_Mesh *)world->objects[i];
+        }
+        else if (world->objects_track[i] == MT_OBJECT_INSTANCE)
+        {
+            mesh = ((const MT_Instance *)world->objects[i])->mesh;
+        }
+
+        if (mesh && mesh->stream)
+        {
+            fprintf(stderr, "mt_world_save_snapshot: worlds with streamed meshes cannot be saved\n");
+            return 0;
+        }
+    }
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+    {
+        perror("fopen");
+        return 0;
+    }
+
+    MT_SnapshotHeader header = {0};
+    MT_SnapshotWriter writer = {0};
+    writer.fp = fp;
+
+    // the real header is written over this once every section's offset is known
+    if (fwrite(&header, 1, sizeof(header), fp) != sizeof(header))
+    {
+        writer.b_failed = 1;
+    }
+    writer.offset = sizeof(header);
+
+    // every mesh is written once, including meshes instances reference that the world does not own, so there is at most one per object or shared mesh
+    uint32_t max_meshes = world->object_index + world->shared_mesh_index;
+    const MT_Mesh **meshes = (const MT_Mesh **)malloc(sizeof(MT_Mesh *) * (max_meshes > 0 ? max_meshes : 1));
+    MT_SnapshotMesh *mesh_records = (MT_SnapshotMesh *)malloc(sizeof(MT_SnapshotMesh) * (max_meshes > 0 ? max_meshes : 1));
+    uint32_t mesh_count = 0;
+
+    MT_SnapshotSphere *spheres = (MT_SnapshotSphere *)malloc(sizeof(MT_SnapshotSphere) * (world->object_index > 0 ? world->object_index : 1));
+    MT_SnapshotInstance *instances = (MT_SnapshotInstance *)malloc(sizeof(MT_SnapshotInstance) * (world->object_index > 0 ? world->object_index : 1));
+    MT_SnapshotBox *boxes = (MT_SnapshotBox *)malloc(sizeof(MT_SnapshotBox) * (world->object_index > 0 ? world->object_index : 1));
+    MT_SnapshotPlane *planes = (MT_SnapshotPlane *)malloc(sizeof(MT_SnapshotPlane) * (world->object_index > 0 ? world->object_index : 1));
+    MT_SnapshotSphereCloud *sphere_clouds = (MT_SnapshotSphereCloud *)malloc(sizeof(MT_SnapshotSphereCloud) * (world->object_index > 0 ? world->object_index : 1));
+    MT_SnapshotObject *objects = (MT_SnapshotObject *)malloc(sizeof(MT_SnapshotObject) * (world->object_index > 0 ? world->object_index : 1));
+    uint32_t sphere_count = 0;
+    uint32_t instance_count = 0;
+    uint32_t box_count = 0;
+    uint32_t plane_count = 0;
+    uint32_t sphere_cloud_count = 0;
+
+    // the meshes are gathered before any is written, so a mesh is written once however its objects and instances are ordered
+    uint32_t *mesh_objects = (uint32_t *)malloc(sizeof(uint32_t) * (max_meshes > 0 ? max_meshes : 1));
+    for (unsigned int i = 0; i < world->shared_mesh_index; ++i)
+    {
+        meshes[mesh_count] = world->shared_meshes[i];
+        mesh_objects[mesh_count++] = MT_SNAPSHOT_NONE;
+    }
+
+    for (unsigned int i = 0; i < world->object_index; ++i)
+    {
+        if (world->objects_track[i] == MT_OBJECT_MESH)
+        {
+            objects[i].index = mesh_count;
+            meshes[mesh_count] = (const MT_Mesh *)world->objects[i];
+            mesh_objects[mesh_count++] = i;
+        }
+    }
+
+    // instances of meshes the world does not own
+    for (unsigned int i = 0; i < world->object_index; ++i)
+    {
+        if (world->objects_track[i] == MT_OBJECT_INSTANCE)
+        {
+            const MT_Mesh *mesh = ((const MT_Instance *)world->objects[i])->mesh;
+            if (mt__snapshot_find_mesh(meshes, mesh_count, mesh) == MT_SNAPSHOT_NONE)
+            {
+                meshes[mesh_count] = mesh;
+                mesh_objects[mesh_count++] = MT_SNAPSHOT_NONE;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < mesh_count; ++i)
+    {
+        mesh_records[i] = mt__snapshot_write_mesh(&writer, meshes[i], mesh_objects[i]);
+    }
+    free(mesh_objects);
+
+    // bounds and leaves are only kept for objects the current world bvh was built over
+    uint32_t built_objects = world->bvh ? world->bvh_object_count : 0;
+
+    for (unsigned int i = 0; i < world->object_index; ++i)
+    {
+        MT_SnapshotObject *object = &objects[i];
+        object->type = world->objects_track[i];
+        object->b_dirty = world->objects_dirty[i];
+        object->leaf = i < built_objects ? world->object_leaves[i] : 0;
+        object->bounds = i < built_objects ? world->object_bounds[i] : mt__bounds_create_invalid();
+
+        switch (world->objects_track[i])
+        {
+        case MT_OBJECT_MESH:
+            // already indexed when the meshes were gathered
+            break;
+        case MT_OBJECT_SPHERE:
+        {
+            const MT_Sphere *sphere = (const MT_Sphere *)world->objects[i];
+            object->index = sphere_count;
+            spheres[sphere_count++] = (MT_SnapshotSphere){sphere->position, sphere->radius, mt__snapshot_material_index(&writer, sphere->mat)};
+            break;
+        }
+        case MT_OBJECT_INSTANCE:
+        {
+            const MT_Instance *instance = (const MT_Instance *)world->objects[i];
+            uint32_t mesh_index = mt__snapshot_find_mesh(meshes, mesh_count, instance->mesh);
+            object->index = instance_count;
+            instances[instance_count++] = (MT_SnapshotInstance){mesh_index, instance->object_to_world, instance->world_to_object, instance->normal_to_world};
+            break;
+        }
+        case MT_OBJECT_BOX:
+        {
+            const MT_Box *box = (const MT_Box *)world->objects[i];
+            object->index = box_count;
+            boxes[box_count++] = (MT_SnapshotBox){box->position, {box->axes[0], box->axes[1], box->axes[2]}, box->half_size, mt__snapshot_material_index(&writer, box->mat)};
+            break;
+        }
+        case MT_OBJECT_PLANE:
+        {
+            const MT_Plane *plane = (const MT_Plane *)world->objects[i];
+            object->index = plane_count;
+            planes[plane_count++] = (MT_SnapshotPlane){plane->position, plane->normal, mt__snapshot_material_index(&writer, plane->mat)};
+            break;
+        }
+        case MT_OBJECT_SPHERE_CLOUD:
+        {
+            object->index = sphere_cloud_count;
+            sphere_clouds[sphere_cloud_count++] = mt__snapshot_write_sphere_cloud(&writer, (const MT_SphereCloud *)world->objects[i]);
+            break;
+        }
+        }
+    }
+
+    header.bvh = mt__snapshot_write_bvh(&writer, world->bvh);
+    header.bvh_settings = world->bvh_settings;
+    header.brute_ray_cost = world->brute_ray_cost;
+    header.bvh_ray_cost = world->bvh_ray_cost;
+    header.b_bvh_slower = world->b_bvh_slower;
+
+    if (world->environment)
+    {
+        header.b_has_environment = 1;
+        header.environment = *world->environment;
+    }
+
+    // materials are copied by value, the loaded world's tris point at the copies
+    MT_Material *materials = (MT_Material *)malloc(sizeof(MT_Material) * (writer.material_count > 0 ? writer.material_count : 1));
+    for (uint32_t i = 0; i < writer.material_count; ++i)
+    {
+        materials[i] = *writer.materials[i];
+    }
+
+    header.material_count = writer.material_count;
+    header.mesh_count = mesh_count;
+    header.sphere_count = sphere_count;
+    header.instance_count = instance_count;
+    header.box_count = box_count;
+    header.plane_count = plane_count;
+    header.sphere_cloud_count = sphere_cloud_count;
+    header.object_count = world->object_index;
+    header.bvh_count = writer.bvh_count;
+
+    header.materials = mt__snapshot_write(&writer, materials, sizeof(MT_Material) * writer.material_count);
+    header.meshes = mt__snapshot_write(&writer, mesh_records, sizeof(MT_SnapshotMesh) * mesh_count);
+    header.spheres = mt__snapshot_write(&writer, spheres, sizeof(MT_SnapshotSphere) * sphere_count);
+    header.instances = mt__snapshot_write(&writer, instances, sizeof(MT_SnapshotInstance) * instance_count);
+    header.boxes = mt__snapshot_write(&writer, boxes, sizeof(MT_SnapshotBox) * box_count);
+    header.planes = mt__snapshot_write(&writer, planes, sizeof(MT_SnapshotPlane) * plane_count);
+    header.sphere_clouds = mt__snapshot_write(&writer, sphere_clouds, sizeof(MT_SnapshotSphereCloud) * sphere_cloud_count);
+    header.objects = mt__snapshot_write(&writer, objects, sizeof(MT_SnapshotObject) * world->object_index);
+    header.bvhs = mt__snapshot_write(&writer, writer.bvhs, sizeof(MT_SnapshotBVH) * writer.bvh_count);
+    header.layout = mt__snapshot_layout(MT_SNAPSHOT_MAGIC, writer.offset);
+
+    if (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header, 1, sizeof(header), fp) != sizeof(header))
+    {
+        writer.b_failed = 1;
+    }
+    if (fclose(fp) != 0)
+    {
+        writer.b_failed = 1;
+    }
+
+    free(materials);
+    free(meshes);
+    free(mesh_records);
+    free(spheres);
+    free(instances);
+    free(boxes);
+    free(planes);
+    free(sphere_clouds);
+    free(objects);
+    free(writer.materials);
+    free(writer.bvhs);
+
+    return !writer.b_failed;
+}
+
+// the section of count elements at offset, or NULL if it does not fit in the file
+static const void *mt__snapshot_section(const unsigned char *data, size_t size, uint64_t offset, uint64_t count, size_t element_size)
+{
+    if (offset == 0 || offset % MT_SNAPSHOT_ALIGN != 0 || offset > size || count > (size - offset) / element_size)
+    {
+        return NULL;
+    }
+    return data + offset;
+}
+
+// whether a file of size bytes starts with the layout this build writes, header_size covers the rest of its header
+static int mt__snapshot_layout_matches(const unsigned char *data, size_t size, const char *magic, size_t header_size)
+{
+    if (size < header_size)
+    {
+        return 0;
+    }
+
+    MT_SnapshotLayout expected = mt__snapshot_layout(magic, size);
+    return memcmp(data, &expected, sizeof(MT_SnapshotLayout)) == 0;
+}
+
+static int mt__snapshot_bvh_fits(const unsigned char *data, size_t size, const MT_SnapshotBVH *bvh)
+{
+    return bvh->node_count > 0 &&
+           mt__snapshot_section(data, size, bvh->nodes, bvh->node_count, sizeof(MT_BVHNode)) &&
+           mt__snapshot_section(data, size, bvh->parents, bvh->node_count, sizeof(uint32_t)) &&
+           (!bvh->prims || mt__snapshot_section(data, size, bvh->prims, bvh->prim_count, sizeof(uint32_t))) &&
+           (!bvh->wide_nodes || mt__snapshot_section(data, size, bvh->wide_nodes, bvh->wide_node_count, sizeof(MT_BVHWideNode))) &&
+           (!bvh->quantized_nodes || mt__snapshot_section(data, size, bvh->quantized_nodes, bvh->wide_node_count, sizeof(MT_BVHQuantizedNode))) &&
+           (!bvh->wide_slots || (mt__snapshot_section(data, size, bvh->wide_slots, bvh->node_count, sizeof(uint32_t)) && !bvh->wide_nodes != !bvh->quantized_nodes && bvh->wide_node_count > 0));
+}
+
+// whether every node of a tree stays inside the tree and every leaf inside the prim_total prims of its owner
+// children must come after their parents and parents before their children, so a corrupt tree cannot send traversal or refits round in a loop
+static int mt__snapshot_bvh_valid(const unsigned char *data, size_t size, const MT_SnapshotBVH *bvh, uint32_t prim_total)
+{
+    if (!mt__snapshot_bvh_fits(data, size, bvh))
+    {
+        return 0;
+    }
+
+    const MT_BVHNode *nodes = (const MT_BVHNode *)(data + bvh->nodes);
+    const uint32_t *parents = (const uint32_t *)(data + bvh->parents);
+    const uint32_t *prims = bvh->prims ? (const uint32_t *)(data + bvh->prims) : NULL;
+
+    // leaves index the tree's own prims when it kept them, and the owner's reordered prims otherwise
+    uint32_t leaf_prims = prims ? bvh->prim_count : prim_total;
+    for (uint32_t i = 0; prims && i < bvh->prim_count; ++i)
+    {
+        if (prims[i] >= prim_total)
+        {
+            return 0;
+        }
+    }
+
+    // the deepest path decides how much stack a traversal needs, so it is measured instead of trusting stack_size
+    uint32_t *depths = (uint32_t *)calloc(bvh->node_count, sizeof(uint32_t));
+    uint32_t max_depth = 0;
+    int b_valid = parents[0] == 0;
+
+    for (uint32_t i = 0; i < bvh->node_count && b_valid; ++i)
+    {
+        const MT_BVHNode *node = &nodes[i];
+        if (i > 0 && parents[i] >= i)
+        {
+            b_valid = 0;
+        }
+        else if (node->prim_count > 0)
+        {
+            b_valid = (uint64_t)node->index + node->prim_count <= leaf_prims;
+        }
+        else if (i + 1 >= bvh->node_count || node->index <= i + 1 || node->index >= bvh->node_count)
+        {
+            b_valid = 0;
+        }
+        else
+        {
+            uint32_t depth = depths[i] + 1;
+            depths[i + 1] = depths[i + 1] > depth ? depths[i + 1] : depth;
+            depths[node->index] = depths[node->index] > depth ? depths[node->index] : depth;
+            max_depth = max_depth > depth ? max_depth : depth;
+        }
+    }
+    free(depths);
+
+    if (!b_valid)
+    {
+        return 0;
+    }
+
+    if (!bvh->wide_slots)
+    {
+        return bvh->stack_size >= max_depth + 1;
+    }
+
+    const uint32_t *wide_slots = (const uint32_t *)(data + bvh->wide_slots);
+    for (uint32_t i = 0; i < bvh->node_count; ++i)
+    {
+        if (wide_slots[i] != UINT32_MAX && wide_slots[i] >= (uint64_t)bvh->wide_node_count * MT_BVH_WIDTH)
+        {
+            return 0;
+        }
+    }
+
+    const MT_BVHWideNode *wide_nodes = bvh->wide_nodes ? (const MT_BVHWideNode *)(data + bvh->wide_nodes) : NULL;
+    const MT_BVHQuantizedNode *quantized_nodes = bvh->quantized_nodes ? (const MT_BVHQuantizedNode *)(data + bvh->quantized_nodes) : NULL;
+
+    // the root is at depth 1 in the wide layout
+    depths = (uint32_t *)calloc(bvh->wide_node_count, sizeof(uint32_t));
+    depths[0] = 1;
+    max_depth = 1;
+
+    for (uint32_t i = 0; i < bvh->wide_node_count && b_valid; ++i)
+    {
+        const uint32_t *child = quantized_nodes ? quantized_nodes[i].child : wide_nodes[i].child;
+        const uint32_t *prim_count = quantized_nodes ? quantized_nodes[i].prim_count : wide_nodes[i].prim_count;
+        uint32_t child_count = quantized_nodes ? quantized_nodes[i].child_count : wide_nodes[i].child_count;
+
+        if (child_count > MT_BVH_WIDTH)
+        {
+            b_valid = 0;
+        }
+
+        for (uint32_t j = 0; j < child_count && b_valid; ++j)
+        {
+            if (prim_count[j] > 0)
+            {
+                b_valid = (uint64_t)child[j] + prim_count[j] <= leaf_prims;
+            }
+            else if (child[j] <= i || child[j] >= bvh->wide_node_count)
+            {
+                b_valid = 0;
+            }
+            else
+            {
+                uint32_t depth = depths[i] + 1;
+                depths[child[j]] = depths[child[j]] > depth ? depths[child[j]] : depth;
+                max_depth = max_depth > depth ? max_depth : depth;
+            }
+        }
+    }
+    free(depths);
+
+    return b_valid && bvh->stack_size >= max_depth * (MT_BVH_WIDTH - 1) + 1;
+}
+
+// checks everything the loader indexes with, down to every node of every tree it will traverse
+static int mt__snapshot_validate(const unsigned char *data, size_t size)
+{
+    if (!mt__snapshot_layout_matches(data, size, MT_SNAPSHOT_MAGIC, sizeof(MT_SnapshotHeader)))
+    {
+        return 0;
+    }
+
+    const MT_SnapshotHeader *header = (const MT_SnapshotHeader *)data;
+
+    // empty tables are stored at offset 0
+    const MT_SnapshotMesh *meshes = (const MT_SnapshotMesh *)mt__snapshot_section(data, size, header->meshes, header->mesh_count, sizeof(MT_SnapshotMesh));
+    const MT_SnapshotInstance *instances = (const MT_SnapshotInstance *)mt__snapshot_section(data, size, header->instances, header->instance_count, sizeof(MT_SnapshotInstance));
+    const MT_SnapshotSphereCloud *sphere_clouds = (const MT_SnapshotSphereCloud *)mt__snapshot_section(data, size, header->sphere_clouds, header->sphere_cloud_count, sizeof(MT_SnapshotSphereCloud));
+    const MT_SnapshotObject *objects = (const MT_SnapshotObject *)mt__snapshot_section(data, size, header->objects, header->object_count, sizeof(MT_SnapshotObject));
+    const MT_SnapshotBVH *bvhs = (const MT_SnapshotBVH *)mt__snapshot_section(data, size, header->bvhs, header->bvh_count, sizeof(MT_SnapshotBVH));
+
+    if ((header->material_count > 0 && !mt__snapshot_section(data, size, header->materials, header->material_count, sizeof(MT_Material))) ||
+        (header->mesh_count > 0 && !meshes) ||
+        (header->sphere_count > 0 && !mt__snapshot_section(data, size, header->spheres, header->sphere_count, sizeof(MT_SnapshotSphere))) ||
+        (header->instance_count > 0 && !instances) ||
+        (header->box_count > 0 && !mt__snapshot_section(data, size, header->boxes, header->box_count, sizeof(MT_SnapshotBox))) ||
+        (header->plane_count > 0 && !mt__snapshot_section(data, size, header->planes, header->plane_count, sizeof(MT_SnapshotPlane))) ||
+        (header->sphere_cloud_count > 0 && !sphere_clouds) ||
+        (header->object_count > 0 && !objects) ||
+        (header->bvh_count > 0 && !bvhs))
+    {
+        return 0;
+    }
+
+    // objects are never reordered, so the world's tree always looks them up through its prims
+    if (header->bvh != MT_SNAPSHOT_NONE && (header->bvh >= header->bvh_count || !bvhs[header->bvh].prims ||
+                                            !mt__snapshot_bvh_valid(data, size, &bvhs[header->bvh], header->object_count)))
+    {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < header->mesh_count; ++i)
+    {
+        const MT_SnapshotMesh *mesh = &meshes[i];
+
+        if ((mesh->vertex_count > 0 && !mt__snapshot_section(data, size, mesh->vertices, mesh->vertex_count, sizeof(MT_Vec3))) ||
+            (mesh->tri_count > 0 && (!mt__snapshot_section(data, size, mesh->indices, (uint64_t)mesh->tri_count * 3, sizeof(uint32_t)) ||
+                                     !mt__snapshot_section(data, size, mesh->normals, mesh->tri_count, sizeof(uint32_t)) ||
+                                     !mt__snapshot_section(data, size, mesh->materials, mesh->tri_count, sizeof(uint32_t)))) ||
+            (mesh->bvh != MT_SNAPSHOT_NONE && (mesh->bvh >= header->bvh_count || !mt__snapshot_bvh_valid(data, size, &bvhs[mesh->bvh], mesh->tri_count))) ||
+            (mesh->object != MT_SNAPSHOT_NONE && (mesh->object >= header->object_count || objects[mesh->object].type != MT_OBJECT_MESH || objects[mesh->object].index != i)))
+        {
+            return 0;
+        }
+
+        // tris are read through their indices, so one past the vertices would read outside the file
+        const uint32_t *indices = (const uint32_t *)(data + mesh->indices);
+        for (uint64_t j = 0; j < (uint64_t)mesh->tri_count * 3; ++j)
+        {
+            if (indices[j] >= mesh->vertex_count)
+            {
+                return 0;
+            }
+        }
+
+        // and their materials are looked up in the world's table as they are
+        const uint32_t *materials = (const uint32_t *)(data + mesh->materials);
+        for (uint32_t j = 0; j < mesh->tri_count; ++j)
+        {
+            if (materials[j] >= header->material_count)
+            {
+                return 0;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < header->sphere_cloud_count; ++i)
+    {
+        const MT_SnapshotSphereCloud *cloud = &sphere_clouds[i];
+
+        if ((cloud->sphere_count > 0 && (!mt__snapshot_section(data, size, cloud->blocks, mt__sphere_block_count(cloud->sphere_count), sizeof(MT_SphereBlock)) ||
+                                         !mt__snapshot_section(data, size, cloud->materials, cloud->sphere_count, sizeof(uint32_t)))) ||
+            (cloud->bvh != MT_SNAPSHOT_NONE && (cloud->bvh >= header->bvh_count || !mt__snapshot_bvh_valid(data, size, &bvhs[cloud->bvh], cloud->sphere_count))))
+        {
+            return 0;
+        }
+
+        const uint32_t *materials = (const uint32_t *)(data + cloud->materials);
+        for (uint32_t j = 0; j < cloud->sphere_count; ++j)
+        {
+            if (materials[j] >= header->material_count)
+            {
+                return 0;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < header->instance_count; ++i)
+    {
+        if (instances[i].mesh >= header->mesh_count)
+        {
+            return 0;
+        }
+    }
+
+    // a mesh is owned by exactly one object, or by the world's shared meshes
+    uint32_t world_nodes = header->bvh != MT_SNAPSHOT_NONE ? bvhs[header->bvh].node_count : 1;
+    for (uint32_t i = 0; i < header->object_count; ++i)
+    {
+        const MT_SnapshotObject *object = &objects[i];
+
+        if (object->leaf >= world_nodes)
+        {
+            return 0;
+        }
+
+        switch (object->type)
+        {
+        case MT_OBJECT_MESH:
+            if (object->index >= header->mesh_count || meshes[object->index].object != i)
+            {
+                return 0;
+            }
+            break;
+        case MT_OBJECT_SPHERE:
+            if (object->index >= header->sphere_count)
+            {
+                return 0;
+            }
+            break;
+        case MT_OBJECT_INSTANCE:
+            if (object->index >= header->instance_count)
+            {
+                return 0;
+            }
+            break;
+        case MT_OBJECT_BOX:
+            if (object->index >= header->box_count)
+            {
+                return 0;
+            }
+            break;
+        case MT_OBJECT_PLANE:
+            if (object->index >= header->plane_count)
+            {
+                return 0;
+            }
+            break;
+        case MT_OBJECT_SPHERE_CLOUD:
+            if (object->index >= header->sphere_cloud_count)
+            {
+                return 0;
+            }
+            break;
+        default:
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static MT_BVH *mt__snapshot_load_bvh(unsigned char *data, const MT_SnapshotBVH *record)
+{
+    MT_BVH *bvh = (MT_BVH *)malloc(sizeof(MT_BVH));
+    bvh->nodes = (MT_BVHNode *)(data + record->nodes);
+    bvh->node_count = record->node_count;
+    bvh->wide_nodes = record->wide_nodes ? (MT_BVHWideNode *)(data + record->wide_nodes) : NULL;
+    bvh->quantized_nodes = record->quantized_nodes ? (MT_BVHQuantizedNode *)(data + record->quantized_nodes) : NULL;
+    bvh->wide_node_count = record->wide_node_count;
+    bvh->max_depth = record->max_depth;
+    bvh->wide_max_depth = record->wide_max_depth;
+    bvh->stack_size = record->stack_size;
+    bvh->prims = record->prims ? (uint32_t *)(data + record->prims) : NULL;
+    bvh->prim_count = record->prim_count;
+    bvh->parents = (uint32_t *)(data + record->parents);
+    bvh->wide_slots = record->wide_slots ? (uint32_t *)(data + record->wide_slots) : NULL;
+    bvh->padding = record->padding;
+    bvh->sah_sum = record->sah_sum;
+    bvh->build_sah_cost = record->build_sah_cost;
+    bvh->build_ms = record->build_ms;
+    bvh->treelet_ms = record->treelet_ms;
+    bvh->b_borrowed = 1;
+    return bvh;
+}
+
+static inline MT_Material *mt__snapshot_material(MT_Material *materials, uint32_t material_count, uint32_t index)
+{
+    return index < material_count ? &materials[index] : NULL;
+}
+
+// maps a file written by mt_world_save_snapshot, the geometry, trees and materials are used in place and only the analytic objects and instances are copied out
+// the mapping is private, so refits and material edits stay in this process, returns NULL if the file is missing or was written by an incompatible build
+MT_World *mt_world_load_snapshot(const char *path)
+{
+    size_t size;
+    unsigned char *data = (unsigned char *)mt__file_map(path, &size);
+    if (!data)
+    {
+        return NULL;
+    }
+
+    if (!mt__snapshot_validate(data, size))
+    {
+        fprintf(stderr, "mt_world_load_snapshot: %s is not a compatible snapshot\n", path);
+        mt__file_unmap(data, size);
+        return NULL;
+    }
+
+    const MT_SnapshotHeader *header = (const MT_SnapshotHeader *)data;
+    MT_Material *materials = (MT_Material *)(data + header->materials);
+    const MT_SnapshotMesh *mesh_records = (const MT_SnapshotMesh *)(data + header->meshes);
+    const MT_SnapshotSphere *sphere_records = (const MT_SnapshotSphere *)(data + header->spheres);
+    const MT_SnapshotInstance *instance_records = (const MT_SnapshotInstance *)(data + header->instances);
+    const MT_SnapshotBox *box_records = (const MT_SnapshotBox *)(data + header->boxes);
+    const MT_SnapshotPlane *plane_records = (const MT_SnapshotPlane *)(data + header->planes);
+    const MT_SnapshotSphereCloud *sphere_cloud_records = (const MT_SnapshotSphereCloud *)(data + header->sphere_clouds);
+    const MT_SnapshotObject *object_records = (const MT_SnapshotObject *)(data + header->objects);
+    const MT_SnapshotBVH *bvh_records = (const MT_SnapshotBVH *)(data + header->bvhs);
+
+    MT_World *world = mt_world_create(header->object_count);
+    world->snapshot = data;
+    world->snapshot_size = size;
+    world->bvh_settings = header->bvh_settings;
+
+    world->materials = (MT_Material **)malloc(sizeof(MT_Material *) * (header->material_count > 0 ? header->material_count : 1));
+    world->material_count = header->material_count;
+    for (uint32_t i = 0; i < header->material_count; ++i)
+    {
+        world->materials[i] = &materials[i];
+    }
+
+    // a mesh is used entirely in place, only the intersection data is worked out from the mapped corners
+    MT_Mesh **meshes = (MT_Mesh **)malloc(sizeof(MT_Mesh *) * (header->mesh_count > 0 ? header->mesh_count : 1));
+    for (uint32_t i = 0; i < header->mesh_count; ++i)
+    {
+        const MT_SnapshotMesh *record = &mesh_records[i];
+
+        MT_Mesh *mesh = mt_mesh_create(0);
+        mesh->vertices = (MT_Vec3 *)(data + record->vertices);
+        mesh->indices = (uint32_t *)(data + record->indices);
+        mesh->normals = (uint32_t *)(data + record->normals);
+        mesh->tri_materials = (uint32_t *)(data + record->materials);
+        mesh->materials = world->materials;
+        mesh->material_count = world->material_count;
+        mesh->max_materials = world->material_count;
+        mesh->b_borrowed = 1;
+
+        mesh->tri_index = record->tri_count;
+        mesh->max_tris = record->tri_count;
+        mesh->vertex_index = record->vertex_count;
+        mesh->max_vertices = record->vertex_count;
+        mt__mesh_update_tri_blocks(mesh);
+        mesh->origin_offset = record->origin_offset;
+        mesh->bvh = record->bvh != MT_SNAPSHOT_NONE ? mt__snapshot_load_bvh(data, &bvh_records[record->bvh]) : NULL;
+        mesh->b_bvh_dirty = record->b_bvh_dirty;
+        mesh->b_bvh_slower = record->b_bvh_slower;
+        mesh->ray_cost = record->ray_cost;
+        meshes[i] = mesh;
+
+        if (record->object == MT_SNAPSHOT_NONE)
+        {
+            if (world->shared_mesh_index >= world->max_shared_meshes)
+            {
+                world->max_shared_meshes = world->max_shared_meshes > 0 ? world->max_shared_meshes * 2 : 16;
+                world->shared_meshes = (MT_Mesh **)realloc(world->shared_meshes, sizeof(MT_Mesh *) * world->max_shared_meshes);
+                world->shared_mesh_hashes = (uint32_t *)realloc(world->shared_mesh_hashes, sizeof(uint32_t) * world->max_shared_meshes);
+            }
+
+            world->shared_meshes[world->shared_mesh_index] = mesh;
+            world->shared_mesh_hashes[world->shared_mesh_index] = record->hash;
+            ++world->shared_mesh_index;
+        }
+    }
+
+    for (uint32_t i = 0; i < header->object_count; ++i)
+    {
+        const MT_SnapshotObject *record = &object_records[i];
+
+        // analytic objects and instances are copied into the world's arena, in the same order so i stays their id
+        switch (record->type)
+        {
+        case MT_OBJECT_MESH:
+            mt_world_add_object(world, meshes[record->index], MT_OBJECT_MESH);
+            break;
+        case MT_OBJECT_SPHERE:
+        {
+            const MT_SnapshotSphere *sphere_record = &sphere_records[record->index];
+            MT_Sphere *sphere = (MT_Sphere *)mt__world_create_object(world, sizeof(MT_Sphere), MT_OBJECT_SPHERE);
+            sphere->position = sphere_record->position;
+            sphere->radius = sphere_record->radius;
+            sphere->mat = mt__snapshot_material(materials, header->material_count, sphere_record->material);
+            break;
+        }
+        case MT_OBJECT_INSTANCE:
+        {
+            const MT_SnapshotInstance *instance_record = &instance_records[record->index];
+            MT_Instance *instance = (MT_Instance *)mt__world_create_object(world, sizeof(MT_Instance), MT_OBJECT_INSTANCE);
+            instance->mesh = meshes[instance_record->mesh];
+            instance->object_to_world = instance_record->object_to_world;
+            instance->world_to_object = instance_record->world_to_object;
+            instance->normal_to_world = instance_record->normal_to_world;
+            break;
+        }
+        case MT_OBJECT_BOX:
+        {
+            const MT_SnapshotBox *box_record = &box_records[record->index];
+            MT_Box *box = (MT_Box *)mt__world_create_object(world, sizeof(MT_Box), MT_OBJECT_BOX);
+            box->position = box_record->position;
+            memcpy(box->axes, box_record->axes, sizeof(box->axes));
+            box->half_size = box_record->half_size;
+            box->mat = mt__snapshot_material(materials, header->material_count, box_record->material);
+            break;
+        }
+        case MT_OBJECT_PLANE:
+        {
+            const MT_SnapshotPlane *plane_record = &plane_records[record->index];
+            MT_Plane *plane = (MT_Plane *)mt__world_create_object(world, sizeof(MT_Plane), MT_OBJECT_PLANE);
+            plane->position = plane_record->position;
+            plane->normal = plane_record->normal;
+            plane->mat = mt__snapshot_material(materials, header->material_count, plane_record->material);
+            break;
+        }
+        case MT_OBJECT_SPHERE_CLOUD:
+        {
+            // used in place like a mesh, the blocks are already laid out for this build's kernel
+            const MT_SnapshotSphereCloud *cloud_record = &sphere_cloud_records[record->index];
+            MT_SphereCloud *cloud = mt_sphere_cloud_create(0);
+            if (cloud_record->sphere_count > 0)
+            {
+                mt__aligned_free(cloud->blocks);
+                cloud->blocks = (MT_SphereBlock *)(data + cloud_record->blocks);
+                cloud->sphere_materials = (uint32_t *)(data + cloud_record->materials);
+                cloud->materials = world->materials;
+                cloud->material_count = world->material_count;
+                cloud->max_materials = world->material_count;
+                cloud->b_borrowed = 1;
+                cloud->sphere_index = cloud_record->sphere_count;
+                cloud->max_spheres = cloud_record->sphere_count;
+            }
+            cloud->bvh = cloud_record->bvh != MT_SNAPSHOT_NONE ? mt__snapshot_load_bvh(data, &bvh_records[cloud_record->bvh]) : NULL;
+            cloud->b_bvh_dirty = cloud_record->b_bvh_dirty;
+            cloud->b_bvh_slower = cloud_record->b_bvh_slower;
+            cloud->ray_cost = cloud_record->ray_cost;
+            mt_world_add_object(world, cloud, MT_OBJECT_SPHERE_CLOUD);
+            break;
+        }
+        }
+
+        world->object_bounds[i] = record->bounds;
+        world->object_leaves[i] = record->leaf;
+        if (record->b_dirty)
+        {
+            mt_world_mark_object_dirty(world, i);
+        }
+    }
+
+    free(meshes);
+
+    if (header->bvh != MT_SNAPSHOT_NONE)
+    {
+        world->bvh = mt__snapshot_load_bvh(data, &bvh_records[header->bvh]);
+        for (uint32_t i = 0; i < world->bvh->prim_count; ++i)
+        {
+            if (world->bvh->prims[i] >= world->bvh_object_count)
+            {
+                world->bvh_object_count = world->bvh->prims[i] + 1;
+            }
+        }
+    }
+
+    // planes are in no leaf, so the ones right after the last object in the tree were there when it was built too
+    if (world->bvh)
+    {
+        while (world->bvh_object_count < world->object_index && world->objects_track[world->bvh_object_count] == MT_OBJECT_PLANE)
+        {
+            ++world->bvh_object_count;
+        }
+        mt__world_index_leaves(world);
+    }
+    world->brute_ray_cost = header->brute_ray_cost;
+    world->bvh_ray_cost = header->bvh_ray_cost;
+    world->b_bvh_slower = header->b_bvh_slower;
+
+    if (header->b_has_environment)
+    {
+        world->environment = (MT_Environment *)malloc(sizeof(MT_Environment));
+        *world->environment = header->environment;
+    }
+
+    return world;
+}
+
+//////////////////////////////////
+// ========== STREAM ========== //
+//////////////////////////////////
+// a mesh stream keeps a mesh's tree and tris in a mapped file and decodes its tris a block at a time as rays reach them
+// the tris are stored in leaf order, so block b holds tris [b * MT_STREAM_BLOCK_TRIS, (b + 1) * MT_STREAM_BLOCK_TRIS)
+#define MT_STREAM_MAGIC "MTSTRM"
+#define MT_STREAM_BLOCK_TRIS 256
+
+// tris per leaf of a streamed mesh's tree, larger leaves mean fewer node pages to read per ray
+#define MT_STREAM_LEAF_TRIS 4
+
+// decoded blocks kept whatever the budget, enough for every render thread to hold one
+#define MT_STREAM_MIN_BLOCKS 64
+
+// blocks are decoded on their own, so a streamed tri carries its corners rather than indices into shared vertices
+typedef struct MT_StreamTri
+{
+    MT_Vec3 p[3];
+    uint32_t normal; // packed, see mt__normal_pack
+    uint32_t material;
+} MT_StreamTri;
+
+typedef struct MT_StreamHeader
+{
+    MT_SnapshotLayout layout;
+
+    uint64_t materials;
+    uint64_t tris; // tri_count MT_StreamTri
+    uint32_t material_count;
+    uint32_t tri_count;
+    uint32_t block_tris;
+
+    MT_Vec3 origin_offset;
+    float ray_cost;
+    MT_SnapshotBVH bvh;
+} MT_StreamHeader;
+
+// a block of tris decoded into the layout rays test resident meshes in
+typedef struct MT_StreamBlock
+{
+    MT_TriBlock tri_blocks[MT_STREAM_BLOCK_TRIS / MT_TRI_BLOCK_WIDTH];
+    uint32_t normals[MT_STREAM_BLOCK_TRIS];
+    uint32_t tri_materials[MT_STREAM_BLOCK_TRIS]; // indices into the stream's materials, as stored
+} MT_StreamBlock;
+
+// one decoded block, slots are linked into a list from most to least recently used
+typedef struct MT_StreamSlot
+{
+    MT_StreamBlock *decoded;
+    uint32_t block; // MT_SNAPSHOT_NONE while empty
+    uint32_t refs;  // rays testing its tris, a slot is only reused once this is 0
+    int b_ready;    // cleared while the block is being decoded
+    uint32_t prev, next;
+} MT_StreamSlot;
+
+typedef struct MT_MeshStream
+{
+    unsigned char *data;
+    size_t size;
+
+    const MT_StreamTri *tris;
+    uint32_t tri_count;
+    uint32_t block_count;
+    MT_Material *materials; // used in place from the mapping
+    uint32_t material_count;
+
+    uint32_t *block_slots; // the slot each block is decoded in, MT_SNAPSHOT_NONE if it is not
+    MT_StreamSlot *slots;
+    MT_StreamBlock *slot_blocks;
+    uint32_t slot_count;
+    uint32_t lru_head, lru_tail;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t ready_cond;
+} MT_MeshStream;
+
+static void mt__stream_unlink(MT_MeshStream *stream, uint32_t slot_index)
+{
+    MT_StreamSlot *slot = &stream->slots[slot_index];
+
+    if (slot->prev != MT_SNAPSHOT_NONE)
+    {
+        stream->slots[slot->prev].next = slot->next;
+    }
+    else
+    {
+        stream->lru_head = slot->next;
+    }
+
+    if (slot->next != MT_SNAPSHOT_NONE)
+    {
+        stream->slots[slot->next].prev = slot->prev;
+    }
+    else
+    {
+        stream->lru_tail = slot->prev;
+    }
+}
+
+static void mt__stream_push_front(MT_MeshStream *stream, uint32_t slot_index)
+{
+    MT_StreamSlot *slot = &stream->slots[slot_index];
+    slot->prev = MT_SNAPSHOT_NONE;
+    slot->next = stream->lru_head;
+
+    if (stream->lru_head != MT_SNAPSHOT_NONE)
+    {
+        stream->slots[stream->lru_head].prev = slot_index;
+    }
+    else
+    {
+        stream->lru_tail = slot_index;
+    }
+    stream->lru_head = slot_index;
 }
 
-static uint32_t mt__morton_code30(uint32_t x, uint32_t y, uint32_t z)
+// decoding only needs the block's part of the file once, so its pages are dropped again right after
+static void mt__stream_decode(MT_MeshStream *stream, uint32_t block, MT_StreamBlock *out)
 {
-    uint32_t e_x = mt__expand_bits10to30(x);
-    uint32_t e_y = mt__expand_bits10to30(y);
-    uint32_t e_z = mt__expand_bits10to30(z);
-    return e_x | (e_y << 1) | (e_z << 2);
+    uint32_t first = block * MT_STREAM_BLOCK_TRIS;
+    uint32_t count = stream->tri_count - first < MT_STREAM_BLOCK_TRIS ? stream->tri_count - first : MT_STREAM_BLOCK_TRIS;
+    const MT_StreamTri *records = &stream->tris[first];
+
+#ifndef _WIN32
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)records & ~(uintptr_t)(page_size - 1);
+    size_t length = (uintptr_t)(records + count) - start;
+    madvise((void *)start, length, MADV_WILLNEED);
+#endif
+
+    memset(out->tri_blocks, 0, sizeof(out->tri_blocks));
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        mt__tri_block_set(&out->tri_blocks[i / MT_TRI_BLOCK_WIDTH], i % MT_TRI_BLOCK_WIDTH, records[i].p);
+        out->normals[i] = records[i].normal;
+        out->tri_materials[i] = records[i].material;
+    }
+
+#ifndef _WIN32
+    madvise((void *)start, length, MADV_DONTNEED);
+#endif
 }
-//
 
-static int mt__morton_compare(const void *a, const void *b)
+// where a thread decodes a block when every slot is pinned, a thread only ever holds one block at a time
+static __thread MT_StreamBlock mt__stream_scratch;
+
+// returns the block's decoded tris and pins them until mt__stream_release
+// if every slot is pinned by other rays the block is decoded into the thread's scratch instead and out_slot is MT_SNAPSHOT_NONE
+static MT_StreamBlock *mt__stream_acquire(MT_MeshStream *stream, uint32_t block, uint32_t *out_slot)
 {
-    const MT_BVHMorton *m_a = (const MT_BVHMorton *)a;
-    const MT_BVHMorton *m_b = (const MT_BVHMorton *)b;
+    pthread_mutex_lock(&stream->mutex);
 
-    if (m_a->morton_code < m_b->morton_code)
+    uint32_t slot_index = stream->block_slots[block];
+    if (slot_index != MT_SNAPSHOT_NONE)
     {
-        return -1;
+        MT_StreamSlot *slot = &stream->slots[slot_index];
+        ++slot->refs;
+        mt__stream_unlink(stream, slot_index);
+        mt__stream_push_front(stream, slot_index);
+
+        // another ray is still decoding it
+        while (!slot->b_ready)
+        {
+            pthread_cond_wait(&stream->ready_cond, &stream->mutex);
+        }
+
+        pthread_mutex_unlock(&stream->mutex);
+        *out_slot = slot_index;
+        return slot->decoded;
     }
-    if (m_a->morton_code > m_b->morton_code)
+
+    // the least recently used slot nobody is testing
+    slot_index = stream->lru_tail;
+    while (slot_index != MT_SNAPSHOT_NONE && stream->slots[slot_index].refs > 0)
     {
-        return 1;
+        slot_index = stream->slots[slot_index].prev;
     }
-    return 0;
-}
 
-static int mt__morton_find_split(MT_BVHMorton *mortons, int start, int end)
-{
-    if (start == end)
+    if (slot_index == MT_SNAPSHOT_NONE)
     {
-        return start;
+        pthread_mutex_unlock(&stream->mutex);
+        mt__stream_decode(stream, block, &mt__stream_scratch);
+        *out_slot = MT_SNAPSHOT_NONE;
+        return &mt__stream_scratch;
     }
 
-    uint32_t first_code = mortons[start].morton_code;
-    uint32_t last_code = mortons[end].morton_code;
+    MT_StreamSlot *slot = &stream->slots[slot_index];
+    if (slot->block != MT_SNAPSHOT_NONE)
+    {
+        stream->block_slots[slot->block] = MT_SNAPSHOT_NONE;
+    }
+    slot->block = block;
+    slot->refs = 1;
+    slot->b_ready = 0;
+    stream->block_slots[block] = slot_index;
+    mt__stream_unlink(stream, slot_index);
+    mt__stream_push_front(stream, slot_index);
+
+    // other rays can keep using the cache while this one reads from the file
+    pthread_mutex_unlock(&stream->mutex);
+    mt__stream_decode(stream, block, slot->decoded);
+
+    pthread_mutex_lock(&stream->mutex);
+    slot->b_ready = 1;
+    pthread_cond_broadcast(&stream->ready_cond);
+    pthread_mutex_unlock(&stream->mutex);
+
+    *out_slot = slot_index;
+    return slot->decoded;
+}
 
-    if (first_code == last_code)
+static void mt__stream_release(MT_MeshStream *stream, uint32_t slot_index)
+{
+    if (slot_index == MT_SNAPSHOT_NONE)
     {
-        return (start + end) / 2;
+        return;
     }
 
-    int common_prefix = __builtin_clz(first_code ^ last_code);
-    int split = start;
-    int step = end - start;
+    pthread_mutex_lock(&stream->mutex);
+    --stream->slots[slot_index].refs;
+    pthread_mutex_unlock(&stream->mutex);
+}
 
-    do
+static void mt__stream_delete(MT_MeshStream *stream)
+{
+    if (!stream)
     {
-        step = (step + 1) >> 1;
-        int new_split = split + step;
+        return;
+    }
 
-        if (new_split < end)
-        {
-            uint32_t split_code = mortons[new_split].morton_code;
-            if (__builtin_clz(first_code ^ split_code) > common_prefix)
-            {
-                split = new_split;
-            }
-        }
-    } while (step > 1);
+    pthread_mutex_destroy(&stream->mutex);
+    pthread_cond_destroy(&stream->ready_cond);
 
-    return split;
+    free(stream->block_slots);
+    free(stream->slots);
+    mt__aligned_free(stream->slot_blocks);
+    mt__file_unmap(stream->data, stream->size);
+    free(stream);
 }
 
-static MT_BVHNode *mt__bvh_node_create(MT_World *world, MT_BVHMorton *mortons, int start, int end)
+static float mt__bvh_estimate_tri_ray_cost(const MT_BVH *bvh);
+
+// writes the mesh's tris and a tree over them to a file mt_mesh_create_from_stream can page in on demand
+// the tree is built here with thread_count threads, so the whole mesh has to fit in memory once, returns 0 if the file could not be written
+int mt_mesh_save_stream(MT_Mesh *mesh, const char *path, unsigned int thread_count)
 {
-    MT_BVHNode *node = (MT_BVHNode *)malloc(sizeof(MT_BVHNode));
+    if (mesh->stream || mesh->tri_index == 0)
+    {
+        return 0;
+    }
 
-    // determine if it will be a leaf node
-    if (start == end)
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
     {
-        int object_index = mortons[start].object_index;
-        void *obj = world->objects[object_index];
-        MT_Bounds bounds;
-        switch (world->objects_track[object_index])
-        {
-        case MT_OBJECT_MESH:
-            bounds = mt__bounds_calculate_mesh((MT_Mesh *)obj);
-            break;
-        case MT_OBJECT_SPHERE:
-            bounds = mt__bounds_calculate_sphere((MT_Sphere *)obj);
-            break;
-        }
+        perror("fopen");
+        return 0;
+    }
 
-        bounds.start = mt_vec3_sub_v(bounds.start, 0.1f);
-        bounds.end = mt_vec3_add_v(bounds.end, 0.1f);
+    MT_StreamHeader header = {0};
+    MT_SnapshotWriter writer = {0};
+    writer.fp = fp;
 
-        node->bounds = bounds;
-        node->child_left = NULL;
-        node->child_right = NULL;
-        node->leaf_object_index = object_index;
+    if (fwrite(&header, 1, sizeof(header), fp) != sizeof(header))
+    {
+        writer.b_failed = 1;
     }
-    else
+    writer.offset = sizeof(header);
+
+    MT_Bounds *tri_bounds = (MT_Bounds *)malloc(sizeof(MT_Bounds) * mesh->tri_index);
+    MT_Vec3 *tri_centers = (MT_Vec3 *)malloc(sizeof(MT_Vec3) * mesh->tri_index);
+    for (unsigned int i = 0; i < mesh->tri_index; ++i)
     {
-        int split_pos = mt__morton_find_split(mortons, start, end);
+        MT_Vec3 p[3];
+        mt__mesh_tri_corners(mesh, i, p);
 
-        node->child_left = mt__bvh_node_create(world, mortons, start, split_pos);
-        node->child_right = mt__bvh_node_create(world, mortons, split_pos + 1, end);
-        node->bounds = mt__bounds_union(node->child_left->bounds, node->child_right->bounds);
-        node->leaf_object_index = -1;
+        tri_bounds[i] = mt__bounds_create_invalid();
+        mt__bounds_shift_mesh_tri(mesh, i, &tri_bounds[i]);
+        tri_centers[i] = mt_vec3_div_v(mt_vec3_add(mt_vec3_add(p[0], p[1]), p[2]), 3.0f);
     }
 
-    return node;
-}
+    // quantized wide nodes are the smallest layout, so a ray pages in the fewest bytes of tree
+    MT_BVHSettings settings = (MT_BVHSettings){MT_BVH_BUILDER_SAH, MT_STREAM_LEAF_TRIS, 1, 1, thread_count > 0 ? thread_count : 1, 0.0f, 0};
+    MT_BVH *bvh = mt__bvh_build(&settings, tri_bounds, tri_centers, mesh->tri_index, MT_BVH_TRI_PADDING, NULL, NULL);
 
-void mt_world_recalculate_bvh(MT_World *world)
-{
-    if (world->object_index <= 0)
+    free(tri_bounds);
+    free(tri_centers);
+
+    // tris are written in leaf order a block at a time, the tree then needs no prims to find them
+    MT_StreamTri *records = (MT_StreamTri *)malloc(sizeof(MT_StreamTri) * MT_STREAM_BLOCK_TRIS);
+    for (uint32_t first = 0; first < bvh->prim_count; first += MT_STREAM_BLOCK_TRIS)
     {
-        return;
-    }
+        uint32_t count = bvh->prim_count - first < MT_STREAM_BLOCK_TRIS ? bvh->prim_count - first : MT_STREAM_BLOCK_TRIS;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t tri = bvh->prims[first + i];
+
+            mt__mesh_tri_corners(mesh, tri, records[i].p);
+            records[i].normal = mesh->normals[tri];
+            records[i].material = mt__snapshot_material_index(&writer, mt__mesh_tri_material(mesh, tri));
+        }
 
-    MT_Bounds world_bounds = mt__world_calculate_bounds(world);
+        // blocks are written back to back, so only the first one is aligned
+        if (first == 0)
+        {
+            header.tris = mt__snapshot_write(&writer, records, sizeof(MT_StreamTri) * count);
+        }
+        else if (fwrite(records, sizeof(MT_StreamTri), count, fp) != count)
+        {
+            writer.b_failed = 1;
+        }
+        else
+        {
+            writer.offset += sizeof(MT_StreamTri) * count;
+        }
+    }
+    free(records);
 
-    float bound_size_x = world_bounds.end.x - world_bounds.start.x;
-    float bound_size_y = world_bounds.end.y - world_bounds.start.y;
-    float bound_size_z = world_bounds.end.z - world_bounds.start.z;
+    free(bvh->prims);
+    bvh->prims = NULL;
+    mt__snapshot_write_bvh(&writer, bvh);
 
-    // needs to be 2^10 for 10 bit morton codes
-    const int scale = 1023;
+    header.bvh = writer.bvhs[0];
+    header.tri_count = bvh->prim_count;
+    header.block_tris = MT_STREAM_BLOCK_TRIS;
+    header.origin_offset = mesh->origin_offset;
+    header.ray_cost = mt__bvh_estimate_tri_ray_cost(bvh);
+    mt__bvh_delete(bvh);
 
-    MT_BVHMorton *mortons = (MT_BVHMorton *)malloc(sizeof(MT_BVHMorton) * world->object_index);
+    MT_Material *materials = (MT_Material *)malloc(sizeof(MT_Material) * (writer.material_count > 0 ? writer.material_count : 1));
+    for (uint32_t i = 0; i < writer.material_count; ++i)
+    {
+        materials[i] = *writer.materials[i];
+    }
+    header.material_count = writer.material_count;
+    header.materials = mt__snapshot_write(&writer, materials, sizeof(MT_Material) * writer.material_count);
+    header.layout = mt__snapshot_layout(MT_STREAM_MAGIC, writer.offset);
 
-    for (int i = 0; i < world->object_index; ++i)
+    if (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header, 1, sizeof(header), fp) != sizeof(header))
+    {
+        writer.b_failed = 1;
+    }
+    if (fclose(fp) != 0)
     {
-        MT_Vec3 object_pos = {0};
+        writer.b_failed = 1;
+    }
 
-        switch (world->objects_track[i])
-        {
-        case MT_OBJECT_MESH:
-            MT_Mesh *mesh = (MT_Mesh *)world->objects[i];
-            object_pos = mesh->origin_offset;
-            break;
-        case MT_OBJECT_SPHERE:
-            MT_Sphere *sphere = (MT_Sphere *)world->objects[i];
-            object_pos = sphere->position;
-            break;
-        }
+    free(materials);
+    free(writer.materials);
+    free(writer.bvhs);
+
+    return !writer.b_failed;
+}
 
-        uint32_t x_rel = (uint32_t)fminf(scale, fmaxf(0, floorf((object_pos.x - world_bounds.start.x) / bound_size_x * scale)));
-        uint32_t y_rel = (uint32_t)fminf(scale, fmaxf(0, floorf((object_pos.y - world_bounds.start.y) / bound_size_y * scale)));
-        uint32_t z_rel = (uint32_t)fminf(scale, fmaxf(0, floorf((object_pos.z - world_bounds.start.z) / bound_size_z * scale)));
+// maps a file written by mt_mesh_save_stream, only the tree's nodes are read in as rays visit them
+// at most resident_bytes of decoded tris are kept, least recently used blocks first make room for new ones
+// the mesh's tris cannot be edited or moved, place it with instances instead, returns NULL if the file is missing or incompatible
+MT_Mesh *mt_mesh_create_from_stream(const char *path, size_t resident_bytes)
+{
+    size_t size;
+    unsigned char *data = (unsigned char *)mt__file_map(path, &size);
+    if (!data)
+    {
+        return NULL;
+    }
 
-        uint32_t morton = mt__morton_code30(x_rel, y_rel, z_rel);
+    const MT_StreamHeader *header = (const MT_StreamHeader *)data;
+    if (!mt__snapshot_layout_matches(data, size, MT_STREAM_MAGIC, sizeof(MT_StreamHeader)) ||
+        header->block_tris != MT_STREAM_BLOCK_TRIS ||
+        header->tri_count == 0 ||
+        header->tri_count != header->bvh.prim_count ||
+        header->bvh.prims != 0 ||
+        !mt__snapshot_section(data, size, header->tris, header->tri_count, sizeof(MT_StreamTri)) ||
+        (header->material_count > 0 && !mt__snapshot_section(data, size, header->materials, header->material_count, sizeof(MT_Material))) ||
+        !mt__snapshot_bvh_valid(data, size, &header->bvh, header->tri_count))
+    {
+        fprintf(stderr, "mt_mesh_create_from_stream: %s is not a compatible mesh stream\n", path);
+        mt__file_unmap(data, size);
+        return NULL;
+    }
 
-        mortons[i].morton_code = morton;
-        mortons[i].object_index = i;
+#ifndef _WIN32
+    // rays jump around the tree, reading ahead would mostly fetch nodes no ray needs
+    madvise(data, size, MADV_RANDOM);
+#endif
+
+    MT_MeshStream *stream = (MT_MeshStream *)malloc(sizeof(MT_MeshStream));
+    stream->data = data;
+    stream->size = size;
+    stream->tris = (const MT_StreamTri *)(data + header->tris);
+    stream->tri_count = header->tri_count;
+    stream->block_count = (header->tri_count + MT_STREAM_BLOCK_TRIS - 1) / MT_STREAM_BLOCK_TRIS;
+    stream->materials = (MT_Material *)(data + header->materials);
+    stream->material_count = header->material_count;
+
+    size_t block_bytes = sizeof(MT_StreamBlock);
+    size_t slot_count = resident_bytes / block_bytes;
+    slot_count = slot_count > MT_STREAM_MIN_BLOCKS ? slot_count : MT_STREAM_MIN_BLOCKS;
+    slot_count = slot_count < stream->block_count ? slot_count : stream->block_count;
+    stream->slot_count = (uint32_t)slot_count;
+
+    stream->block_slots = (uint32_t *)malloc(sizeof(uint32_t) * stream->block_count);
+    memset(stream->block_slots, 0xFF, sizeof(uint32_t) * stream->block_count);
+
+    stream->slots = (MT_StreamSlot *)malloc(sizeof(MT_StreamSlot) * stream->slot_count);
+    stream->slot_blocks = (MT_StreamBlock *)mt__aligned_malloc(block_bytes * stream->slot_count, MT_TRI_BLOCK_ALIGN);
+    stream->lru_head = MT_SNAPSHOT_NONE;
+    stream->lru_tail = MT_SNAPSHOT_NONE;
+    for (uint32_t i = 0; i < stream->slot_count; ++i)
+    {
+        stream->slots[i] = (MT_StreamSlot){&stream->slot_blocks[i], MT_SNAPSHOT_NONE, 0, 1, MT_SNAPSHOT_NONE, MT_SNAPSHOT_NONE};
+        mt__stream_push_front(stream, i);
     }
 
-    qsort(mortons, world->object_index, sizeof(MT_BVHMorton), mt__morton_compare);
-    world->bvh = mt__bvh_node_create(world, mortons, 0, world->object_index - 1);
-    free(mortons);
+    pthread_mutex_init(&stream->mutex, NULL);
+    pthread_cond_init(&stream->ready_cond, NULL);
+
+    // the mesh itself holds no tris, rays reach them through the tree
+    MT_Mesh *mesh = mt_mesh_create(0);
+    mesh->stream = stream;
+    mesh->bvh = mt__snapshot_load_bvh(data, &header->bvh);
+    mesh->b_bvh_dirty = 0;
+    mesh->b_bvh_slower = 0;
+    mesh->ray_cost = header->ray_cost;
+    mesh->origin_offset = header->origin_offset;
+
+    return mesh;
 }
 
 //////////////////////////////////
@@ -1547,6 +8100,8 @@ typedef struct MT_RenderSettings
     int b_progressive;
     int b_antialias;
     int b_use_bvh;
+    int b_auto_bvh;
+    int b_use_grid;
 } MT_RenderSettings;
 
 typedef struct MT_RenderPixel
@@ -1580,128 +8135,518 @@ typedef struct MT_RenderChunk
     pthread_cond_t wake_cond;
 } MT_RenderChunk;
 
-typedef struct MT_Renderer
+typedef struct MT_Renderer
+{
+    MT_RenderSettings settings;
+
+    pthread_t *threads;
+    MT_RenderChunk **render_chunks;
+
+    MT_RenderThreadStation thread_station;
+} MT_Renderer;
+
+// what intersection keeps of the closest hit so far, mt__render_resolve_hit turns it into an MT_RayHit once nothing closer is left
+typedef struct MT_HitRecord
+{
+    float t;         // FLT_MAX until something is hit
+    float u, v;      // barycentrics of the tri hit, unused for spheres
+    uint32_t object; // index into the world's objects
+    uint32_t prim;   // tri within the mesh
+    int is_backface;
+} MT_HitRecord;
+
+// tests tris [start, end) of precomputed blocks, only the closest one hit is written to the record
+static void mt__render_handle_tri_blocks(MT_Ray *ray, const MT_TriBlock *tri_blocks, uint32_t start, uint32_t end, MT_HitRecord *hit)
+{
+    if (start >= end)
+    {
+        return;
+    }
+
+    uint32_t block_first = start / MT_TRI_BLOCK_WIDTH;
+    uint32_t block_last = (end - 1) / MT_TRI_BLOCK_WIDTH;
+    for (uint32_t b = block_first; b <= block_last; ++b)
+    {
+        float t[MT_TRI_BLOCK_WIDTH];
+        float u[MT_TRI_BLOCK_WIDTH];
+        float v[MT_TRI_BLOCK_WIDTH];
+        unsigned int backface;
+        unsigned int mask = mt__ray_hit_tri_block_wide(ray, &tri_blocks[b], hit->t, t, u, v, &backface);
+
+        // drop the lanes outside [start, end) in the first and last block
+        uint32_t block_start = b * MT_TRI_BLOCK_WIDTH;
+        if (start > block_start)
+        {
+            mask &= ~0u << (start - block_start);
+        }
+        if (end - block_start < MT_TRI_BLOCK_WIDTH)
+        {
+            mask &= (1u << (end - block_start)) - 1;
+        }
+
+        // lowest lane first and a strict compare, so ties go to the earliest tri like the scalar loop
+        while (mask)
+        {
+            uint32_t lane = (uint32_t)__builtin_ctz(mask);
+            mask &= mask - 1;
+            if (t[lane] < hit->t)
+            {
+                hit->t = t[lane];
+                hit->u = u[lane];
+                hit->v = v[lane];
+                hit->prim = block_start + lane;
+                hit->is_backface = (backface >> lane) & 1;
+            }
+        }
+    }
+}
+
+// for tris that moved since their blocks were built
+static void mt__render_handle_mesh_tri(MT_Ray *ray, const MT_Mesh *mesh, uint32_t tri, MT_HitRecord *hit)
+{
+    const uint32_t *index = &mesh->indices[tri * 3];
+    MT_Vec3 p0 = mesh->vertices[index[0]];
+
+    float t, u, v;
+    int b_backface;
+    if (mt__ray_hit_tri_edges(ray, p0, mt_vec3_sub(mesh->vertices[index[1]], p0), mt_vec3_sub(mesh->vertices[index[2]], p0), &t, &u, &v, &b_backface) && t < hit->t)
+    {
+        hit->t = t;
+        hit->u = u;
+        hit->v = v;
+        hit->prim = tri;
+        hit->is_backface = b_backface;
+    }
+}
+
+// what a bvh leaf callback is filling in, target is the world or mesh the bvh was built over
+typedef struct MT_RenderQuery
+{
+    void *target;
+    MT_HitRecord *hit;
+} MT_RenderQuery;
+
+// a leaf can straddle two blocks, each is pinned only while its own tris are tested
+static float mt__render_handle_stream_leaf(void *data, MT_Ray *ray, uint32_t prim_start, uint32_t prim_count)
+{
+    MT_RenderQuery *query = (MT_RenderQuery *)data;
+    MT_MeshStream *stream = ((MT_Mesh *)query->target)->stream;
+
+    uint32_t prim_end = prim_start + prim_count;
+    for (uint32_t i = prim_start; i < prim_end;)
+    {
+        uint32_t block = i / MT_STREAM_BLOCK_TRIS;
+        uint32_t block_start = block * MT_STREAM_BLOCK_TRIS;
+        uint32_t block_end = block_start + MT_STREAM_BLOCK_TRIS < prim_end ? block_start + MT_STREAM_BLOCK_TRIS : prim_end;
+
+        // the decoded tris are numbered from the start of their block
+        float closest_t = query->hit->t;
+        uint32_t slot;
+        MT_StreamBlock *decoded = mt__stream_acquire(stream, block, &slot);
+        mt__render_handle_tri_blocks(ray, decoded->tri_blocks, i - block_start, block_end - block_start, query->hit);
+        mt__stream_release(stream, slot);
+        if (query->hit->t < closest_t)
+        {
+            query->hit->prim += block_start;
+        }
+        i = block_end;
+    }
+
+    return query->hit->t;
+}
+
+static void mt__render_handle_mesh(MT_Ray *ray, MT_Mesh *mesh, MT_HitRecord *hit)
+{
+    // a streamed mesh only has a few blocks of tris in memory at a time, so it is always traversed
+    if (mesh->stream)
+    {
+        MT_RenderQuery query = {mesh, hit};
+        mt__bvh_traverse(mesh->bvh, ray, hit->t, mt__render_handle_stream_leaf, &query);
+        return;
+    }
+
+    if (mesh->tri_blocks && !mesh->b_bvh_dirty)
+    {
+        mt__render_handle_tri_blocks(ray, mesh->tri_blocks, 0, mesh->tri_index, hit);
+        return;
+    }
+
+    for (uint32_t i = 0; i < mesh->tri_index; ++i)
+    {
+        mt__render_handle_mesh_tri(ray, mesh, i, hit);
+    }
+}
+
+static float mt__render_handle_mesh_leaf(void *data, MT_Ray *ray, uint32_t prim_start, uint32_t prim_count)
+{
+    MT_RenderQuery *query = (MT_RenderQuery *)data;
+    MT_Mesh *mesh = (MT_Mesh *)query->target;
+
+    // the tree is only traversed while it is up to date, and the blocks are built with it
+    if (!mesh->bvh->prims)
+    {
+        mt__render_handle_tri_blocks(ray, mesh->tri_blocks, prim_start, prim_start + prim_count, query->hit);
+        return query->hit->t;
+    }
+
+    for (uint32_t i = prim_start; i < prim_start + prim_count; ++i)
+    {
+        uint32_t tri_index = mesh->bvh->prims[i];
+        mt__render_handle_tri_blocks(ray, mesh->tri_blocks, tri_index, tri_index + 1, query->hit);
+    }
+
+    return query->hit->t;
+}
+
+// descends the mesh's triangle bvh, falls back to testing every triangle if it is out of date or expected to be slower
+static void mt__render_handle_mesh_bvh(MT_Ray *ray, MT_Mesh *mesh, MT_HitRecord *hit)
+{
+    if (!mesh->bvh || mesh->b_bvh_dirty || mesh->b_bvh_slower || mesh->stream)
+    {
+        mt__render_handle_mesh(ray, mesh, hit);
+        return;
+    }
+
+    // anything past the closest hit found in other objects can be culled right away
+    MT_RenderQuery query = {mesh, hit};
+    mt__bvh_traverse(mesh->bvh, ray, hit->t, mt__render_handle_mesh_leaf, &query);
+}
+
+static void mt__render_handle_sphere(MT_Ray *ray, MT_Sphere *sphere, MT_HitRecord *hit)
+{
+    float t;
+    if (mt__ray_hit_sphere(ray, sphere, &t) && t < hit->t)
+    {
+        hit->t = t;
+    }
+}
+
+// tests spheres [start, end) of a cloud's blocks, only the closest one hit is written to the record
+static void mt__render_handle_sphere_blocks(MT_Ray *ray, const MT_SphereBlock *blocks, uint32_t start, uint32_t end, MT_HitRecord *hit)
+{
+    if (start >= end)
+    {
+        return;
+    }
+
+    uint32_t block_first = start / MT_TRI_BLOCK_WIDTH;
+    uint32_t block_last = (end - 1) / MT_TRI_BLOCK_WIDTH;
+    for (uint32_t b = block_first; b <= block_last; ++b)
+    {
+        float t[MT_TRI_BLOCK_WIDTH];
+        unsigned int mask = mt__ray_hit_sphere_block_wide(ray, &blocks[b], hit->t, t);
+
+        // drop the lanes outside [start, end) in the first and last block, the padding past the last sphere among them
+        uint32_t block_start = b * MT_TRI_BLOCK_WIDTH;
+        if (start > block_start)
+        {
+            mask &= ~0u << (start - block_start);
+        }
+        if (end - block_start < MT_TRI_BLOCK_WIDTH)
+        {
+            mask &= (1u << (end - block_start)) - 1;
+        }
+
+        // lowest lane first and a strict compare, so ties go to the earliest sphere
+        while (mask)
+        {
+            uint32_t lane = (uint32_t)__builtin_ctz(mask);
+            mask &= mask - 1;
+            if (t[lane] < hit->t)
+            {
+                hit->t = t[lane];
+                hit->prim = block_start + lane;
+            }
+        }
+    }
+}
+
+static float mt__render_handle_sphere_cloud_leaf(void *data, MT_Ray *ray, uint32_t prim_start, uint32_t prim_count)
+{
+    MT_RenderQuery *query = (MT_RenderQuery *)data;
+    MT_SphereCloud *cloud = (MT_SphereCloud *)query->target;
+
+    if (!cloud->bvh->prims)
+    {
+        mt__render_handle_sphere_blocks(ray, cloud->blocks, prim_start, prim_start + prim_count, query->hit);
+        return query->hit->t;
+    }
+
+    for (uint32_t i = prim_start; i < prim_start + prim_count; ++i)
+    {
+        uint32_t sphere = cloud->bvh->prims[i];
+        mt__render_handle_sphere_blocks(ray, cloud->blocks, sphere, sphere + 1, query->hit);
+    }
+
+    return query->hit->t;
+}
+
+// descends the cloud's sphere bvh, falls back to testing every block if it is out of date or expected to be slower
+static void mt__render_handle_sphere_cloud(MT_Ray *ray, MT_SphereCloud *cloud, MT_HitRecord *hit, int b_use_bvh)
+{
+    if (!b_use_bvh || !cloud->bvh || cloud->b_bvh_dirty || cloud->b_bvh_slower)
+    {
+        mt__render_handle_sphere_blocks(ray, cloud->blocks, 0, cloud->sphere_index, hit);
+        return;
+    }
+
+    MT_RenderQuery query = {cloud, hit};
+    mt__bvh_traverse(cloud->bvh, ray, hit->t, mt__render_handle_sphere_cloud_leaf, &query);
+}
+
+static void mt__render_handle_box(MT_Ray *ray, MT_Box *box, MT_HitRecord *hit)
+{
+    float t;
+    uint32_t face;
+    int b_backface;
+    if (mt__ray_hit_box(ray, box, &t, &face, &b_backface) && t < hit->t)
+    {
+        hit->t = t;
+        hit->prim = face;
+        hit->is_backface = b_backface;
+    }
+}
+
+static void mt__render_handle_plane(MT_Ray *ray, MT_Plane *plane, MT_HitRecord *hit)
+{
+    float t;
+    int b_backface;
+    if (mt__ray_hit_plane(ray, plane, &t, &b_backface) && t < hit->t)
+    {
+        hit->t = t;
+        hit->is_backface = b_backface;
+    }
+}
+
+// the ray is moved into the mesh's space instead of the mesh into the world's
+// its direction is left unnormalized so hit distances stay comparable with world space ones
+static void mt__render_handle_instance(MT_Ray *ray, MT_Instance *instance, MT_HitRecord *hit, int b_use_bvh)
+{
+    MT_Ray local_ray = *ray;
+    local_ray.origin = mt_mat4x4_mult_vec3(instance->world_to_object, ray->origin);
+    local_ray.direction = mt__mat4x4_mult_dir(&instance->world_to_object, ray->direction);
+
+    if (b_use_bvh)
+    {
+        mt__render_handle_mesh_bvh(&local_ray, instance->mesh, hit);
+    }
+    else
+    {
+        mt__render_handle_mesh(&local_ray, instance->mesh, hit);
+    }
+}
+
+// b_use_bvh picks whether meshes and sphere clouds are tested through their own bvh
+static void mt__render_handle_object(MT_Ray *ray, MT_World *world, uint32_t index, MT_HitRecord *hit, int b_use_bvh)
+{
+    float closest_t = hit->t;
+
+    switch (world->objects_track[index])
+    {
+    case MT_OBJECT_MESH:
+        if (b_use_bvh)
+        {
+            mt__render_handle_mesh_bvh(ray, (MT_Mesh *)world->objects[index], hit);
+        }
+        else
+        {
+            mt__render_handle_mesh(ray, (MT_Mesh *)world->objects[index], hit);
+        }
+        break;
+    case MT_OBJECT_SPHERE:
+        mt__render_handle_sphere(ray, (MT_Sphere *)world->objects[index], hit);
+        break;
+    case MT_OBJECT_INSTANCE:
+        mt__render_handle_instance(ray, (MT_Instance *)world->objects[index], hit, b_use_bvh);
+        break;
+    case MT_OBJECT_BOX:
+        mt__render_handle_box(ray, (MT_Box *)world->objects[index], hit);
+        break;
+    case MT_OBJECT_PLANE:
+        mt__render_handle_plane(ray, (MT_Plane *)world->objects[index], hit);
+        break;
+    case MT_OBJECT_SPHERE_CLOUD:
+        mt__render_handle_sphere_cloud(ray, (MT_SphereCloud *)world->objects[index], hit, b_use_bvh);
+        break;
+    }
+
+    if (hit->t < closest_t)
+    {
+        hit->object = index;
+    }
+}
+
+static float mt__render_handle_world_leaf(void *data, MT_Ray *ray, uint32_t prim_start, uint32_t prim_count)
 {
-    MT_RenderSettings settings;
+    MT_RenderQuery *query = (MT_RenderQuery *)data;
+    MT_World *world = (MT_World *)query->target;
 
-    pthread_t *threads;
-    MT_RenderChunk **render_chunks;
+    for (uint32_t i = prim_start; i < prim_start + prim_count; ++i)
+    {
+        mt__render_handle_object(ray, world, world->bvh->prims[i], query->hit, 1);
+    }
 
-    MT_RenderThreadStation thread_station;
-} MT_Renderer;
+    return query->hit->t;
+}
+
+static float mt__render_handle_grid_object(void *data, MT_Ray *ray, uint32_t object)
+{
+    MT_RenderQuery *query = (MT_RenderQuery *)data;
+    mt__render_handle_object(ray, (MT_World *)query->target, object, query->hit, 1);
+    return query->hit->t;
+}
 
-static void mt__render_handle_tri(MT_Ray *ray, MT_Tri *tri, MT_RayHit *hit_info, MT_Material *hit_mat)
+// the face normal, turned towards the ray, and material of the tri a record points at
+static void mt__render_resolve_mesh_hit(const MT_Mesh *mesh, const MT_HitRecord *record, MT_Vec3 *out_normal, MT_Material *out_mat)
 {
-    MT_RayHit ray_hit = mt__ray_hit_tri(ray, tri);
-    if (ray_hit.hit && ray_hit.t < hit_info->t)
+    uint32_t normal;
+    if (mesh->stream)
+    {
+        // the block was just tested, so it is normally still decoded
+        MT_MeshStream *stream = mesh->stream;
+        uint32_t slot;
+        MT_StreamBlock *decoded = mt__stream_acquire(stream, record->prim / MT_STREAM_BLOCK_TRIS, &slot);
+        uint32_t material = decoded->tri_materials[record->prim % MT_STREAM_BLOCK_TRIS];
+        normal = decoded->normals[record->prim % MT_STREAM_BLOCK_TRIS];
+        mt__stream_release(stream, slot);
+
+        *out_mat = material < stream->material_count ? stream->materials[material] : (MT_Material){0};
+    }
+    else
+    {
+        normal = mesh->normals[record->prim];
+        *out_mat = *mt__mesh_tri_material(mesh, record->prim);
+    }
+
+    *out_normal = mt__normal_unpack(normal);
+    if (record->is_backface)
     {
-        *hit_info = ray_hit;
-        *hit_mat = *tri->mat;
+        *out_normal = mt_vec3_negate(*out_normal);
     }
 }
 
-static void mt__render_handle_mesh(MT_Ray *ray, MT_Mesh *mesh, MT_RayHit *hit_info, MT_Material *hit_mat)
+// works out the position, normal and material of the closest hit only, every candidate before it was just a distance
+static void mt__render_resolve_hit(MT_World *world, const MT_Ray *ray, const MT_HitRecord *record, MT_RayHit *out_hit, MT_Material *out_mat)
 {
-    for (int i = 0; i < mesh->tri_index; ++i)
+    *out_hit = (MT_RayHit){0};
+    out_hit->t = FLT_MAX;
+    *out_mat = (MT_Material){0};
+
+    if (record->t == FLT_MAX)
+    {
+        return;
+    }
+
+    out_hit->hit = 1;
+    out_hit->t = record->t;
+    out_hit->pos = mt__ray_at(ray, record->t);
+    out_hit->is_backface = record->is_backface;
+
+    switch (world->objects_track[record->object])
+    {
+    case MT_OBJECT_MESH:
+        mt__render_resolve_mesh_hit((MT_Mesh *)world->objects[record->object], record, &out_hit->normal, out_mat);
+        break;
+    case MT_OBJECT_SPHERE:
+    {
+        MT_Sphere *sphere = (MT_Sphere *)world->objects[record->object];
+        out_hit->normal = mt_vec3_normalize(mt_vec3_sub(out_hit->pos, sphere->position));
+        out_hit->is_backface = (mt_vec3_dot(ray->direction, out_hit->normal) > 0.0f);
+        if (out_hit->is_backface)
+        {
+            out_hit->normal = mt_vec3_negate(out_hit->normal);
+        }
+        *out_mat = *sphere->mat;
+        break;
+    }
+    case MT_OBJECT_INSTANCE:
+    {
+        MT_Instance *instance = (MT_Instance *)world->objects[record->object];
+        MT_Vec3 normal;
+        mt__render_resolve_mesh_hit(instance->mesh, record, &normal, out_mat);
+        out_hit->normal = mt_vec3_normalize(mt__mat4x4_mult_dir(&instance->normal_to_world, normal));
+        break;
+    }
+    case MT_OBJECT_BOX:
+    {
+        MT_Box *box = (MT_Box *)world->objects[record->object];
+        out_hit->normal = box->axes[record->prim / 2];
+        if ((record->prim & 1) != record->is_backface)
+        {
+            out_hit->normal = mt_vec3_negate(out_hit->normal);
+        }
+        *out_mat = *box->mat;
+        break;
+    }
+    case MT_OBJECT_PLANE:
+    {
+        MT_Plane *plane = (MT_Plane *)world->objects[record->object];
+        out_hit->normal = record->is_backface ? mt_vec3_negate(plane->normal) : plane->normal;
+        *out_mat = *plane->mat;
+        break;
+    }
+    case MT_OBJECT_SPHERE_CLOUD:
     {
-        mt__render_handle_tri(ray, mesh->tris[i], hit_info, hit_mat);
+        MT_SphereCloud *cloud = (MT_SphereCloud *)world->objects[record->object];
+        out_hit->normal = mt_vec3_normalize(mt_vec3_sub(out_hit->pos, mt__sphere_cloud_center(cloud, record->prim)));
+        out_hit->is_backface = (mt_vec3_dot(ray->direction, out_hit->normal) > 0.0f);
+        if (out_hit->is_backface)
+        {
+            out_hit->normal = mt_vec3_negate(out_hit->normal);
+        }
+        *out_mat = *cloud->materials[cloud->sphere_materials[record->prim]];
+        break;
+    }
     }
 }
 
-static void mt__render_handle_sphere(MT_Ray *ray, MT_Sphere *sphere, MT_RayHit *hit_info, MT_Material *hit_mat)
+// the closest unbounded object also gives the traversal after it a tighter limit
+static void mt__render_handle_unbounded(MT_Ray *ray, MT_World *world, MT_HitRecord *hit)
 {
-    MT_RayHit ray_hit = mt__ray_hit_sphere(ray, sphere);
-    if (ray_hit.hit && ray_hit.t < hit_info->t)
+    for (unsigned int i = 0; i < world->unbounded_count; ++i)
     {
-        *hit_info = ray_hit;
-        *hit_mat = *sphere->mat;
+        mt__render_handle_object(ray, world, world->unbounded_objects[i], hit, 1);
     }
 }
 
 static void mt__ray_bvh(MT_World *world, MT_Ray *ray, MT_RayHit *out_hit, MT_Material *out_mat)
 {
-    MT_RayHit closest_hit = {0};
+    MT_HitRecord closest_hit = {0};
     closest_hit.t = FLT_MAX;
-    MT_Material closest_mat = {0};
 
-    MT_BVHNode *stack[64];
-    int stack_ptr = 0;
-    stack[0] = world->bvh;
-    ++stack_ptr;
+    mt__render_handle_unbounded(ray, world, &closest_hit);
 
-    while (stack_ptr > 0)
-    {
-        --stack_ptr;
-        MT_BVHNode *node = stack[stack_ptr];
+    MT_RenderQuery query = {world, &closest_hit};
+    mt__bvh_traverse(world->bvh, ray, closest_hit.t, mt__render_handle_world_leaf, &query);
 
-        if (!mt__ray_hit_bounds(ray, node->bounds))
-        {
-            continue;
-        }
+    mt__render_resolve_hit(world, ray, &closest_hit, out_hit, out_mat);
+}
 
-        if (node->leaf_object_index != -1)
-        {
-            MT_RayHit hit_info = {0};
-            hit_info.t = FLT_MAX;
-            MT_Material hit_mat = {0};
+static void mt__ray_grid(MT_World *world, MT_Ray *ray, MT_RayHit *out_hit, MT_Material *out_mat)
+{
+    MT_HitRecord closest_hit = {0};
+    closest_hit.t = FLT_MAX;
 
-            int index = node->leaf_object_index;
-            switch (world->objects_track[index])
-            {
-            case MT_OBJECT_MESH:
-                mt__render_handle_mesh(ray, (MT_Mesh *)world->objects[index], &hit_info, &hit_mat);
-                break;
-            case MT_OBJECT_SPHERE:
-                mt__render_handle_sphere(ray, (MT_Sphere *)world->objects[index], &hit_info, &hit_mat);
-                break;
-            }
+    mt__render_handle_unbounded(ray, world, &closest_hit);
 
-            if (hit_info.hit && hit_info.t < closest_hit.t)
-            {
-                closest_hit = hit_info;
-                closest_mat = hit_mat;
-            }
-        }
-        else
-        {
-            if (node->child_left && stack_ptr < 64)
-            {
-                stack[stack_ptr] = node->child_left;
-                stack_ptr++;
-            }
-            if (node->child_right && stack_ptr < 64)
-            {
-                stack[stack_ptr] = node->child_right;
-                stack_ptr++;
-            }
-        }
-    }
+    MT_RenderQuery query = {world, &closest_hit};
+    mt__grid_traverse(world->grid, ray, closest_hit.t, mt__render_handle_grid_object, &query);
 
-    *out_hit = closest_hit;
-    *out_mat = closest_mat;
+    mt__render_resolve_hit(world, ray, &closest_hit, out_hit, out_mat);
 }
 
-static void mt__ray_brute(MT_World *world, MT_Ray *ray, MT_RayHit *out_hit, MT_Material *out_mat)
+// b_use_mesh_bvh lets meshes still use their own triangle bvhs
+static void mt__ray_brute(MT_World *world, MT_Ray *ray, MT_RayHit *out_hit, MT_Material *out_mat, int b_use_mesh_bvh)
 {
-    MT_RayHit closest_hit = {0};
+    MT_HitRecord closest_hit = {0};
     closest_hit.t = FLT_MAX;
-    MT_Material closest_mat = {0};
 
     for (int k = 0; k < world->object_index; ++k)
     {
-        switch (world->objects_track[k])
-        {
-        case MT_OBJECT_MESH:
-            mt__render_handle_mesh(ray, (MT_Mesh *)world->objects[k], &closest_hit, &closest_mat);
-            break;
-        case MT_OBJECT_SPHERE:
-            mt__render_handle_sphere(ray, (MT_Sphere *)world->objects[k], &closest_hit, &closest_mat);
-            break;
-        }
+        mt__render_handle_object(ray, world, k, &closest_hit, b_use_mesh_bvh);
     }
 
-    *out_hit = closest_hit;
-    *out_mat = closest_mat;
+    mt__render_resolve_hit(world, ray, &closest_hit, out_hit, out_mat);
 }
 
 static void mt__render_chunk(void *data)
@@ -1724,6 +8669,8 @@ static void mt__render_chunk(void *data)
     MT_Vec3 viewport_top_left = mt_vec3_sub(rs->camera->position, (MT_Vec3){viewport_width / 2.0f, viewport_height / 2.0f, rs->camera->fov});
     MT_Vec3 pixel00_pos = mt_vec3_add(viewport_top_left, (MT_Vec3){0.5 * pixel_delta_u, 0.5 * pixel_delta_v, 0});
 
+    int b_use_bvh = rs->b_auto_bvh ? !rs->world->b_bvh_slower : rs->b_use_bvh;
+
     for (int i = rc->px_start; i < rc->px_end; ++i)
     {
         MT_RenderPixel *pixel = &rc->thread_station->pixels[i];
@@ -1783,13 +8730,17 @@ static void mt__render_chunk(void *data)
                 MT_RayHit hit = {0};
                 MT_Material mat = {0};
 
-                if (rs->b_use_bvh && rs->world->bvh)
+                if (rs->b_use_grid && rs->world->grid)
+                {
+                    mt__ray_grid(rs->world, &ray, &hit, &mat);
+                }
+                else if (b_use_bvh && rs->world->bvh)
                 {
                     mt__ray_bvh(rs->world, &ray, &hit, &mat);
                 }
                 else
                 {
-                    mt__ray_brute(rs->world, &ray, &hit, &mat);
+                    mt__ray_brute(rs->world, &ray, &hit, &mat, rs->b_auto_bvh);
                 }
 
                 if (hit.hit)
@@ -1861,7 +8812,7 @@ static void *mt__worker_thread(void *data)
 MT_Renderer *mt_renderer_create(unsigned int width, unsigned int height, unsigned int thread_count)
 {
     MT_Renderer *renderer = (MT_Renderer *)malloc(sizeof(MT_Renderer));
-    *renderer = (MT_Renderer){(MT_RenderSettings){NULL, NULL, width, height, 5, 20, 1, 1, 0}};
+    *renderer = (MT_Renderer){(MT_RenderSettings){NULL, NULL, width, height, 5, 20, 1, 1, 0, 1, 0}};
 
     renderer->threads = (pthread_t *)malloc(sizeof(pthread_t) * thread_count);
     renderer->render_chunks = (MT_RenderChunk **)malloc(sizeof(MT_RenderChunk *) * thread_count);
@@ -1908,6 +8859,12 @@ MT_Renderer *mt_renderer_create(unsigned int width, unsigned int height, unsigne
 void mt_renderer_set_world(MT_Renderer *renderer, MT_World *world)
 {
     renderer->settings.world = world;
+
+    // bvh builds run between renders, when the render threads would otherwise sit idle
+    if (world)
+    {
+        mt_world_set_bvh_thread_count(world, renderer->thread_station.thread_count);
+    }
 }
 
 void mt_renderer_set_camera(MT_Renderer *renderer, MT_Camera *camera)
@@ -1941,9 +8898,23 @@ void mt_renderer_enable_antialiasing(MT_Renderer *renderer, int b_enable)
     renderer->settings.b_antialias = b_enable;
 }
 
+// forces the bvh on or off, turning off the automatic choice
 void mt_renderer_enable_bvh(MT_Renderer *renderer, int b_enable)
 {
     renderer->settings.b_use_bvh = b_enable;
+    renderer->settings.b_auto_bvh = 0;
+}
+
+// on by default until mt_renderer_enable_bvh is called, uses the world bvh or brute force, whichever the last mt_world_recalculate_bvh estimated to be faster
+void mt_renderer_enable_auto_bvh(MT_Renderer *renderer, int b_enable)
+{
+    renderer->settings.b_auto_bvh = b_enable;
+}
+
+// takes priority over the bvh while the world has a grid built, mt_render rebuilds it first if objects were added or moved since
+void mt_renderer_enable_grid(MT_Renderer *renderer, int b_enable)
+{
+    renderer->settings.b_use_grid = b_enable;
 }
 
 void mt_renderer_delete(MT_Renderer *renderer)
@@ -2059,6 +9030,13 @@ void mt_render(MT_Renderer *renderer)
         return;
     }
 
+    // objects added or moved since the grid was built would be missing from it, a rebuild is o(n) like the first build
+    MT_World *world = renderer->settings.world;
+    if (renderer->settings.b_use_grid && world && world->grid && world->b_grid_dirty)
+    {
+        mt_world_recalculate_grid(world);
+    }
+
     pthread_mutex_lock(&renderer->thread_station.finished_mutex);
     renderer->thread_station.finished_count = 0;
     pthread_mutex_unlock(&renderer->thread_station.finished_mutex);
@@ -2082,6 +9060,464 @@ void mt_render(MT_Renderer *renderer)
     ++renderer->thread_station.progressive_index;
 }
 
+//////////////////////////////////////
+// ========== COST MODEL ========== //
+//////////////////////////////////////
+// nanoseconds per ray for each step of a query, measured once per process
+typedef struct MT_CostModel
+{
+    float tri;
+    float sphere;
+    float cloud_sphere; // one sphere of a cloud, tested a block at a time
+    float box;       // one slab test, what a tree that misses costs after its traversal is set up
+    float traversal; // setting up a traversal, also charged for moving a ray into an instance
+
+    // a visited node of each layout, including its share of the stack and leaf callbacks
+    float binary_node;
+    float wide_node;
+    float quantized_node;
+} MT_CostModel;
+
+static MT_CostModel mt__cost_model;
+static pthread_once_t mt__cost_model_once = PTHREAD_ONCE_INIT;
+
+#define MT_COST_CALIBRATION_TRIS 64
+#define MT_COST_CALIBRATION_RAYS 64
+#define MT_COST_CALIBRATION_ROUNDS 8
+
+static inline float mt__cost_random(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return 2.0f * (*state / (float)UINT_MAX) - 1.0f;
+}
+
+// keeps the fastest of a few rounds, so a round interrupted by another thread does not skew the model
+#define MT__COST_MEASURE(out, per_round, ...)                            \
+    do                                                                   \
+    {                                                                    \
+        double best = DBL_MAX;                                           \
+        for (int round = 0; round < MT_COST_CALIBRATION_ROUNDS; ++round) \
+        {                                                                \
+            double start = mt__time_ms();                                \
+            __VA_ARGS__;                                                 \
+            double elapsed = mt__time_ms() - start;                      \
+            best = elapsed < best ? elapsed : best;                      \
+        }                                                                \
+        (out) = (float)(best * 1000000.0 / (per_round));                 \
+    } while (0)
+
+static MT_Bounds mt__bvh_wide_node_bounds(const MT_BVH *bvh, uint32_t wide_index)
+{
+    MT_Bounds bounds = mt__bounds_create_invalid();
+
+    if (bvh->quantized_nodes)
+    {
+        const MT_BVHQuantizedNode *node = &bvh->quantized_nodes[wide_index];
+        for (uint32_t lane = 0; lane < node->child_count; ++lane)
+        {
+            bounds = mt__bounds_union(bounds, mt__bvh_dequantize_lane(node, lane));
+        }
+        return bounds;
+    }
+
+    const MT_BVHWideNode *node = &bvh->wide_nodes[wide_index];
+    for (uint32_t lane = 0; lane < node->child_count; ++lane)
+    {
+        MT_Bounds lane_bounds = {{node->min_x[lane], node->min_y[lane], node->min_z[lane]}, {node->max_x[lane], node->max_y[lane], node->max_z[lane]}};
+        bounds = mt__bounds_union(bounds, lane_bounds);
+    }
+    return bounds;
+}
+
+static inline float mt__area_ratio(MT_Bounds bounds, float root_area)
+{
+    return root_area > 0.0f ? fminf(mt__bounds_area(bounds) / root_area, 1.0f) : 1.0f;
+}
+
+// how many nodes of the traversed layout a ray entering the root visits on average, each is entered as often as its area allows
+static float mt__bvh_expected_node_visits(const MT_BVH *bvh)
+{
+    float root_area = mt__bounds_area(bvh->nodes[0].bounds);
+    float visits = 0.0f;
+
+    if (bvh->wide_slots)
+    {
+        for (uint32_t i = 0; i < bvh->wide_node_count; ++i)
+        {
+            visits += mt__area_ratio(mt__bvh_wide_node_bounds(bvh, i), root_area);
+        }
+        return visits;
+    }
+
+    for (uint32_t i = 0; i < bvh->node_count; ++i)
+    {
+        if (bvh->nodes[i].prim_count == 0)
+        {
+            visits += mt__area_ratio(bvh->nodes[i].bounds, root_area);
+        }
+    }
+    return visits;
+}
+
+static float mt__bvh_node_cost(const MT_BVH *bvh, const MT_CostModel *model)
+{
+    if (!bvh->wide_slots)
+    {
+        return model->binary_node;
+    }
+    return bvh->quantized_nodes ? model->quantized_node : model->wide_node;
+}
+
+// tris a ray entering a mesh's root is expected to test
+static float mt__bvh_expected_prim_tests(const MT_BVH *bvh)
+{
+    float root_area = mt__bounds_area(bvh->nodes[0].bounds);
+    float tests = 0.0f;
+
+    for (uint32_t i = 0; i < bvh->node_count; ++i)
+    {
+        const MT_BVHNode *node = &bvh->nodes[i];
+        if (node->prim_count > 0)
+        {
+            tests += mt__area_ratio(node->bounds, root_area) * node->prim_count;
+        }
+    }
+    return tests;
+}
+
+// traverses a small mesh in one layout and charges whatever the tri tests do not explain to the nodes the area model expects it to visit
+static float mt__cost_model_fit_node(MT_Mesh *mesh, const MT_Bounds *tri_bounds, const MT_Vec3 *tri_centers, const MT_Ray *rays, int b_wide, int b_quantized)
+{
+    MT_BVHSettings settings = (MT_BVHSettings){MT_BVH_BUILDER_SAH, 1, b_wide, b_quantized, 1, 0.0f, 0};
+    MT_BVH *bvh = mt__bvh_build(&settings, tri_bounds, tri_centers, mesh->tri_index, MT_BVH_TRI_PADDING, NULL, NULL);
+    mesh->bvh = bvh;
+
+    float traverse_cost;
+    MT__COST_MEASURE(traverse_cost, MT_COST_CALIBRATION_RAYS, {
+        for (int r = 0; r < MT_COST_CALIBRATION_RAYS; ++r)
+        {
+            MT_Ray ray = rays[r];
+            MT_HitRecord hit = {0};
+            hit.t = FLT_MAX;
+            MT_RenderQuery query = {mesh, &hit};
+            mt__bvh_traverse(bvh, &ray, FLT_MAX, mt__render_handle_mesh_leaf, &query);
+        }
+    });
+
+    float node_cost = (traverse_cost - mt__cost_model.traversal - mt__bvh_expected_prim_tests(bvh) * mt__cost_model.tri) / mt__bvh_expected_node_visits(bvh);
+
+    mt__bvh_delete(bvh);
+    mesh->bvh = NULL;
+
+    // a node is never free, even if the tris happened to run faster inside the tree than in the brute force loop
+    return fmaxf(node_cost, mt__cost_model.box);
+}
+
+// a short run over a mesh of random tris in a unit cube, with rays passing through it from outside
+static void mt__cost_model_calibrate(void)
+{
+    uint32_t state = 2463534242u;
+
+    MT_Vec3 vertices[MT_COST_CALIBRATION_TRIS * 3];
+    uint32_t indices[MT_COST_CALIBRATION_TRIS * 3];
+    uint32_t normals[MT_COST_CALIBRATION_TRIS];
+    uint32_t tri_materials[MT_COST_CALIBRATION_TRIS];
+    MT_Bounds tri_bounds[MT_COST_CALIBRATION_TRIS];
+    MT_Vec3 tri_centers[MT_COST_CALIBRATION_TRIS];
+    MT_Sphere spheres[MT_COST_CALIBRATION_TRIS];
+    MT_SphereBlock sphere_blocks[(MT_COST_CALIBRATION_TRIS + MT_TRI_BLOCK_WIDTH - 1) / MT_TRI_BLOCK_WIDTH] = {0};
+    MT_Material mat = {0};
+    MT_Material *materials[1] = {&mat};
+
+    MT_Mesh mesh = {0};
+    mesh.vertices = vertices;
+    mesh.indices = indices;
+    mesh.normals = normals;
+    mesh.tri_materials = tri_materials;
+    mesh.materials = materials;
+    mesh.material_count = 1;
+    mesh.max_materials = 1;
+    mesh.b_borrowed = 1;
+    mesh.tri_index = MT_COST_CALIBRATION_TRIS;
+    mesh.max_tris = MT_COST_CALIBRATION_TRIS;
+    mesh.vertex_index = MT_COST_CALIBRATION_TRIS * 3;
+    mesh.max_vertices = MT_COST_CALIBRATION_TRIS * 3;
+
+    for (int i = 0; i < MT_COST_CALIBRATION_TRIS; ++i)
+    {
+        MT_Vec3 center = (MT_Vec3){mt__cost_random(&state), mt__cost_random(&state), mt__cost_random(&state)};
+        for (int j = 0; j < 3; ++j)
+        {
+            MT_Vec3 offset = (MT_Vec3){mt__cost_random(&state), mt__cost_random(&state), mt__cost_random(&state)};
+            vertices[i * 3 + j] = mt_vec3_add(center, mt_vec3_mult_v(offset, 0.25f));
+            indices[i * 3 + j] = i * 3 + j;
+        }
+        tri_materials[i] = 0;
+        mt__mesh_recalculate_tri_normal(&mesh, i);
+
+        tri_bounds[i] = mt__bounds_create_invalid();
+        mt__bounds_shift_mesh_tri(&mesh, i, &tri_bounds[i]);
+        tri_centers[i] = center;
+
+        spheres[i].position = center;
+        spheres[i].radius = 0.1f;
+        spheres[i].mat = &mat;
+
+        MT_SphereBlock *block = &sphere_blocks[i / MT_TRI_BLOCK_WIDTH];
+        block->center[0][i % MT_TRI_BLOCK_WIDTH] = center.x;
+        block->center[1][i % MT_TRI_BLOCK_WIDTH] = center.y;
+        block->center[2][i % MT_TRI_BLOCK_WIDTH] = center.z;
+        block->radius[i % MT_TRI_BLOCK_WIDTH] = 0.1f;
+    }
+
+    mesh.b_bvh_dirty = 0;
+    mt__mesh_update_tri_blocks(&mesh);
+
+    MT_Ray rays[MT_COST_CALIBRATION_RAYS];
+    for (int i = 0; i < MT_COST_CALIBRATION_RAYS; ++i)
+    {
+        MT_Vec3 target = (MT_Vec3){mt__cost_random(&state), mt__cost_random(&state), mt__cost_random(&state)};
+        MT_Vec3 from = (MT_Vec3){mt__cost_random(&state), mt__cost_random(&state), mt__cost_random(&state)};
+        rays[i] = (MT_Ray){0};
+        rays[i].origin = mt_vec3_mult_v(mt_vec3_normalize(from), 4.0f);
+        rays[i].direction = mt_vec3_normalize(mt_vec3_sub(target, rays[i].origin));
+    }
+
+    const int tests = MT_COST_CALIBRATION_TRIS * MT_COST_CALIBRATION_RAYS;
+    volatile float sink = 0.0f;
+
+    MT__COST_MEASURE(mt__cost_model.tri, tests, {
+        for (int r = 0; r < MT_COST_CALIBRATION_RAYS; ++r)
+        {
+            MT_HitRecord hit = {0};
+            hit.t = FLT_MAX;
+            mt__render_handle_mesh(&rays[r], &mesh, &hit);
+            sink += hit.t;
+        }
+    });
+    MT__COST_MEASURE(mt__cost_model.sphere, tests, {
+        for (int r = 0; r < MT_COST_CALIBRATION_RAYS; ++r)
+        {
+            MT_HitRecord hit = {0};
+            hit.t = FLT_MAX;
+            for (int i = 0; i < MT_COST_CALIBRATION_TRIS; ++i)
+            {
+                mt__render_handle_sphere(&rays[r], &spheres[i], &hit);
+            }
+            sink += hit.t;
+        }
+    });
+    MT__COST_MEASURE(mt__cost_model.cloud_sphere, tests, {
+        for (int r = 0; r < MT_COST_CALIBRATION_RAYS; ++r)
+        {
+            MT_HitRecord hit = {0};
+            hit.t = FLT_MAX;
+            mt__render_handle_sphere_blocks(&rays[r], sphere_blocks, 0, MT_COST_CALIBRATION_TRIS, &hit);
+            sink += hit.t;
+        }
+    });
+    MT__COST_MEASURE(mt__cost_model.box, tests, {
+        for (int r = 0; r < MT_COST_CALIBRATION_RAYS; ++r)
+        {
+            MT_RaySlab slab = mt__ray_slab_create(&rays[r]);
+            for (int i = 0; i < MT_COST_CALIBRATION_TRIS; ++i)
+            {
+                sink += mt__ray_hit_bounds(&slab, &tri_bounds[i], FLT_MAX);
+            }
+        }
+    });
+    MT__COST_MEASURE(mt__cost_model.traversal, tests, {
+        for (int r = 0; r < MT_COST_CALIBRATION_RAYS; ++r)
+        {
+            for (int i = 0; i < MT_COST_CALIBRATION_TRIS; ++i)
+            {
+                sink += mt__ray_slab_create(&rays[r]).inv_dir.x;
+            }
+        }
+    });
+
+    mt__cost_model.binary_node = mt__cost_model_fit_node(&mesh, tri_bounds, tri_centers, rays, 0, 0);
+    mt__cost_model.wide_node = mt__cost_model_fit_node(&mesh, tri_bounds, tri_centers, rays, 1, 0);
+    mt__cost_model.quantized_node = mt__cost_model_fit_node(&mesh, tri_bounds, tri_centers, rays, 0, 1);
+
+    mt__aligned_free(mesh.tri_blocks);
+    (void)sink;
+}
+
+static const MT_CostModel *mt__cost_model_get(void)
+{
+    pthread_once(&mt__cost_model_once, mt__cost_model_calibrate);
+    return &mt__cost_model;
+}
+
+// expected cost of a ray that reaches a tree, each prim it tests costs prim_cost
+static float mt__bvh_estimate_ray_cost(const MT_BVH *bvh, float prim_cost)
+{
+    const MT_CostModel *model = mt__cost_model_get();
+    return model->traversal + mt__bvh_expected_node_visits(bvh) * mt__bvh_node_cost(bvh, model) + mt__bvh_expected_prim_tests(bvh) * prim_cost;
+}
+
+// expected cost of a ray that reaches a tree built over tris
+static float mt__bvh_estimate_tri_ray_cost(const MT_BVH *bvh)
+{
+    return mt__bvh_estimate_ray_cost(bvh, mt__cost_model_get()->tri);
+}
+
+// decides whether a ray that reaches the mesh is cheaper through its triangle bvh or against every triangle
+static void mt__mesh_estimate_cost(MT_Mesh *mesh)
+{
+    const MT_CostModel *model = mt__cost_model_get();
+    float brute_cost = mesh->tri_index * model->tri;
+
+    mesh->b_bvh_slower = 1;
+    mesh->ray_cost = brute_cost;
+
+    MT_BVH *bvh = mesh->bvh;
+    if (!bvh)
+    {
+        return;
+    }
+
+    float bvh_cost = mt__bvh_estimate_tri_ray_cost(bvh);
+    if (bvh_cost < brute_cost)
+    {
+        mesh->b_bvh_slower = 0;
+        mesh->ray_cost = bvh_cost;
+    }
+}
+
+// the same choice for a cloud, between its sphere bvh and every block
+static void mt__sphere_cloud_estimate_cost(MT_SphereCloud *cloud)
+{
+    const MT_CostModel *model = mt__cost_model_get();
+    float brute_cost = cloud->sphere_index * model->cloud_sphere;
+
+    cloud->b_bvh_slower = 1;
+    cloud->ray_cost = brute_cost;
+
+    MT_BVH *bvh = cloud->bvh;
+    if (!bvh)
+    {
+        return;
+    }
+
+    float bvh_cost = mt__bvh_estimate_ray_cost(bvh, model->cloud_sphere);
+    if (bvh_cost < brute_cost)
+    {
+        cloud->b_bvh_slower = 0;
+        cloud->ray_cost = bvh_cost;
+    }
+}
+
+// the cost of an object once a ray reaches it, and its cost for a ray that is only somewhere in the world
+// a mesh's or cloud's tree rejects rays that miss it after one box test, so the rest of its cost only counts as often as its area is hit
+static void mt__world_object_cost(MT_World *world, uint32_t index, const MT_CostModel *model, float world_area, float *out_reached, float *out_anywhere)
+{
+    MT_Mesh *mesh = NULL;
+    float instance_cost = 0.0f;
+    float ray_cost = 0.0f;
+    int b_culls = 0; // whether its own tree rejects rays that miss it
+
+    switch (world->objects_track[index])
+    {
+    case MT_OBJECT_SPHERE:
+    case MT_OBJECT_PLANE:
+        *out_reached = model->sphere;
+        *out_anywhere = model->sphere;
+        return;
+    case MT_OBJECT_BOX:
+        // the ray is projected onto the box's axes first, about what moving it into an instance's space costs
+        *out_reached = model->traversal + model->box;
+        *out_anywhere = *out_reached;
+        return;
+    case MT_OBJECT_MESH:
+        mesh = (MT_Mesh *)world->objects[index];
+        break;
+    case MT_OBJECT_INSTANCE:
+        mesh = ((MT_Instance *)world->objects[index])->mesh;
+        instance_cost = model->traversal;
+        break;
+    case MT_OBJECT_SPHERE_CLOUD:
+        MT_SphereCloud *cloud = (MT_SphereCloud *)world->objects[index];
+        ray_cost = cloud->ray_cost;
+        b_culls = cloud->bvh && !cloud->b_bvh_slower;
+        break;
+    }
+
+    if (mesh)
+    {
+        ray_cost = mesh->ray_cost;
+        b_culls = mesh->bvh && !mesh->b_bvh_slower;
+    }
+
+    *out_reached = instance_cost + ray_cost;
+    *out_anywhere = *out_reached;
+    if (b_culls)
+    {
+        float entry_cost = model->traversal + model->box;
+        *out_anywhere = instance_cost + entry_cost + mt__area_ratio(world->object_bounds[index], world_area) * (ray_cost - entry_cost);
+    }
+}
+
+// decides whether rays are cheaper through the world bvh or against every object, for a ray starting inside the world's bounds
+static void mt__world_estimate_cost(MT_World *world)
+{
+    const MT_CostModel *model = mt__cost_model_get();
+    MT_BVH *bvh = world->bvh;
+
+    // a world of only planes has no tree to weigh, rays test every object
+    if (!bvh)
+    {
+        world->brute_ray_cost = 0.0f;
+        world->bvh_ray_cost = 0.0f;
+        world->b_bvh_slower = 1;
+        return;
+    }
+
+    float root_area = mt__bounds_area(bvh->nodes[0].bounds);
+
+    float *reached_costs = (float *)malloc(sizeof(float) * world->object_index);
+    float brute_cost = 0.0f;
+    for (uint32_t i = 0; i < world->object_index; ++i)
+    {
+        float anywhere_cost;
+        mt__world_object_cost(world, i, model, root_area, &reached_costs[i], &anywhere_cost);
+        brute_cost += anywhere_cost;
+    }
+
+    float bvh_cost = model->traversal + mt__bvh_expected_node_visits(bvh) * mt__bvh_node_cost(bvh, model);
+
+    // planes are tested before the traversal either way
+    for (uint32_t i = 0; i < world->unbounded_count; ++i)
+    {
+        bvh_cost += reached_costs[world->unbounded_objects[i]];
+    }
+
+    for (uint32_t i = 0; i < bvh->node_count; ++i)
+    {
+        const MT_BVHNode *node = &bvh->nodes[i];
+        if (node->prim_count == 0)
+        {
+            continue;
+        }
+
+        float leaf_cost = 0.0f;
+        for (uint32_t j = node->index; j < node->index + node->prim_count; ++j)
+        {
+            leaf_cost += reached_costs[bvh->prims[j]];
+        }
+        bvh_cost += mt__area_ratio(node->bounds, root_area) * leaf_cost;
+    }
+
+    free(reached_costs);
+
+    world->brute_ray_cost = brute_cost;
+    world->bvh_ray_cost = bvh_cost;
+    world->b_bvh_slower = bvh_cost >= brute_cost;
+}
+
 ///////////////////////////////
 // ========== BMP ========== //
 ///////////////////////////////